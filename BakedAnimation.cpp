@@ -0,0 +1,108 @@
+#include "BakedAnimation.h"
+#include "Object.h"
+#include <algorithm>
+#include <cmath>
+
+void BakedAnimation::bake(Animation& animation, float rate)
+{
+	clear();
+	sampleRate = rate;
+	boneCount = static_cast<int>(animation.skeleton.bones.size());
+
+	std::vector<DirectX::XMFLOAT4X4> pose(boneCount);
+	const std::vector<int> allBones;
+	for (int handle = 0; handle < static_cast<int>(animation.sequences.size()); handle++)
+	{
+		Clip clip;
+		clip.firstFrame = frameCount();
+		clip.duration = animation.sequences[handle].getDuration();
+		clip.loop = handle != animation.deathSequence;
+		//a loop's frame at duration is its first frame again, the held clip needs its end pose
+		clip.frameCount = std::max(1, static_cast<int>(std::ceil(clip.duration * rate)) + (clip.loop ? 0 : 1));
+		clips.push_back(clip);
+
+		data.resize(static_cast<size_t>(clip.firstFrame + clip.frameCount) * boneCount * halfsPerBone);
+		for (int f = 0; f < clip.frameCount; f++)
+		{
+			//the same steps as AnimationInstance::update with every bone evaluated
+			int frame = 0;
+			float interpolationFact = 0.0f;
+			animation.calcFrame(handle, std::min(f / rate, clip.duration), frame, interpolationFact);
+			animation.interpolateBonesToGlobal(handle, pose, frame, interpolationFact, !clip.loop, allBones);
+			animation.calcFinalTransformations(pose, allBones);
+
+			DirectX::PackedVector::HALF* out = &data[static_cast<size_t>(clip.firstFrame + f) * boneCount * halfsPerBone];
+			for (int b = 0; b < boneCount; b++)
+			{
+				const float* rows = &pose[b]._11;
+				for (int k = 0; k < halfsPerBone; k++)
+				{
+					*out++ = DirectX::PackedVector::XMConvertFloatToHalf(rows[k]);
+				}
+			}
+		}
+	}
+}
+
+void BakedAnimation::clear()
+{
+	clips.clear();
+	data.clear();
+	boneCount = 0;
+}
+
+int BakedAnimation::frameCount() const
+{
+	if (boneCount == 0) return 0;
+	return static_cast<int>(data.size() / (static_cast<size_t>(boneCount) * halfsPerBone));
+}
+
+size_t BakedAnimation::sizeInBytes() const
+{
+	return data.size() * sizeof(DirectX::PackedVector::HALF);
+}
+
+int BakedAnimation::frameIndex(const BakedClipState& state, float now) const
+{
+	//an instance without a valid clip shows the first baked frame
+	if (state.clip < 0 || state.clip >= static_cast<int>(clips.size())) return 0;
+	const Clip& clip = clips[state.clip];
+	float local = std::max(0.0f, now - state.startTime);
+	if (clip.loop && clip.duration > 0.0f)
+	{
+		local = std::fmod(local, clip.duration);
+	}
+	//nearest baked frame, a loop's last half frame rounds onto its first frame
+	int f = static_cast<int>(local * sampleRate + 0.5f);
+	if (clip.loop)
+	{
+		f = f % clip.frameCount;
+	}
+	else
+	{
+		f = std::min(f, clip.frameCount - 1);
+	}
+	return clip.firstFrame + f;
+}
+
+int BakedAnimation::boneOffset(const BakedClipState& state, float now) const
+{
+	return frameIndex(state, now) * boneCount;
+}
+
+void BakedAnimation::decode(int frame, std::vector<DirectX::XMFLOAT4X4>& bones) const
+{
+	const DirectX::PackedVector::HALF* in = &data[static_cast<size_t>(frame) * boneCount * halfsPerBone];
+	for (int b = 0; b < boneCount; b++)
+	{
+		float* rows = &bones[b]._11;
+		for (int k = 0; k < halfsPerBone; k++)
+		{
+			rows[k] = DirectX::PackedVector::XMConvertHalfToFloat(*in++);
+		}
+		bones[b]._41 = 0.0f;
+		bones[b]._42 = 0.0f;
+		bones[b]._43 = 0.0f;
+		bones[b]._44 = 1.0f;
+	}
+}
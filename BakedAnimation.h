@@ -0,0 +1,49 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <vector>
+
+class Animation;
+
+//what a baked instance needs per frame: its clip and when it started playing
+struct BakedClipState {
+	int clip = -1;
+	float startTime = 0.0f;
+};
+
+//every clip of an Animation sampled at a fixed rate into one atlas of final skinning matrices
+//a baked frame is laid out like one BonePalette range but in halfs: boneCount bones of three rows of four,
+//so the dynamic vertex shader reads it through the same Buffer<float4> code with a R16G16B16A16_FLOAT view
+//and an instance only has to point its BoneOffset at the frame it is on
+//looping clips wrap at their duration, the death clip holds its last frame
+class BakedAnimation {
+public:
+	static const int halfsPerBone = 12;
+
+	struct Clip {
+		int firstFrame = 0;
+		int frameCount = 0;
+		float duration = 0.0f;
+		bool loop = true;
+	};
+
+	float sampleRate = 0.0f;
+	int boneCount = 0;
+	std::vector<Clip> clips;
+	std::vector<DirectX::PackedVector::HALF> data;
+
+	//sample every clip at sampleRate frames per second, clip handles stay the same
+	void bake(Animation& animation, float rate);
+	void clear();
+
+	int frameCount() const;
+	size_t sizeInBytes() const;
+
+	//atlas frame shown at time now for an instance that started clip at startTime
+	int frameIndex(const BakedClipState& state, float now) const;
+	//the same frame as the first bone of the palette, for InstanceData_General::BoneOffset
+	int boneOffset(const BakedClipState& state, float now) const;
+
+	//unpack one frame into column-vector matrices like AnimationInstance::BonesTransforms, for checks on the CPU
+	void decode(int frame, std::vector<DirectX::XMFLOAT4X4>& bones) const;
+};
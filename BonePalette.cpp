@@ -0,0 +1,48 @@
+#include "BonePalette.h"
+#include <algorithm>
+
+int BonePalette::allocate(int boneCount)
+{
+	boneCount = std::max(0, boneCount);
+	offsets.push_back(totalBones());
+	boneCounts.push_back(boneCount);
+	data.resize(static_cast<size_t>(totalBones() + boneCount) * floatsPerBone);
+	return instanceCount() - 1;
+}
+
+void BonePalette::clear()
+{
+	data.clear();
+	offsets.clear();
+	boneCounts.clear();
+}
+
+int BonePalette::instanceCount() const
+{
+	return static_cast<int>(offsets.size());
+}
+
+int BonePalette::totalBones() const
+{
+	return static_cast<int>(data.size() / floatsPerBone);
+}
+
+size_t BonePalette::sizeInBytes() const
+{
+	return data.size() * sizeof(float);
+}
+
+void BonePalette::write(int instance, const std::vector<DirectX::XMFLOAT4X4>& bones)
+{
+	int count = std::min(boneCounts[instance], static_cast<int>(bones.size()));
+	float* out = data.data() + static_cast<size_t>(offsets[instance]) * floatsPerBone;
+	//three unaligned 16-byte loads and stores per bone, the constant last row is dropped
+	for (int i = 0; i < count; i++)
+	{
+		const DirectX::XMFLOAT4* rows = reinterpret_cast<const DirectX::XMFLOAT4*>(bones[i].m);
+		DirectX::XMFLOAT4* dst = reinterpret_cast<DirectX::XMFLOAT4*>(out + i * floatsPerBone);
+		DirectX::XMStoreFloat4(&dst[0], DirectX::XMLoadFloat4(&rows[0]));
+		DirectX::XMStoreFloat4(&dst[1], DirectX::XMLoadFloat4(&rows[1]));
+		DirectX::XMStoreFloat4(&dst[2], DirectX::XMLoadFloat4(&rows[2]));
+	}
+}
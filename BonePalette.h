@@ -0,0 +1,30 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+//CPU side of the bone palette uploaded to the dynamic vertex shader
+//every skinned instance owns one contiguous range of matrices sized to its skeleton's real bone count,
+//the instance data carries the first bone of that range so the shader reads palette[offset + boneID]
+//the palette grows with the instance count and never touches the GPU, the renderer only uploads data
+//skinning matrices are affine, so only their first three rows are stored and the shader rebuilds (0,0,0,1)
+class BonePalette {
+public:
+	static const int floatsPerBone = 12;
+
+	//packed 3x4 matrices, floatsPerBone floats per bone
+	std::vector<float> data;
+	//first bone and bone count of each instance
+	std::vector<int> offsets;
+	std::vector<int> boneCounts;
+
+	//reserve a range for one more instance and return its index
+	int allocate(int boneCount);
+	void clear();
+
+	int instanceCount() const;
+	int totalBones() const;
+	size_t sizeInBytes() const;
+
+	//pack the instance's bones into its range, extra matrices in bones are ignored
+	void write(int instance, const std::vector<DirectX::XMFLOAT4X4>& bones);
+};
@@ -0,0 +1,342 @@
+#include "ClipCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+	const float halfSqrt2 = 0.70710678f;
+
+	//smallest-three: drop the largest component, made positive so it can be rebuilt from the other three
+	void encodeQuaternion(const DirectX::XMFLOAT4A& q, uint16_t out[3])
+	{
+		float c[4] = { q.x, q.y, q.z, q.w };
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (std::fabs(c[i]) > std::fabs(c[largest])) largest = i;
+		}
+		float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+		uint16_t v[3];
+		int k = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest) continue;
+			float x = std::max(-halfSqrt2, std::min(halfSqrt2, c[i] * sign));
+			v[k++] = static_cast<uint16_t>(std::lround((x / halfSqrt2 * 0.5f + 0.5f) * 32767.0f));
+		}
+		out[0] = static_cast<uint16_t>(v[0] | ((largest & 1) << 15));
+		out[1] = static_cast<uint16_t>(v[1] | ((largest >> 1) << 15));
+		out[2] = v[2];
+	}
+
+	DirectX::XMVECTOR decodeQuaternion(const uint16_t* in)
+	{
+		int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+		float v[3];
+		for (int k = 0; k < 3; k++)
+		{
+			v[k] = ((in[k] & 0x7fff) * (2.0f / 32767.0f) - 1.0f) * halfSqrt2;
+		}
+		float w = std::sqrt(std::max(0.0f, 1.0f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2]));
+		float c[4];
+		int k = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			c[i] = i == largest ? w : v[k++];
+		}
+		return DirectX::XMVectorSet(c[0], c[1], c[2], c[3]);
+	}
+
+	DirectX::XMVECTOR decodeRange(const uint16_t* in, DirectX::FXMVECTOR minimum, DirectX::FXMVECTOR step)
+	{
+		DirectX::XMVECTOR q = DirectX::XMVectorSet(in[0], in[1], in[2], 0.0f);
+		return DirectX::XMVectorMultiplyAdd(q, step, minimum);
+	}
+
+	DirectX::XMVECTOR lerp(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, float t)
+	{
+		return DirectX::XMVectorLerp(a, b, t);
+	}
+
+	//nlerp along the shorter arc, like the raw sampler
+	DirectX::XMVECTOR nlerp(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, float t)
+	{
+		DirectX::XMVECTOR target = DirectX::XMVectorGetX(DirectX::XMVector4Dot(a, b)) < 0.0f ? DirectX::XMVectorNegate(b) : b;
+		return DirectX::XMVector4Normalize(DirectX::XMVectorLerp(a, target, t));
+	}
+
+	float maxDifference(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+	{
+		DirectX::XMFLOAT4 d;
+		DirectX::XMStoreFloat4(&d, DirectX::XMVectorAbs(DirectX::XMVectorSubtract(a, b)));
+		return std::max(std::max(d.x, d.y), std::max(d.z, d.w));
+	}
+
+	float quaternionDifference(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+	{
+		//q and -q are the same rotation
+		return std::min(maxDifference(a, b), maxDifference(a, DirectX::XMVectorNegate(b)));
+	}
+
+	//frames to keep so interpolating between the quantized keys stays within error of every raw frame
+	//greedy: each key is followed by the farthest frame that still reproduces everything in between
+	//empty when quantizing a frame on its own already misses by more than error, any key would break the bound
+	std::vector<int> reduceKeys(int frames, const std::function<DirectX::XMVECTOR(int)>& raw, const std::function<DirectX::XMVECTOR(int)>& quantized,
+		bool quaternion, float error)
+	{
+		auto difference = quaternion ? quaternionDifference : maxDifference;
+		auto interpolate = quaternion ? nlerp : lerp;
+
+		for (int f = 0; f < frames; f++)
+		{
+			if (!(difference(quantized(f), raw(f)) <= error)) return {};
+		}
+
+		bool constant = true;
+		DirectX::XMVECTOR first = quantized(0);
+		for (int f = 0; f < frames && constant; f++)
+		{
+			constant = difference(first, raw(f)) <= error;
+		}
+		if (constant) return { 0 };
+
+		std::vector<int> keys = { 0 };
+		int a = 0;
+		int b = 1;
+		while (b < frames - 1)
+		{
+			int candidate = b + 1;
+			DirectX::XMVECTOR va = quantized(a);
+			DirectX::XMVECTOR vc = quantized(candidate);
+			bool fits = true;
+			for (int f = a + 1; f < candidate && fits; f++)
+			{
+				float u = static_cast<float>(f - a) / static_cast<float>(candidate - a);
+				fits = difference(interpolate(va, vc, u), raw(f)) <= error;
+			}
+			if (fits)
+			{
+				b = candidate;
+			}
+			else
+			{
+				keys.push_back(b);
+				a = b;
+				b = a + 1;
+			}
+		}
+		keys.push_back(frames - 1);
+		return keys;
+	}
+}
+
+int CompressedClip::Track::findKey(const Channel& channel, int frame) const
+{
+	const uint16_t* begin = frames.data() + channel.firstKey;
+	const uint16_t* end = begin + channel.keyCount;
+	return static_cast<int>(std::upper_bound(begin, end, static_cast<uint16_t>(frame)) - begin) - 1;
+}
+
+void CompressedClip::Track::segment(const Channel& channel, int frame, int nextFrame, float interpolationFact, uint32_t& a, uint32_t& b, float& u) const
+{
+	a = channel.firstKey;
+	b = a;
+	u = 0.0f;
+	if (channel.keyCount < 2) return;
+	a += findKey(channel, frame);
+	if (a + 1 < channel.firstKey + channel.keyCount)
+	{
+		b = a + 1;
+		u = (static_cast<float>(frame - frames[a]) + interpolationFact) / static_cast<float>(frames[b] - frames[a]);
+	}
+	else
+	{
+		//past the last key the clip goes on to nextFrame, the first frame of a loop or the held last frame
+		b = nextFrame < frame ? channel.firstKey : a;
+		u = interpolationFact;
+	}
+}
+
+const uint16_t* CompressedClip::Track::quantizedKey(const Channel& channel, uint32_t key) const
+{
+	return &keys[(channel.firstValue + key - channel.firstKey) * 3];
+}
+
+DirectX::XMVECTOR CompressedClip::Track::rawKey(const Channel& channel, uint32_t key) const
+{
+	return DirectX::XMLoadFloat4(&rawKeys[channel.firstValue + key - channel.firstKey]);
+}
+
+size_t CompressedClip::Track::sizeInBytes() const
+{
+	return channels.size() * sizeof(Channel) + frames.size() * sizeof(uint16_t) + keys.size() * sizeof(uint16_t) + rawKeys.size() * sizeof(DirectX::XMFLOAT4);
+}
+
+bool CompressedClip::empty() const
+{
+	return boneCount == 0;
+}
+
+size_t CompressedClip::sizeInBytes() const
+{
+	return positions.sizeInBytes() + rotations.sizeInBytes() + scales.sizeInBytes()
+		+ (positionMin.size() + positionStep.size() + scaleMin.size() + scaleStep.size()) * sizeof(DirectX::XMFLOAT4A);
+}
+
+int CompressedClip::keyCount() const
+{
+	return static_cast<int>(positions.frames.size() + rotations.frames.size() + scales.frames.size());
+}
+
+void CompressedClip::build(int frames, int bones, int boneStride, const std::vector<DirectX::XMFLOAT4A>& rawPositions, const std::vector<DirectX::XMFLOAT4A>& rawQuaternions, const std::vector<DirectX::XMFLOAT4A>& rawScales, const ClipCompressionSettings& settings)
+{
+	*this = CompressedClip();
+	//key frames are stored in 16 bits
+	if (frames <= 0 || frames > 65535 || bones <= 0) return;
+	frameCount = frames;
+	boneCount = bones;
+	positionMin.resize(bones);
+	positionStep.resize(bones);
+	scaleMin.resize(bones);
+	scaleStep.resize(bones);
+
+	auto at = [boneStride](int frame, int bone) { return static_cast<size_t>(frame) * boneStride + bone; };
+
+	//per bone range of a channel over this clip, quantized to 16 bits per component
+	auto range = [&](const std::vector<DirectX::XMFLOAT4A>& raw, int bone, DirectX::XMFLOAT4A& minimum, DirectX::XMFLOAT4A& step)
+	{
+		DirectX::XMVECTOR lo = DirectX::XMLoadFloat4A(&raw[at(0, bone)]);
+		DirectX::XMVECTOR hi = lo;
+		for (int f = 1; f < frames; f++)
+		{
+			DirectX::XMVECTOR v = DirectX::XMLoadFloat4A(&raw[at(f, bone)]);
+			lo = DirectX::XMVectorMin(lo, v);
+			hi = DirectX::XMVectorMax(hi, v);
+		}
+		lo = DirectX::XMVectorSetW(lo, 0.0f);
+		DirectX::XMStoreFloat4A(&minimum, lo);
+		DirectX::XMStoreFloat4A(&step, DirectX::XMVectorSetW(DirectX::XMVectorScale(DirectX::XMVectorSubtract(hi, lo), 1.0f / 65535.0f), 0.0f));
+	};
+	auto encodeRange = [](const DirectX::XMFLOAT4A& v, const DirectX::XMFLOAT4A& minimum, const DirectX::XMFLOAT4A& step, uint16_t out[3])
+	{
+		const float* value = &v.x;
+		const float* lo = &minimum.x;
+		const float* s = &step.x;
+		for (int k = 0; k < 3; k++)
+		{
+			out[k] = s[k] > 0.0f ? static_cast<uint16_t>(std::max(0L, std::min(65535L, std::lround((value[k] - lo[k]) / s[k])))) : 0;
+		}
+	};
+
+	//a channel the 16 bit keys cannot hold within error keeps raw keys, reduced against the raw frames themselves
+	auto addChannel = [frames](Track& track, const std::function<DirectX::XMVECTOR(int)>& raw, const std::function<DirectX::XMVECTOR(int)>& quantized,
+		const std::function<void(int, uint16_t*)>& encode, bool quaternion, float error)
+	{
+		std::vector<int> keep = reduceKeys(frames, raw, quantized, quaternion, error);
+		Channel channel;
+		channel.raw = keep.empty();
+		if (channel.raw) keep = reduceKeys(frames, raw, raw, quaternion, error);
+		channel.firstKey = static_cast<uint32_t>(track.frames.size());
+		channel.keyCount = static_cast<uint32_t>(keep.size());
+		channel.firstValue = static_cast<uint32_t>(channel.raw ? track.rawKeys.size() : track.keys.size() / 3);
+		for (int f : keep)
+		{
+			track.frames.push_back(static_cast<uint16_t>(f));
+			if (channel.raw)
+			{
+				DirectX::XMFLOAT4 value;
+				DirectX::XMStoreFloat4(&value, raw(f));
+				track.rawKeys.push_back(value);
+				continue;
+			}
+			uint16_t key[3];
+			encode(f, key);
+			track.keys.insert(track.keys.end(), key, key + 3);
+		}
+		track.channels.push_back(channel);
+	};
+
+	for (int bone = 0; bone < bones; bone++)
+	{
+		range(rawPositions, bone, positionMin[bone], positionStep[bone]);
+		range(rawScales, bone, scaleMin[bone], scaleStep[bone]);
+		DirectX::XMVECTOR pMin = DirectX::XMLoadFloat4A(&positionMin[bone]);
+		DirectX::XMVECTOR pStep = DirectX::XMLoadFloat4A(&positionStep[bone]);
+		DirectX::XMVECTOR sMin = DirectX::XMLoadFloat4A(&scaleMin[bone]);
+		DirectX::XMVECTOR sStep = DirectX::XMLoadFloat4A(&scaleStep[bone]);
+
+		auto encodePosition = [&](int f, uint16_t* key) { encodeRange(rawPositions[at(f, bone)], positionMin[bone], positionStep[bone], key); };
+		auto encodeScale = [&](int f, uint16_t* key) { encodeRange(rawScales[at(f, bone)], scaleMin[bone], scaleStep[bone], key); };
+		auto encodeRotation = [&](int f, uint16_t* key) { encodeQuaternion(rawQuaternions[at(f, bone)], key); };
+
+		auto rawPosition = [&](int f) { return DirectX::XMVectorSetW(DirectX::XMLoadFloat4A(&rawPositions[at(f, bone)]), 0.0f); };
+		auto rawScale = [&](int f) { return DirectX::XMVectorSetW(DirectX::XMLoadFloat4A(&rawScales[at(f, bone)]), 0.0f); };
+		auto rawRotation = [&](int f) { return DirectX::XMLoadFloat4A(&rawQuaternions[at(f, bone)]); };
+		auto quantizedPosition = [&](int f) { uint16_t key[3]; encodePosition(f, key); return decodeRange(key, pMin, pStep); };
+		auto quantizedScale = [&](int f) { uint16_t key[3]; encodeScale(f, key); return decodeRange(key, sMin, sStep); };
+		auto quantizedRotation = [&](int f) { uint16_t key[3]; encodeRotation(f, key); return decodeQuaternion(key); };
+
+		addChannel(positions, rawPosition, quantizedPosition, encodePosition, false, settings.positionError);
+		addChannel(rotations, rawRotation, quantizedRotation, encodeRotation, true, settings.rotationError);
+		addChannel(scales, rawScale, quantizedScale, encodeScale, false, settings.scaleError);
+	}
+}
+
+DirectX::XMVECTOR CompressedClip::samplePosition(int bone, int frame, int nextFrame, float interpolationFact) const
+{
+	const Channel& channel = positions.channels[bone];
+	uint32_t a, b;
+	float u;
+	positions.segment(channel, frame, nextFrame, interpolationFact, a, b, u);
+	DirectX::XMVECTOR minimum = DirectX::XMLoadFloat4A(&positionMin[bone]);
+	DirectX::XMVECTOR step = DirectX::XMLoadFloat4A(&positionStep[bone]);
+	auto key = [&](uint32_t k) { return channel.raw ? positions.rawKey(channel, k) : decodeRange(positions.quantizedKey(channel, k), minimum, step); };
+	DirectX::XMVECTOR va = key(a);
+	if (a == b) return va;
+	return lerp(va, key(b), u);
+}
+
+DirectX::XMVECTOR CompressedClip::sampleRotation(int bone, int frame, int nextFrame, float interpolationFact) const
+{
+	const Channel& channel = rotations.channels[bone];
+	uint32_t a, b;
+	float u;
+	rotations.segment(channel, frame, nextFrame, interpolationFact, a, b, u);
+	auto key = [&](uint32_t k) { return channel.raw ? rotations.rawKey(channel, k) : decodeQuaternion(rotations.quantizedKey(channel, k)); };
+	DirectX::XMVECTOR va = key(a);
+	if (a == b) return va;
+	return nlerp(va, key(b), u);
+}
+
+DirectX::XMVECTOR CompressedClip::sampleScale(int bone, int frame, int nextFrame, float interpolationFact) const
+{
+	const Channel& channel = scales.channels[bone];
+	uint32_t a, b;
+	float u;
+	scales.segment(channel, frame, nextFrame, interpolationFact, a, b, u);
+	DirectX::XMVECTOR minimum = DirectX::XMLoadFloat4A(&scaleMin[bone]);
+	DirectX::XMVECTOR step = DirectX::XMLoadFloat4A(&scaleStep[bone]);
+	auto key = [&](uint32_t k) { return channel.raw ? scales.rawKey(channel, k) : decodeRange(scales.quantizedKey(channel, k), minimum, step); };
+	DirectX::XMVECTOR va = key(a);
+	if (a == b) return va;
+	return lerp(va, key(b), u);
+}
+
+void CompressedClip::sampleBlock(int frame, int nextFrame, float interpolationFact, int bone, DirectX::XMVECTOR position[4], DirectX::XMVECTOR quaternion[4], DirectX::XMVECTOR scale[4]) const
+{
+	for (int k = 0; k < 4; k++)
+	{
+		int i = bone + k;
+		if (i >= boneCount)
+		{
+			position[k] = DirectX::XMVectorZero();
+			quaternion[k] = DirectX::XMQuaternionIdentity();
+			scale[k] = DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f);
+			continue;
+		}
+		position[k] = samplePosition(i, frame, nextFrame, interpolationFact);
+		quaternion[k] = sampleRotation(i, frame, nextFrame, interpolationFact);
+		scale[k] = sampleScale(i, frame, nextFrame, interpolationFact);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+//largest error each channel may pick up, in the clip's local bone space
+//positions in model units, quaternions and scales per component
+struct ClipCompressionSettings {
+	float positionError = 0.001f;
+	float rotationError = 0.0005f;
+	float scaleError = 0.0005f;
+};
+
+//compressed form of one AnimationSequence
+//every bone has a position, rotation and scale channel holding only the keyframes linear interpolation cannot
+//reproduce within the error, a constant channel keeps a single key
+//positions and scales are 16 bits per component over the channel's range in this clip,
+//quaternions are smallest-three, 15 bits for each of the three smaller components and 2 bits for the dropped one
+//a channel whose range is too wide for 16 bits to hold within the error keeps its keys as floats
+//sampleBlock decodes on the fly and gives the same results as AnimationSequence's raw sampler up to the error
+class CompressedClip {
+private:
+	struct Channel {
+		uint32_t firstKey = 0;
+		uint32_t keyCount = 0;
+		//first of the channel's values in keys or, for a raw channel, in rawKeys
+		uint32_t firstValue = 0;
+		bool raw = false;
+	};
+	struct Track {
+		std::vector<Channel> channels;
+		//frame of every kept key, ascending per channel
+		std::vector<uint16_t> frames;
+		//three uint16 per key
+		std::vector<uint16_t> keys;
+		//one per key of the raw channels
+		std::vector<DirectX::XMFLOAT4> rawKeys;
+
+		int findKey(const Channel& channel, int frame) const;
+		//the keys around frame and how far between them the sample lies, a == b for a single key
+		void segment(const Channel& channel, int frame, int nextFrame, float interpolationFact, uint32_t& a, uint32_t& b, float& u) const;
+		//value of the key segment returned as a or b
+		const uint16_t* quantizedKey(const Channel& channel, uint32_t key) const;
+		DirectX::XMVECTOR rawKey(const Channel& channel, uint32_t key) const;
+		size_t sizeInBytes() const;
+	};
+
+	int frameCount = 0;
+	int boneCount = 0;
+	Track positions;
+	Track rotations;
+	Track scales;
+	//per bone quantization ranges of positions and scales
+	std::vector<DirectX::XMFLOAT4A> positionMin;
+	std::vector<DirectX::XMFLOAT4A> positionStep;
+	std::vector<DirectX::XMFLOAT4A> scaleMin;
+	std::vector<DirectX::XMFLOAT4A> scaleStep;
+
+	DirectX::XMVECTOR samplePosition(int bone, int frame, int nextFrame, float interpolationFact) const;
+	DirectX::XMVECTOR sampleRotation(int bone, int frame, int nextFrame, float interpolationFact) const;
+	DirectX::XMVECTOR sampleScale(int bone, int frame, int nextFrame, float interpolationFact) const;
+public:
+	bool empty() const;
+	size_t sizeInBytes() const;
+	int keyCount() const;
+
+	//compress channels laid out like AnimationSequence, [frame * boneStride + bone]
+	void build(int frames, int bones, int boneStride, const std::vector<DirectX::XMFLOAT4A>& rawPositions, const std::vector<DirectX::XMFLOAT4A>& rawQuaternions, const std::vector<DirectX::XMFLOAT4A>& rawScales, const ClipCompressionSettings& settings);
+
+	//bones bone to bone + 3 between frame and nextFrame, bones past the end get the identity
+	void sampleBlock(int frame, int nextFrame, float interpolationFact, int bone, DirectX::XMVECTOR position[4], DirectX::XMVECTOR quaternion[4], DirectX::XMVECTOR scale[4]) const;
+};
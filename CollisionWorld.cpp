@@ -0,0 +1,190 @@
+#include "CollisionWorld.h"
+#include "Object.h"
+#include <algorithm>
+#include <cfloat>
+#include <immintrin.h>
+
+//the AVX2 paths are compiled for AVX2 whatever the project's target is and only run when the CPU has it
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	bool cpuHasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		//OSXSAVE and AVX, then check the OS saves the YMM registers
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+		if ((_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+}
+
+CollisionWorld::CollisionWorld()
+{
+	useAVX2 = cpuHasAVX2();
+}
+
+void CollisionWorld::setBox(int index, const Object& object)
+{
+	//the same expressions as preCheckCollisionWithPlayer, so the stored bounds are bit identical
+	minX[index] = object.position.x - object.collisionHalfX;
+	maxX[index] = object.position.x + object.collisionHalfX;
+	minZ[index] = object.position.z - object.collisionHalfZ;
+	maxZ[index] = object.position.z + object.collisionHalfZ;
+}
+
+void CollisionWorld::build(const std::vector<Object>& objects)
+{
+	count = static_cast<int>(objects.size());
+	//always keep at least one padding box, the gather path points unused lanes at it
+	size_t padded = (static_cast<size_t>(count) / 8 + 1) * 8;
+	//an inverted box fails every overlap test
+	minX.assign(padded, FLT_MAX);
+	maxX.assign(padded, -FLT_MAX);
+	minZ.assign(padded, FLT_MAX);
+	maxZ.assign(padded, -FLT_MAX);
+	for (int i = 0; i < count; i++)
+	{
+		setBox(i, objects[i]);
+	}
+}
+
+void CollisionWorld::update(int index, const Object& object)
+{
+	setBox(index, object);
+}
+
+int CollisionWorld::size() const
+{
+	return count;
+}
+
+void CollisionWorld::setAVX2(bool enable)
+{
+	useAVX2 = enable && cpuHasAVX2();
+}
+
+bool CollisionWorld::hasAVX2() const
+{
+	return useAVX2;
+}
+
+bool CollisionWorld::overlapsAnyScalar(float x, float z, float halfX, float halfZ) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		float PDx = std::min(maxX[i], x + halfX) - std::max(minX[i], x - halfX);
+		float PDz = std::min(maxZ[i], z + halfZ) - std::max(minZ[i], z - halfZ);
+		if (PDx > 0 && PDz > 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//min(a1, b1) - max(a0, b0) > 0 holds exactly when a1 > a0, a1 > b0, b1 > a0 and b1 > b0,
+//the vector paths test those four comparisons per axis
+AVX2_TARGET bool CollisionWorld::overlapsAnyAVX2(float x, float z, float halfX, float halfZ) const
+{
+	float qMinX = x - halfX;
+	float qMaxX = x + halfX;
+	float qMinZ = z - halfZ;
+	float qMaxZ = z + halfZ;
+	if (!(qMaxX > qMinX) || !(qMaxZ > qMinZ)) return false;
+
+	__m256 q0x = _mm256_set1_ps(qMinX);
+	__m256 q1x = _mm256_set1_ps(qMaxX);
+	__m256 q0z = _mm256_set1_ps(qMinZ);
+	__m256 q1z = _mm256_set1_ps(qMaxZ);
+	int padded = static_cast<int>(minX.size());
+	for (int i = 0; i < padded; i += 8)
+	{
+		__m256 b0x = _mm256_loadu_ps(&minX[i]);
+		__m256 b1x = _mm256_loadu_ps(&maxX[i]);
+		__m256 b0z = _mm256_loadu_ps(&minZ[i]);
+		__m256 b1z = _mm256_loadu_ps(&maxZ[i]);
+		__m256 hitX = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b1x, q0x, _CMP_GT_OQ), _mm256_cmp_ps(q1x, b0x, _CMP_GT_OQ)), _mm256_cmp_ps(b1x, b0x, _CMP_GT_OQ));
+		__m256 hitZ = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b1z, q0z, _CMP_GT_OQ), _mm256_cmp_ps(q1z, b0z, _CMP_GT_OQ)), _mm256_cmp_ps(b1z, b0z, _CMP_GT_OQ));
+		if (_mm256_movemask_ps(_mm256_and_ps(hitX, hitZ)) != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+AVX2_TARGET bool CollisionWorld::overlapsAnyAVX2(const int* indices, int n, float x, float z, float halfX, float halfZ) const
+{
+	float qMinX = x - halfX;
+	float qMaxX = x + halfX;
+	float qMinZ = z - halfZ;
+	float qMaxZ = z + halfZ;
+	if (!(qMaxX > qMinX) || !(qMaxZ > qMinZ)) return false;
+
+	__m256 q0x = _mm256_set1_ps(qMinX);
+	__m256 q1x = _mm256_set1_ps(qMaxX);
+	__m256 q0z = _mm256_set1_ps(qMinZ);
+	__m256 q1z = _mm256_set1_ps(qMaxZ);
+	for (int i = 0; i < n; i += 8)
+	{
+		//the last group points its unused lanes at the padding box
+		int lanes[8];
+		for (int k = 0; k < 8; k++)
+		{
+			lanes[k] = i + k < n ? indices[i + k] : count;
+		}
+		__m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+		__m256 b0x = _mm256_i32gather_ps(minX.data(), index, 4);
+		__m256 b1x = _mm256_i32gather_ps(maxX.data(), index, 4);
+		__m256 b0z = _mm256_i32gather_ps(minZ.data(), index, 4);
+		__m256 b1z = _mm256_i32gather_ps(maxZ.data(), index, 4);
+		__m256 hitX = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b1x, q0x, _CMP_GT_OQ), _mm256_cmp_ps(q1x, b0x, _CMP_GT_OQ)), _mm256_cmp_ps(b1x, b0x, _CMP_GT_OQ));
+		__m256 hitZ = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(b1z, q0z, _CMP_GT_OQ), _mm256_cmp_ps(q1z, b0z, _CMP_GT_OQ)), _mm256_cmp_ps(b1z, b0z, _CMP_GT_OQ));
+		if (_mm256_movemask_ps(_mm256_and_ps(hitX, hitZ)) != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CollisionWorld::overlapsAny(float x, float z, float halfX, float halfZ) const
+{
+	if (useAVX2)
+	{
+		return overlapsAnyAVX2(x, z, halfX, halfZ);
+	}
+	return overlapsAnyScalar(x, z, halfX, halfZ);
+}
+
+bool CollisionWorld::overlapsAny(const std::vector<int>& indices, float x, float z, float halfX, float halfZ) const
+{
+	if (useAVX2)
+	{
+		return overlapsAnyAVX2(indices.data(), static_cast<int>(indices.size()), x, z, halfX, halfZ);
+	}
+	for (int i : indices)
+	{
+		float PDx = std::min(maxX[i], x + halfX) - std::max(minX[i], x - halfX);
+		float PDz = std::min(maxZ[i], z + halfZ) - std::max(minZ[i], z - halfZ);
+		if (PDx > 0 && PDz > 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+
+class Object;
+
+//structure-of-arrays mirror of the placed objects' XZ collision boxes
+//queries answer "does a box centred at (x, z) overlap any object" with exactly the result of
+//Object::preCheckCollisionWithPlayer, eight boxes per instruction when the CPU has AVX2
+//the arrays are padded to a multiple of eight with boxes that never overlap anything
+class CollisionWorld {
+private:
+	std::vector<float> minX;
+	std::vector<float> maxX;
+	std::vector<float> minZ;
+	std::vector<float> maxZ;
+	int count = 0;
+	bool useAVX2 = false;
+
+	void setBox(int index, const Object& object);
+	bool overlapsAnyAVX2(float x, float z, float halfX, float halfZ) const;
+	bool overlapsAnyAVX2(const int* indices, int n, float x, float z, float halfX, float halfZ) const;
+public:
+	CollisionWorld();
+
+	void build(const std::vector<Object>& objects);
+	//call after objects[index] moved or changed size
+	void update(int index, const Object& object);
+	int size() const;
+
+	//test every object
+	bool overlapsAny(float x, float z, float halfX, float halfZ) const;
+	//test only the listed objects, e.g. the result of a spatial hash query
+	bool overlapsAny(const std::vector<int>& indices, float x, float z, float halfX, float halfZ) const;
+
+	//one box at a time, the reference the vector paths must agree with
+	bool overlapsAnyScalar(float x, float z, float halfX, float halfZ) const;
+
+	//force the scalar path, for comparisons
+	void setAVX2(bool enable);
+	bool hasAVX2() const;
+};
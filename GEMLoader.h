@@ -29,6 +29,7 @@ SOFTWARE.
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
 
 namespace GEMLoader
 {
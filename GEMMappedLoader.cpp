@@ -0,0 +1,259 @@
+#include "GEMMappedLoader.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace GEMLoader
+{
+	const unsigned char* GEMMappedModel::take(size_t bytes)
+	{
+		if (bytes > fileSize - cursor)
+		{
+			std::cout << filename << " is truncated" << std::endl;
+			exit(0);
+		}
+		const unsigned char* p = base + cursor;
+		cursor += bytes;
+		return p;
+	}
+
+	unsigned int GEMMappedModel::readUInt()
+	{
+		unsigned int v = 0;
+		memcpy(&v, take(sizeof(unsigned int)), sizeof(unsigned int));
+		return v;
+	}
+
+	int GEMMappedModel::readInt()
+	{
+		int v = 0;
+		memcpy(&v, take(sizeof(int)), sizeof(int));
+		return v;
+	}
+
+	float GEMMappedModel::readFloat()
+	{
+		float v = 0;
+		memcpy(&v, take(sizeof(float)), sizeof(float));
+		return v;
+	}
+
+	std::string GEMMappedModel::readString()
+	{
+		int l = readInt();
+		const char* p = reinterpret_cast<const char*>(take(static_cast<size_t>(l)));
+		//the stream loader stops at the first null, keep the same behaviour
+		return std::string(p, strnlen(p, static_cast<size_t>(l)));
+	}
+
+	//reads an element count and rejects it before anything is resized if the rest of the file cannot hold
+	//that many elements of at least elementBytes each, a negative int count reads back above INT_MAX and fails the same check
+	size_t GEMMappedModel::readCount(size_t elementBytes)
+	{
+		unsigned int count = readUInt();
+		if (count > static_cast<unsigned int>(std::numeric_limits<int>::max()) || (count > 0 && (elementBytes == 0 || count > (fileSize - cursor) / elementBytes)))
+		{
+			std::cout << filename << " has an invalid element count" << std::endl;
+			exit(0);
+		}
+		return count;
+	}
+
+	template<typename T>
+	GEMSpan<T> GEMMappedModel::readSpan(size_t count)
+	{
+		static_assert(alignof(T) <= alignof(unsigned int), "owned copies are only unsigned int aligned");
+		GEMSpan<T> span;
+		span.size = count;
+		const unsigned char* p = take(count * sizeof(T));
+		if (reinterpret_cast<uintptr_t>(p) % alignof(T) == 0)
+		{
+			span.data = reinterpret_cast<const T*>(p);
+			return span;
+		}
+		//misaligned in the file, copy the whole array once
+		copies.emplace_back((count * sizeof(T) + sizeof(unsigned int) - 1) / sizeof(unsigned int));
+		memcpy(copies.back().data(), p, count * sizeof(T));
+		span.data = reinterpret_cast<const T*>(copies.back().data());
+		return span;
+	}
+
+	template<typename T>
+	void GEMMappedModel::readArray(std::vector<T>& values, size_t count)
+	{
+		values.resize(count);
+		if (count > 0)
+		{
+			memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+		}
+	}
+
+	void GEMMappedModel::readMesh(GEMMappedMesh& mesh, unsigned int isAnimated)
+	{
+		//a property is two strings, each at least its length
+		size_t n = readCount(sizeof(int) * 2);
+		for (size_t i = 0; i < n; i++)
+		{
+			GEMMaterialProperty prop;
+			prop.name = readString();
+			prop.value = readString();
+			mesh.material.properties.push_back(prop);
+		}
+		if (isAnimated == 0)
+		{
+			n = readCount(sizeof(GEMStaticVertex));
+			mesh.verticesStatic = readSpan<GEMStaticVertex>(n);
+		}
+		else
+		{
+			n = readCount(sizeof(GEMAnimatedVertex));
+			mesh.verticesAnimated = readSpan<GEMAnimatedVertex>(n);
+		}
+		n = readCount(sizeof(unsigned int));
+		mesh.indices = readSpan<unsigned int>(n);
+	}
+
+	void GEMMappedModel::readAnimation()
+	{
+		//read skeleton
+		//a bone is a name, an offset matrix and a parent index
+		size_t bonesN = readCount(sizeof(int) + sizeof(GEMMatrix) + sizeof(int));
+		animation.bones.resize(bonesN);
+		for (size_t i = 0; i < bonesN; i++)
+		{
+			GEMBone& bone = animation.bones[i];
+			bone.name = readString();
+			memcpy(bone.offset.m, take(sizeof(float) * 16), sizeof(float) * 16);
+			bone.parentIndex = readInt();
+		}
+		memcpy(animation.globalInverse.m, take(sizeof(float) * 16), sizeof(float) * 16);
+
+		//read animation sequences, each channel of a frame is one bulk copy
+		//a sequence is a name, a frame count and a tick rate
+		size_t n = readCount(sizeof(int) * 2 + sizeof(float));
+		animation.animations.resize(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			GEMAnimationSequence& aseq = animation.animations[i];
+			aseq.name = readString();
+			//frames of a skeleton without bones would carry no data, readCount rejects any such count
+			size_t frameBytes = bonesN * (sizeof(GEMVec3) + sizeof(GEMQuaternion) + sizeof(GEMVec3));
+			size_t frames = readCount(frameBytes);
+			aseq.ticksPerSecond = readFloat();
+			aseq.frames.resize(frames);
+			for (auto& frame : aseq.frames)
+			{
+				readArray(frame.positions, bonesN);
+				readArray(frame.rotations, bonesN);
+				readArray(frame.scales, bonesN);
+			}
+		}
+	}
+
+	void GEMMappedModel::open(std::string _filename)
+	{
+		close();
+		filename = _filename;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		LARGE_INTEGER size = {};
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			std::cout << filename << " could not be opened" << std::endl;
+			exit(0);
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (view == nullptr)
+		{
+			if (mapping) CloseHandle(mapping);
+			CloseHandle(file);
+			std::cout << filename << " could not be mapped" << std::endl;
+			exit(0);
+		}
+		fileHandle = file;
+		mappingHandle = mapping;
+		fileSize = static_cast<size_t>(size.QuadPart);
+#else
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		struct stat st = {};
+		if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			if (fd >= 0) ::close(fd);
+			std::cout << filename << " could not be opened" << std::endl;
+			exit(0);
+		}
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (view == MAP_FAILED)
+		{
+			std::cout << filename << " could not be mapped" << std::endl;
+			exit(0);
+		}
+		fileSize = static_cast<size_t>(st.st_size);
+#endif
+		base = static_cast<const unsigned char*>(view);
+		cursor = 0;
+
+		if (readUInt() != 4058972161)
+		{
+			std::cout << filename << " is not a GE Model File" << std::endl;
+			close();
+			exit(0);
+		}
+		unsigned int isAnimated = readUInt();
+		animated = isAnimated != 0;
+		//a mesh is at least its property, vertex and index counts
+		size_t n = readCount(sizeof(unsigned int) * 3);
+		meshes.resize(n);
+		for (auto& mesh : meshes)
+		{
+			readMesh(mesh, isAnimated);
+		}
+		if (animated)
+		{
+			readAnimation();
+		}
+	}
+
+	void GEMMappedModel::close()
+	{
+		if (base != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(base);
+			CloseHandle(static_cast<HANDLE>(mappingHandle));
+			CloseHandle(static_cast<HANDLE>(fileHandle));
+#else
+			munmap(const_cast<unsigned char*>(base), fileSize);
+#endif
+		}
+		base = nullptr;
+		fileHandle = nullptr;
+		mappingHandle = nullptr;
+		fileSize = 0;
+		cursor = 0;
+		copies.clear();
+		meshes.clear();
+		animation = GEMAnimation();
+		animated = false;
+	}
+
+	GEMMappedModel::~GEMMappedModel()
+	{
+		close();
+	}
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include "GEMLoader.h"
+
+namespace GEMLoader
+{
+	//read-only view over a contiguous array, it points into the file mapping or into an owned copy
+	template<typename T>
+	struct GEMSpan
+	{
+		const T* data = nullptr;
+		size_t size = 0;
+
+		const T* begin() const { return data; }
+		const T* end() const { return data + size; }
+		const T& operator[](size_t i) const { return data[i]; }
+	};
+
+	class GEMMappedMesh
+	{
+	public:
+		GEMMaterial material;
+		GEMSpan<GEMStaticVertex> verticesStatic;
+		GEMSpan<GEMAnimatedVertex> verticesAnimated;
+		GEMSpan<unsigned int> indices;
+		bool isAnimated()
+		{
+			return verticesAnimated.size > 0;
+		}
+	};
+
+	//memory-mapped .gem reader
+	//vertex and index arrays are exposed as spans straight into the mapping,
+	//an array is copied once into an owned buffer only if its file offset is misaligned
+	//the spans stay valid until close() or destruction
+	class GEMMappedModel
+	{
+	private:
+		const unsigned char* base = nullptr;
+		size_t fileSize = 0;
+		size_t cursor = 0;
+		std::string filename;
+
+		//platform handles of the mapping
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+
+		//aligned copies of misaligned arrays
+		std::vector<std::vector<unsigned int>> copies;
+
+		const unsigned char* take(size_t bytes);
+		unsigned int readUInt();
+		int readInt();
+		float readFloat();
+		std::string readString();
+		size_t readCount(size_t elementBytes);
+		template<typename T>
+		GEMSpan<T> readSpan(size_t count);
+		template<typename T>
+		void readArray(std::vector<T>& values, size_t count);
+
+		void readMesh(GEMMappedMesh& mesh, unsigned int isAnimated);
+		void readAnimation();
+	public:
+		std::vector<GEMMappedMesh> meshes;
+		GEMAnimation animation;
+		bool animated = false;
+
+		GEMMappedModel() = default;
+		GEMMappedModel(const GEMMappedModel&) = delete;
+		GEMMappedModel& operator=(const GEMMappedModel&) = delete;
+		~GEMMappedModel();
+
+		void open(std::string filename);
+		void close();
+	};
+};
@@ -0,0 +1,130 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+
+JobSystem::JobSystem(int threadCount)
+{
+	if (threadCount <= 0)
+	{
+		threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	for (int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::make_unique<Worker>());
+	}
+	for (int i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+int JobSystem::threadCount()
+{
+	return static_cast<int>(workers.size());
+}
+
+bool JobSystem::pop(int worker, Job& job)
+{
+	Worker& w = *workers[worker];
+	std::lock_guard<std::mutex> lock(w.mutex);
+	if (w.jobs.empty()) return false;
+	job = w.jobs.back();
+	w.jobs.pop_back();
+	return true;
+}
+
+bool JobSystem::steal(int worker, Job& job)
+{
+	int n = threadCount();
+	for (int i = 1; i < n; i++)
+	{
+		Worker& victim = *workers[(worker + i) % n];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.jobs.empty()) continue;
+		job = victim.jobs.front();
+		victim.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::runOne(int worker)
+{
+	Job job;
+	if (!pop(worker, job) && !steal(worker, job))
+	{
+		return false;
+	}
+	queued--;
+	(*job.task)(job.begin, job.end);
+	if (--unfinished == 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		done.notify_all();
+	}
+	return true;
+}
+
+void JobSystem::workerLoop(int worker)
+{
+	PROFILE_THREAD_NAME("job worker");
+	while (true)
+	{
+		if (runOne(worker)) continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return quit || queued > 0; });
+		if (quit) return;
+	}
+}
+
+void JobSystem::parallelFor(int count, int grain, const std::function<void(int, int)>& task)
+{
+	if (count <= 0) return;
+	grain = std::max(1, grain);
+	int chunks = (count + grain - 1) / grain;
+	if (chunks == 1 || threadCount() == 1)
+	{
+		task(0, count);
+		return;
+	}
+
+	unfinished += chunks;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queued += chunks;
+	}
+	int n = threadCount();
+	for (int c = 0; c < chunks; c++)
+	{
+		Job job;
+		job.task = &task;
+		job.begin = c * grain;
+		job.end = std::min(count, job.begin + grain);
+		Worker& w = *workers[c % n];
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.jobs.push_back(job);
+	}
+	wake.notify_all();
+
+	//help until every chunk is finished, then sleep on the stragglers
+	while (unfinished > 0)
+	{
+		if (runOne(0)) continue;
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		done.wait(lock, [this] { return unfinished == 0; });
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//work-stealing job system
+//parallelFor cuts a range into chunks and deals them round-robin into per-thread queues,
+//each thread drains its own queue from the back and steals from the front of the others when it runs dry
+//the calling thread takes part and parallelFor returns once every chunk has run
+//the chunk boundaries only depend on count and grain, so a task that writes only to its own indices
+//gives the same result for any thread count
+//parallelFor must only be called from one thread at a time and tasks must not call it again
+class JobSystem {
+private:
+	struct Job {
+		const std::function<void(int, int)>* task = nullptr;
+		int begin = 0;
+		int end = 0;
+	};
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers; //worker 0 is the calling thread
+	std::vector<std::thread> threads;
+
+	std::atomic<int> queued{ 0 };
+	std::atomic<int> unfinished{ 0 };
+	bool quit = false;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	bool pop(int worker, Job& job);
+	bool steal(int worker, Job& job);
+	bool runOne(int worker);
+	void workerLoop(int worker);
+public:
+	//threadCount includes the calling thread, 0 uses every hardware thread
+	JobSystem(int threadCount = 0);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int threadCount();
+
+	//run task(begin, end) over [0, count) in chunks of at most grain items
+	void parallelFor(int count, int grain, const std::function<void(int, int)>& task);
+};
@@ -0,0 +1,451 @@
+#include "LevelCache.h"
+#include <filesystem>
+
+namespace
+{
+	//FNV-1a
+	uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= p[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//hashes the contents, a missing file hashes as empty
+	uint64_t hashFile(const std::string& filename, uint64_t hash)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		std::vector<char> buffer(1 << 16);
+		uint64_t size = 0;
+		while (file)
+		{
+			file.read(buffer.data(), buffer.size());
+			size_t read = static_cast<size_t>(file.gcount());
+			hash = hashBytes(buffer.data(), read, hash);
+			size += read;
+		}
+		return hashBytes(&size, sizeof(size), hash);
+	}
+}
+
+std::string LevelCache::cacheFileName(const std::string& levelFile)
+{
+	return levelFile + ".bake";
+}
+
+uint64_t LevelCache::sourceHash(const std::string& levelFile)
+{
+	std::ifstream file(levelFile, std::ios::binary);
+	std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	uint64_t hash = hashBytes(&version, sizeof(version));
+	hash = hashBytes(text.data(), text.size(), hash);
+
+	//every line references its source file in the second column
+	std::stringstream lines(text);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		std::stringstream ss(line);
+		std::string segment;
+		std::getline(ss, segment, ',');
+		//options are applied after every load, not baked, and a tile file is far too big to hash on every start
+		if (segment == "TerrainTiles" || segment == "BakedAnimation") continue;
+		if (!std::getline(ss, segment, ',')) continue;
+
+		//size and modification time miss edits that keep both, e.g. a checkout or a copy that preserves times
+		hash = hashBytes(segment.data(), segment.size(), hash);
+		hash = hashFile(segment, hash);
+	}
+	return hash;
+}
+
+template<typename T>
+void LevelCache::write(const T& value)
+{
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+void LevelCache::writeVector(const std::vector<T>& values)
+{
+	write(static_cast<uint64_t>(values.size()));
+	out.write(reinterpret_cast<const char*>(values.data()), sizeof(T) * values.size());
+}
+
+void LevelCache::writeString(const std::string& str)
+{
+	write(static_cast<uint32_t>(str.size()));
+	out.write(str.data(), str.size());
+}
+
+void LevelCache::writeMatrix(const DirectX::XMMATRIX& m)
+{
+	DirectX::XMFLOAT4X4 f;
+	DirectX::XMStoreFloat4x4(&f, m);
+	write(f);
+}
+
+void LevelCache::writeObject(Object& object)
+{
+	write(object.isAlive);
+	write(object.position);
+	write(object.rotation);
+	write(object.scale);
+	write(object.collisionHalfX);
+	write(object.collisionHalfZ);
+	write(object.collisionHalfY);
+}
+
+void LevelCache::writeAnimation(Animation& animation)
+{
+	write(static_cast<uint32_t>(animation.skeleton.bones.size()));
+	for (auto& bone : animation.skeleton.bones)
+	{
+		write(bone.parentIndex);
+		writeString(bone.name);
+		writeMatrix(bone.bindingOffset);
+	}
+	writeMatrix(animation.skeleton.globalInverse);
+
+	write(static_cast<uint32_t>(animation.sequences.size()));
+	for (size_t i = 0; i < animation.sequences.size(); i++)
+	{
+		AnimationSequence& seq = animation.sequences[i];
+		writeString(animation.sequenceNames[i]);
+		write(seq.ticksPerSecond);
+		write(seq.frameCount);
+		write(seq.boneCount);
+		write(seq.boneStride);
+		writeVector(seq.positions);
+		writeVector(seq.quaternions);
+		writeVector(seq.scales);
+	}
+}
+
+template<typename T>
+void LevelCache::read(T& value)
+{
+	in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+//each array is one large read straight into its destination
+template<typename T>
+void LevelCache::readVector(std::vector<T>& values)
+{
+	uint64_t n = 0;
+	read(n);
+	if (!in || n > fileSize / sizeof(T))
+	{
+		in.setstate(std::ios::failbit);
+		return;
+	}
+	values.resize(static_cast<size_t>(n));
+	in.read(reinterpret_cast<char*>(values.data()), sizeof(T) * values.size());
+}
+
+void LevelCache::readString(std::string& str)
+{
+	uint32_t n = 0;
+	read(n);
+	if (!in || n > fileSize)
+	{
+		in.setstate(std::ios::failbit);
+		return;
+	}
+	str.resize(n);
+	in.read(&str[0], n);
+}
+
+void LevelCache::readMatrix(DirectX::XMMATRIX& m)
+{
+	DirectX::XMFLOAT4X4 f = {};
+	read(f);
+	m = DirectX::XMLoadFloat4x4(&f);
+}
+
+void LevelCache::readObject(Object& object)
+{
+	read(object.isAlive);
+	read(object.position);
+	read(object.rotation);
+	read(object.scale);
+	read(object.collisionHalfX);
+	read(object.collisionHalfZ);
+	read(object.collisionHalfY);
+}
+
+void LevelCache::readAnimation(Animation& animation)
+{
+	uint32_t n = 0;
+	read(n);
+	for (uint32_t i = 0; i < n && in; i++)
+	{
+		Bone bone;
+		read(bone.parentIndex);
+		readString(bone.name);
+		readMatrix(bone.bindingOffset);
+		animation.skeleton.bones.push_back(bone);
+	}
+	readMatrix(animation.skeleton.globalInverse);
+	animation.skeleton.combineOffsets();
+
+	read(n);
+	for (uint32_t i = 0; i < n && in; i++)
+	{
+		std::string name;
+		readString(name);
+		AnimationSequence seq;
+		read(seq.ticksPerSecond);
+		read(seq.frameCount);
+		read(seq.boneCount);
+		read(seq.boneStride);
+		readVector(seq.positions);
+		readVector(seq.quaternions);
+		readVector(seq.scales);
+		if (seq.positions.size() != static_cast<size_t>(seq.frameCount) * seq.boneStride)
+		{
+			in.setstate(std::ios::failbit);
+		}
+		//handles are assigned in the same order they were written
+		animation.addSequence(name, seq);
+	}
+}
+
+bool LevelCache::load(const std::string& levelFile, MeshManager& meshManager, ObjectManager& objectManager, Map& map)
+{
+	in.open(cacheFileName(levelFile), std::ios::binary | std::ios::ate);
+	if (!in) return false;
+	fileSize = static_cast<uint64_t>(in.tellg());
+	in.seekg(0);
+
+	uint32_t fileMagic = 0;
+	uint32_t fileVersion = 0;
+	uint64_t hash = 0;
+	read(fileMagic);
+	read(fileVersion);
+	read(hash);
+	if (!in || fileMagic != magic || fileVersion != version || hash != sourceHash(levelFile))
+	{
+		in.close();
+		return false;
+	}
+
+	//read into temporaries so a damaged blob leaves the outputs untouched
+	MeshManager mm;
+	ObjectManager om;
+	Map m;
+	Animation animation;
+
+	uint32_t n = 0;
+	read(n);
+	for (uint32_t i = 0; i < n && in; i++)
+	{
+		std::string name;
+		readString(name);
+		MeshDescriptor& md = mm.objects[name];
+		read(md.isDynamic);
+		read(md.vertexOffset);
+		read(md.vertexCount);
+		read(md.indexOffset);
+		read(md.indexCount);
+		read(md.shortIndices);
+		read(md.instanceOffset);
+		read(md.instanceCount);
+		readString(md.textureFile);
+		readString(md.normalMapFile);
+	}
+	readVector(mm.vertices_Static);
+	readVector(mm.indices_Static);
+	readVector(mm.indices16_Static);
+	readVector(mm.vertices_Dynamic);
+	readVector(mm.indices_Dynamic);
+	readVector(mm.indices16_Dynamic);
+	readVector(mm.instances);
+	read(n);
+	mm.materials.resize(in && n <= fileSize ? n : 0);
+	for (auto& material : mm.materials)
+	{
+		uint32_t properties = 0;
+		read(properties);
+		for (uint32_t i = 0; i < properties && in; i++)
+		{
+			MaterialProperty prop;
+			readString(prop.name);
+			readString(prop.filePath);
+			material.properties.push_back(prop);
+		}
+	}
+
+	read(m.width);
+	read(m.height);
+	read(m.channel);
+	read(m.heightScale);
+	read(m.heightOffset);
+	readVector(m.heightMap);
+	readVector(m.normals);
+	read(m.terrainChunks.chunkSize);
+	read(m.terrainChunks.lodDistance);
+	readVector(m.terrainChunks.chunks);
+	//the chunk sets live in whichever static pool the terrain went to
+	auto terrain = mm.objects.find("Terrain");
+	size_t terrainIndices = terrain != mm.objects.end() && terrain->second.shortIndices ? mm.indices16_Static.size() : mm.indices_Static.size();
+	for (auto& chunk : m.terrainChunks.chunks)
+	{
+		for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+		{
+			if (chunk.indexOffset[lod] < 0 || chunk.indexCount[lod] < 0 ||
+				static_cast<size_t>(chunk.indexOffset[lod]) + chunk.indexCount[lod] > terrainIndices)
+			{
+				in.setstate(std::ios::failbit);
+			}
+		}
+	}
+	if (m.width < 0 || m.height < 0 || m.heightMap.size() != static_cast<size_t>(m.width) * m.height || m.normals.size() != m.heightMap.size() || !(m.heightScale > 0.0f))
+	{
+		in.setstate(std::ios::failbit);
+	}
+	else
+	{
+		m.BuildHeightPyramid();
+	}
+
+	readAnimation(animation);
+
+	read(n);
+	for (uint32_t i = 0; i < n && in; i++)
+	{
+		NPC npc;
+		readObject(npc);
+		read(npc.animationInstance.sequence);
+		if (npc.animationInstance.sequence >= static_cast<int>(animation.sequences.size()))
+		{
+			in.setstate(std::ios::failbit);
+		}
+		om.npcs.push_back(npc);
+	}
+	//palette ranges are rebuilt in the same order, so the offsets stored in the instances stay valid
+	std::vector<int> boneCounts;
+	readVector(boneCounts);
+	for (int count : boneCounts)
+	{
+		if (count < 0 || count > static_cast<int>(animation.skeleton.bones.size()))
+		{
+			in.setstate(std::ios::failbit);
+			break;
+		}
+		mm.bonePalette.allocate(count);
+	}
+	read(n);
+	for (uint32_t i = 0; i < n && in; i++)
+	{
+		Object object;
+		readObject(object);
+		om.objects.push_back(object);
+	}
+	//the blob must be consumed exactly
+	bool ok = in && in.peek() == std::ifstream::traits_type::eof();
+	in.close();
+	if (!ok) return false;
+
+	//packing is a load setting like the ones below, the move would reset it
+	mm.packVertices = meshManager.packVertices;
+	meshManager = std::move(mm);
+	objectManager = std::move(om);
+	map = std::move(m);
+	//LOD and compression settings are not part of the level, keep the ones the game set
+	animation.lodLevels = NPC::animation.lodLevels;
+	animation.compressClips = NPC::animation.compressClips;
+	animation.compression = NPC::animation.compression;
+	NPC::animation = std::move(animation);
+
+	//rebuild the initial pose of each NPC
+	for (auto& npc : objectManager.npcs)
+	{
+		int sequence = npc.animationInstance.sequence;
+		npc.animationInstance.sequence = -1;
+		npc.animationInstance.update(sequence, 0.0f);
+	}
+	return true;
+}
+
+bool LevelCache::save(const std::string& levelFile, MeshManager& meshManager, ObjectManager& objectManager, Map& map)
+{
+	out.open(cacheFileName(levelFile), std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+	write(magic);
+	write(version);
+	write(sourceHash(levelFile));
+
+	write(static_cast<uint32_t>(meshManager.objects.size()));
+	for (auto& pair : meshManager.objects)
+	{
+		MeshDescriptor& md = pair.second;
+		writeString(pair.first);
+		write(md.isDynamic);
+		write(md.vertexOffset);
+		write(md.vertexCount);
+		write(md.indexOffset);
+		write(md.indexCount);
+		write(md.shortIndices);
+		write(md.instanceOffset);
+		write(md.instanceCount);
+		writeString(md.textureFile);
+		writeString(md.normalMapFile);
+	}
+	writeVector(meshManager.vertices_Static);
+	writeVector(meshManager.indices_Static);
+	writeVector(meshManager.indices16_Static);
+	writeVector(meshManager.vertices_Dynamic);
+	writeVector(meshManager.indices_Dynamic);
+	writeVector(meshManager.indices16_Dynamic);
+	writeVector(meshManager.instances);
+	write(static_cast<uint32_t>(meshManager.materials.size()));
+	for (auto& material : meshManager.materials)
+	{
+		write(static_cast<uint32_t>(material.properties.size()));
+		for (auto& prop : material.properties)
+		{
+			writeString(prop.name);
+			writeString(prop.filePath);
+		}
+	}
+
+	write(map.width);
+	write(map.height);
+	write(map.channel);
+	write(map.heightScale);
+	write(map.heightOffset);
+	writeVector(map.heightMap);
+	writeVector(map.normals);
+	write(map.terrainChunks.chunkSize);
+	write(map.terrainChunks.lodDistance);
+	writeVector(map.terrainChunks.chunks);
+
+	writeAnimation(NPC::animation);
+
+	write(static_cast<uint32_t>(objectManager.npcs.size()));
+	for (auto& npc : objectManager.npcs)
+	{
+		writeObject(npc);
+		write(npc.animationInstance.sequence);
+	}
+	writeVector(meshManager.bonePalette.boneCounts);
+	write(static_cast<uint32_t>(objectManager.objects.size()));
+	for (auto& object : objectManager.objects)
+	{
+		writeObject(object);
+	}
+	out.close();
+	//a short write (full disk, lost share) leaves a blob that would be rejected on every start, remove it instead
+	if (out.fail())
+	{
+		std::error_code ec;
+		std::filesystem::remove(cacheFileName(levelFile), ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "Object.h"
+#include <cstdint>
+
+class Map;
+class MeshManager;
+class ObjectManager;
+
+//baked level format
+//stores the final mesh pools, instances, object descriptors, terrain data and chunks, placed objects and the NPC animation
+//in one versioned blob next to the level file, so startup skips text parsing, .gem parsing and terrain generation
+//the blob carries a hash of the contents of the level file and of every source file it references, a change to any of them rebuilds it
+class LevelCache {
+private:
+	static constexpr uint32_t magic = 0x4B41424C; //"LBAK"
+	static constexpr uint32_t version = 10;
+
+	std::ifstream in;
+	std::ofstream out;
+	//used to reject corrupt lengths before allocating
+	uint64_t fileSize = 0;
+
+	uint64_t sourceHash(const std::string& levelFile);
+
+	//writing
+	template<typename T>
+	void write(const T& value);
+	template<typename T>
+	void writeVector(const std::vector<T>& values);
+	void writeString(const std::string& str);
+	void writeMatrix(const DirectX::XMMATRIX& m);
+	void writeObject(Object& object);
+	void writeAnimation(Animation& animation);
+
+	//reading
+	template<typename T>
+	void read(T& value);
+	template<typename T>
+	void readVector(std::vector<T>& values);
+	void readString(std::string& str);
+	void readMatrix(DirectX::XMMATRIX& m);
+	void readObject(Object& object);
+	void readAnimation(Animation& animation);
+public:
+	static std::string cacheFileName(const std::string& levelFile);
+
+	//return false if there is no cache or it is stale, the outputs are left untouched in that case
+	bool load(const std::string& levelFile, MeshManager& meshManager, ObjectManager& objectManager, Map& map);
+	//return false if the blob could not be written completely, no cache file is left behind in that case
+	bool save(const std::string& levelFile, MeshManager& meshManager, ObjectManager& objectManager, Map& map);
+};
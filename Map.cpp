@@ -1,10 +1,22 @@
 #include "Map.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+//the stb_image implementation lives here so every target that links Map gets it
+#define STB_IMAGE_IMPLEMENTATION
 #include"stb_image.h"
 #include<algorithm>
+#include<cfloat>
+#include<cctype>
+#include<cmath>
+#include<fstream>
+#include<memory>
 float Map::GetHeight(float x, float z)
 {
-	int x0 = static_cast<int>(x);
-	int z0 = static_cast<int>(z);
+	if (terrainTiles) return terrainTiles->GetHeight(x, z);
+
+	//floor, not truncation, so (-1, 0) is off the map instead of extrapolating cell 0
+	int x0 = static_cast<int>(std::floor(x));
+	int z0 = static_cast<int>(std::floor(z));
 	int x1 = x0 + 1;
 	int z1 = z0 + 1;
 
@@ -12,10 +24,10 @@ float Map::GetHeight(float x, float z)
 	{
 		return 0.0f;
 	}
-	float h00 = heightMap[z0 * width + x0];
-	float h01 = heightMap[z0 * width + x1];
-	float h10 = heightMap[z1 * width + x0];
-	float h11 = heightMap[z1 * width + x1];
+	float h00 = DecodeHeight(heightMap[z0 * width + x0]);
+	float h01 = DecodeHeight(heightMap[z0 * width + x1]);
+	float h10 = DecodeHeight(heightMap[z1 * width + x0]);
+	float h11 = DecodeHeight(heightMap[z1 * width + x1]);
 
 	float dx = x - static_cast<float>(x0);
 	float dz = z - static_cast<float>(z0);
@@ -27,8 +39,10 @@ float Map::GetHeight(float x, float z)
 }
 DirectX::XMFLOAT3 Map::GetTerrainNormal(float x, float z)
 {
-	int x0 = static_cast<int>(x);
-	int z0 = static_cast<int>(z);
+	if (terrainTiles) return terrainTiles->GetTerrainNormal(x, z);
+
+	int x0 = static_cast<int>(std::floor(x));
+	int z0 = static_cast<int>(std::floor(z));
 	int x1 = x0 + 1;
 	int z1 = z0 + 1;
 
@@ -36,10 +50,10 @@ DirectX::XMFLOAT3 Map::GetTerrainNormal(float x, float z)
 	{
 		return { 0.0f,1.0f,0.0f };
 	}
-	DirectX::XMFLOAT3 v00 = normals[z0 * width + x0];
-	DirectX::XMFLOAT3 v01 = normals[z0 * width + x1];
-	DirectX::XMFLOAT3 v10 = normals[z1 * width + x0];
-	DirectX::XMFLOAT3 v11 = normals[z1 * width + x1];
+	DirectX::XMFLOAT3 v00 = unpackOctahedral(normals[z0 * width + x0]);
+	DirectX::XMFLOAT3 v01 = unpackOctahedral(normals[z0 * width + x1]);
+	DirectX::XMFLOAT3 v10 = unpackOctahedral(normals[z1 * width + x0]);
+	DirectX::XMFLOAT3 v11 = unpackOctahedral(normals[z1 * width + x1]);
 
 	float dx = x - static_cast<float>(x0);
 	float dz = z - static_cast<float>(z0);
@@ -64,102 +78,471 @@ DirectX::XMFLOAT3 Map::GetTerrainNormal(float x, float z)
 	v.z /= l;
 	return v;
 }
-void Map::LoadHeightMap(std::string filename, std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices)
+void Map::LoadHeightMap(std::string filename, std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices, JobSystem* jobSystem)
 {
-	size_t vertexOffset = vertices.size();
-	size_t indexOffset = indices.size();
-	//load the height map
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channel, 0);
-	for (int i = 0; i < width * height; i++)
+	PROFILE_ZONE("LoadHeightMap");
+	//without a job system the build runs on a local one using every hardware thread
+	std::unique_ptr<JobSystem> localJobSystem;
+	if (!jobSystem)
 	{
-		//set the height of the terrain
-		heightMap.push_back((float)data[i]);
+		localJobSystem = std::make_unique<JobSystem>();
+		jobSystem = localJobSystem.get();
 	}
-	stbi_image_free(data);
+	//rows per job
+	const int rowGrain = 16;
 
-	//create the vertices
-	for (int y = 0; y < height; y++)
+	//load the height map
+	if (!ReadHeightFile(filename)) return;
+
+	//create the vertices, every row writes only its own vertices so rows run in parallel
+	//the normals come from central differences of the height map (one sided on the border),
+	//a vertex's normal only reads heights so no face normals are scattered between rows
+	size_t vertexOffset = vertices.size();
+	size_t normalOffset = normals.size();
+	vertices.resize(vertexOffset + heightMap.size());
+	normals.resize(normalOffset + heightMap.size());
+	jobSystem->parallelFor(height, rowGrain, [&](int begin, int end)
 	{
-		for (int x = 0; x < width; x++)
+		for (int y = begin; y < end; y++)
 		{
-			float yf = static_cast<float>(y);
-			float xf = static_cast<float>(x);
+			int y0 = std::max(y - 1, 0);
+			int y1 = std::min(y + 1, height - 1);
+			for (int x = 0; x < width; x++)
+			{
+				int x0 = std::max(x - 1, 0);
+				int x1 = std::min(x + 1, width - 1);
+				float dx = (DecodeHeight(heightMap[y * width + x1]) - DecodeHeight(heightMap[y * width + x0])) / static_cast<float>(std::max(x1 - x0, 1));
+				float dz = (DecodeHeight(heightMap[y1 * width + x]) - DecodeHeight(heightMap[y0 * width + x])) / static_cast<float>(std::max(y1 - y0, 1));
+				DirectX::XMFLOAT3 normal;
+				DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMVectorSet(-dx, 1.0f, -dz, 0.0f)));
+
+				float yf = static_cast<float>(y);
+				float xf = static_cast<float>(x);
+				vertices[vertexOffset + y * width + x] = addVertex(DirectX::XMFLOAT3(xf, DecodeHeight(heightMap[y * width + x]), yf), normal, DirectX::XMFLOAT2(xf / static_cast<float>(width - 1), yf / static_cast<float>(height - 1)));
+				normals[normalOffset + y * width + x] = packOctahedral(normal);
+			}
+		}
+	});
+
+	//split the grid into chunks, this appends the skirts and the index sets of every LOD
+	terrainChunks.Build(width, height, vertices, vertexOffset, indices, *jobSystem);
+
+	BuildHeightPyramid();
+}
+
+bool Map::ReadHeightFile(const std::string& filename)
+{
+	width = 0;
+	height = 0;
+	heightMap.clear();
+
+	//world units per step of the file's samples, 16 bit maps span 0..256 and 8 bit maps 0..255 like they always did
+	float sourceStep = 1.0f / 256.0f;
+	//headerless little endian 16 bit samples of a square map
+	std::string extension = filename.substr(std::min(filename.find_last_of('.'), filename.size()));
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	if (extension == ".raw" || extension == ".r16")
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		size_t samples = file ? static_cast<size_t>(file.tellg()) / 2 : 0;
+		int side = static_cast<int>(std::lround(std::sqrt(static_cast<double>(samples))));
+		if (side < 2 || static_cast<size_t>(side) * side != samples) return false;
+		std::vector<unsigned char> bytes(samples * 2);
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		if (!file) return false;
+		heightMap.resize(samples);
+		for (size_t i = 0; i < samples; i++)
+		{
+			heightMap[i] = static_cast<uint16_t>(bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+		}
+		width = side;
+		height = side;
+		channel = 1;
+	}
+	//images are read as one grey channel
+	else if (stbi_is_16_bit(filename.c_str()))
+	{
+		stbi_us* data = stbi_load_16(filename.c_str(), &width, &height, &channel, 1);
+		if (!data) return false;
+		heightMap.assign(data, data + static_cast<size_t>(width) * height);
+		stbi_image_free(data);
+	}
+	else
+	{
+		unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channel, 1);
+		if (!data) return false;
+		heightMap.assign(data, data + static_cast<size_t>(width) * height);
+		stbi_image_free(data);
+		sourceStep = 1.0f;
+	}
+	FitHeightRange(sourceStep);
+	return true;
+}
+
+void Map::FitHeightRange(float sourceStep)
+{
+	heightScale = sourceStep;
+	heightOffset = 0.0f;
+	if (heightMap.empty()) return;
+	auto range = std::minmax_element(heightMap.begin(), heightMap.end());
+	int low = *range.first;
+	int span = *range.second - low;
+
+	//the largest whole number of stored steps per source step that still fits, so every source sample stays exact
+	int stepsPerSource = span > 0 ? 65535 / span : 1;
+	for (uint16_t& sample : heightMap)
+	{
+		sample = static_cast<uint16_t>((sample - low) * stepsPerSource);
+	}
+	heightScale = sourceStep / static_cast<float>(stepsPerSource);
+	heightOffset = sourceStep * static_cast<float>(low);
+}
+
+void Map::BuildHeightPyramid()
+{
+	maxPyramid.clear();
+	pyramidWidth = { width };
+	pyramidHeight = { height };
+	if (width <= 0 || height <= 0) return;
 
-			vertices.push_back(addVertex(DirectX::XMFLOAT3(xf, heightMap[y * width + x], yf), DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f), DirectX::XMFLOAT2(xf / static_cast<float>(width - 1), yf / static_cast<float>(height - 1))));
+	int w = width;
+	int h = height;
+	while (w > 1 || h > 1)
+	{
+		const uint16_t* src = maxPyramid.empty() ? heightMap.data() : maxPyramid.back().data();
+		int nw = (w + 1) / 2;
+		int nh = (h + 1) / 2;
+		std::vector<uint16_t> level(static_cast<size_t>(nw) * nh);
+		for (int z = 0; z < nh; z++)
+		{
+			int z0 = z * 2;
+			int z1 = std::min(z0 + 1, h - 1);
+			for (int x = 0; x < nw; x++)
+			{
+				int x0 = x * 2;
+				int x1 = std::min(x0 + 1, w - 1);
+				level[z * nw + x] = std::max(std::max(src[z0 * w + x0], src[z0 * w + x1]), std::max(src[z1 * w + x0], src[z1 * w + x1]));
+			}
 		}
+		maxPyramid.push_back(std::move(level));
+		pyramidWidth.push_back(nw);
+		pyramidHeight.push_back(nh);
+		w = nw;
+		h = nh;
 	}
+}
 
-	//create the indices
-	for (int y = 0; y < height - 1; y++)
+uint16_t Map::PyramidValue(int level, int x, int z)
+{
+	if (level == 0) return heightMap[z * width + x];
+	return maxPyramid[level - 1][z * pyramidWidth[level] + x];
+}
+
+//branch and bound descent on the stored samples, a node is skipped once it cannot beat best
+//nodes fully inside the rectangle answer with their stored max, so only nodes on the rectangle's border are opened,
+//and a border node of at most queryScanSize texels a side scans its overlap instead of opening four more nodes
+void Map::QueryMaxHeight(int level, int x, int z, int x0, int z0, int x1, int z1, int& best)
+{
+	int m = PyramidValue(level, x, z);
+	if (m <= best) return;
+
+	int nx0 = x << level;
+	int nz0 = z << level;
+	int nx1 = std::min(((x + 1) << level) - 1, width - 1);
+	int nz1 = std::min(((z + 1) << level) - 1, height - 1);
+	if (nx1 < x0 || nx0 > x1 || nz1 < z0 || nz0 > z1) return;
+	if (nx0 >= x0 && nx1 <= x1 && nz0 >= z0 && nz1 <= z1)
+	{
+		best = m;
+		return;
+	}
+
+	//a level 0 node is a single texel, so it never reaches here
+	if ((1 << level) <= queryScanSize)
+	{
+		int sx0 = std::max(nx0, x0);
+		int sx1 = std::min(nx1, x1);
+		for (int sz = std::max(nz0, z0); sz <= std::min(nz1, z1); sz++)
+		{
+			const uint16_t* row = heightMap.data() + sz * width;
+			for (int sx = sx0; sx <= sx1; sx++) best = std::max(best, static_cast<int>(row[sx]));
+		}
+		return;
+	}
+	//highest child first, the sooner best is high the more of the border the other children skip
+	int child = level - 1;
+	int order[4][3];
+	int children = 0;
+	for (int cz = z * 2; cz <= std::min(z * 2 + 1, pyramidHeight[child] - 1); cz++)
 	{
-		for (int x = 0; x < width - 1; x++)
+		for (int cx = x * 2; cx <= std::min(x * 2 + 1, pyramidWidth[child] - 1); cx++)
 		{
-			indices.push_back(  y * width + x);
-			indices.push_back( (y + 1) * width + x);
-			indices.push_back(  y * width + x + 1);
+			int value = PyramidValue(child, cx, cz);
+			int i = children++;
+			for (; i > 0 && order[i - 1][0] < value; i--)
+			{
+				std::copy(order[i - 1], order[i - 1] + 3, order[i]);
+			}
+			order[i][0] = value;
+			order[i][1] = cx;
+			order[i][2] = cz;
+		}
+	}
+	for (int i = 0; i < children; i++)
+	{
+		QueryMaxHeight(child, order[i][1], order[i][2], x0, z0, x1, z1, best);
+	}
+}
+
+float Map::GetMaxHeight(float minX, float minZ, float maxX, float maxZ)
+{
+	if (terrainTiles) return terrainTiles->GetMaxHeight(minX, minZ, maxX, maxZ);
 
-			indices.push_back(  y * width + x + 1);
-			indices.push_back( (y + 1) * width + x);
-			indices.push_back( (y + 1) * width + x + 1);
+	int x0 = static_cast<int>(std::floor(minX));
+	int z0 = static_cast<int>(std::floor(minZ));
+	int cellX1 = static_cast<int>(std::floor(maxX));
+	int cellZ1 = static_cast<int>(std::floor(maxZ));
+	int x1 = cellX1 + (static_cast<float>(cellX1) < maxX ? 1 : 0);
+	int z1 = cellZ1 + (static_cast<float>(cellZ1) < maxZ ? 1 : 0);
+
+	//GetHeight returns 0 for any sample whose cell is not fully inside the map
+	bool outside = x0 < 0 || z0 < 0 || cellX1 + 1 >= width || cellZ1 + 1 >= height;
+	float floorHeight = outside ? 0.0f : -FLT_MAX;
+
+	x0 = std::max(x0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, width - 1);
+	z1 = std::min(z1, height - 1);
+	if (x0 > x1 || z0 > z1 || heightMap.empty()) return floorHeight;
+
+	//the search runs on the stored samples, which order the same way as the heights they decode to
+	int best = -1;
+	//a handful of rows is cheaper to scan than to descend
+	if ((x1 - x0 + 1) * (z1 - z0 + 1) <= queryScanSize * queryScanSize)
+	{
+		for (int z = z0; z <= z1; z++)
+		{
+			const uint16_t* row = heightMap.data() + z * width;
+			for (int x = x0; x <= x1; x++) best = std::max(best, static_cast<int>(row[x]));
 		}
+		return std::max(floorHeight, DecodeHeight(static_cast<uint16_t>(best)));
 	}
 
-	//calculate the normals
-	for (int i = vertexOffset; i < vertices.size(); i++) {
-		vertices[i].normal = { 0.0f,0.0f,0.0f };
+	//start at the finest level where the rectangle touches at most 2x2 nodes
+	int level = 0;
+	while ((x1 >> level) - (x0 >> level) > 1 || (z1 >> level) - (z0 >> level) > 1)
+	{
+		level++;
 	}
-	for (int i = indexOffset; i < indices.size(); i += 3)
+	for (int z = z0 >> level; z <= z1 >> level; z++)
 	{
-		DirectX::XMFLOAT3 v0 = vertices[indices[i]+ vertexOffset].position;
-		DirectX::XMFLOAT3 v1 = vertices[indices[i + 1]+ vertexOffset].position;
-		DirectX::XMFLOAT3 v2 = vertices[indices[i + 2]+ vertexOffset].position;
+		for (int x = x0 >> level; x <= x1 >> level; x++)
+		{
+			QueryMaxHeight(level, x, z, x0, z0, x1, z1, best);
+		}
+	}
+	return std::max(floorHeight, DecodeHeight(static_cast<uint16_t>(best)));
+}
 
-		DirectX::XMFLOAT3 edge1 = { v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
-		DirectX::XMFLOAT3 edge2 = { v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
-		DirectX::XMFLOAT3 normal = {
-			edge1.y * edge2.z - edge1.z * edge2.y,
-			edge1.z * edge2.x - edge1.x * edge2.z,
-			edge1.x * edge2.y - edge1.y * edge2.x };
+float Map::CellMax(int level, int x, int z)
+{
+	const uint16_t* data = level == 0 ? heightMap.data() : maxPyramid[level - 1].data();
+	int w = pyramidWidth[level];
+	int x1 = std::min(x + 1, w - 1);
+	int z1 = std::min(z + 1, pyramidHeight[level] - 1);
+	return DecodeHeight(std::max(std::max(data[z * w + x], data[z * w + x1]), std::max(data[z1 * w + x], data[z1 * w + x1])));
+}
 
-		vertices[indices[i]].normal.x += normal.x;
-		vertices[indices[i]].normal.y += normal.y;
-		vertices[indices[i]].normal.z += normal.z;
-		vertices[indices[i + 1]].normal.x += normal.x;
-		vertices[indices[i + 1]].normal.y += normal.y;
-		vertices[indices[i + 1]].normal.z += normal.z;
-		vertices[indices[i + 2]].normal.x += normal.x;
-		vertices[indices[i + 2]].normal.y += normal.y;
-		vertices[indices[i + 2]].normal.z += normal.z;
+bool Map::IntersectCell(int cx, int cz, const DirectX::XMFLOAT3& p, const DirectX::XMFLOAT3& d, float length, float& s)
+{
+	float h00 = DecodeHeight(heightMap[cz * width + cx]);
+	float h01 = DecodeHeight(heightMap[cz * width + cx + 1]);
+	float h10 = DecodeHeight(heightMap[(cz + 1) * width + cx]);
+	float h11 = DecodeHeight(heightMap[(cz + 1) * width + cx + 1]);
+	float a = h01 - h00;
+	float b = h10 - h00;
+	float c = h00 - h01 - h10 + h11;
+	float u = p.x - static_cast<float>(cx);
+	float v = p.z - static_cast<float>(cz);
+
+	//the patch is bilinear and the ray linear in x and z, so ray height minus terrain height is a quadratic in s
+	float C = p.y - (h00 + a * u + b * v + c * u * v);
+	float B = d.y - (a * d.x + b * d.z + c * (u * d.z + v * d.x));
+	float A = -c * d.x * d.z;
+	if (C <= 0.0f)
+	{
+		s = 0.0f;
+		return true;
 	}
-	//normalize the normals
-	for (int i = vertexOffset; i < vertices.size(); i++) {
-		DirectX::XMVECTOR n = DirectX::XMLoadFloat3(&vertices[i].normal);
-		n = DirectX::XMVector3Normalize(n);
-		DirectX::XMStoreFloat3(&vertices[i].normal, n);
-		normals.push_back(vertices[i].normal);
+
+	float best = FLT_MAX;
+	if (fabs(A) < 1e-8f)
+	{
+		if (B < 0.0f) best = -C / B;
+	}
+	else
+	{
+		float discriminant = B * B - 4.0f * A * C;
+		if (discriminant >= 0.0f)
+		{
+			//the stable form of the two roots
+			float q = -0.5f * (B + (B >= 0.0f ? 1.0f : -1.0f) * sqrt(discriminant));
+			float r0 = q / A;
+			float r1 = q != 0.0f ? C / q : FLT_MAX;
+			if (r0 >= 0.0f) best = std::min(best, r0);
+			if (r1 >= 0.0f) best = std::min(best, r1);
+		}
+	}
+	if (best <= length)
+	{
+		s = best;
+		return true;
+	}
+	//rounding can lose a root the ends of the interval prove is there
+	if (C + B * length + A * length * length <= 0.0f)
+	{
+		s = length;
+		return true;
+	}
+	return false;
+}
+
+bool Map::Raycast(const TerrainRay& ray, TerrainHit& hit)
+{
+	hit = TerrainHit();
+	if (width < 2 || height < 2 || heightMap.empty()) return false;
+	float length = sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z);
+	if (length == 0.0f) return false;
+	DirectX::XMFLOAT3 o = ray.origin;
+	DirectX::XMFLOAT3 d = { ray.direction.x / length, ray.direction.y / length, ray.direction.z / length };
+
+	//clip to the map's rectangle
+	float t0 = 0.0f;
+	float t1 = ray.maxDistance;
+	auto clip = [&](float origin, float direction, float high)
+	{
+		if (direction == 0.0f) return origin >= 0.0f && origin <= high;
+		float a = (0.0f - origin) / direction;
+		float b = (high - origin) / direction;
+		t0 = std::max(t0, std::min(a, b));
+		t1 = std::min(t1, std::max(a, b));
+		return t0 <= t1;
+	};
+	if (!clip(o.x, d.x, static_cast<float>(width - 1)) || !clip(o.z, d.z, static_cast<float>(height - 1))) return false;
+
+	//the cell a point is in, a point on a cell border belongs to the cell the ray goes on into
+	auto cellOf = [](float p, float direction, int cells)
+	{
+		int cell = static_cast<int>(std::floor(p));
+		if (direction < 0.0f && static_cast<float>(cell) == p) cell--;
+		return std::max(std::min(cell, cells - 1), 0);
+	};
+
+	//nodes much bigger than the ray's reach only cost steps to descend through
+	int top = static_cast<int>(pyramidWidth.size()) - 1;
+	int level = 0;
+	while (level < top && static_cast<float>(1 << level) < t1 - t0) level++;
+	float invX = d.x != 0.0f ? 1.0f / d.x : 0.0f;
+	float invZ = d.z != 0.0f ? 1.0f / d.z : 0.0f;
+	float t = t0;
+	while (true)
+	{
+		int cx = cellOf(o.x + d.x * t, d.x, width - 1);
+		int cz = cellOf(o.z + d.z * t, d.z, height - 1);
+		int nx = cx >> level;
+		int nz = cz >> level;
+
+		//where the ray leaves the node's cells
+		float tExit = t1;
+		if (d.x > 0.0f) tExit = std::min(tExit, (static_cast<float>(std::min((nx + 1) << level, width - 1)) - o.x) * invX);
+		else if (d.x < 0.0f) tExit = std::min(tExit, (static_cast<float>(nx << level) - o.x) * invX);
+		if (d.z > 0.0f) tExit = std::min(tExit, (static_cast<float>(std::min((nz + 1) << level, height - 1)) - o.z) * invZ);
+		else if (d.z < 0.0f) tExit = std::min(tExit, (static_cast<float>(nz << level) - o.z) * invZ);
+		tExit = std::max(tExit, t);
+
+		//the ray is straight, so it is lowest over the node at one of its ends
+		bool above = std::min(o.y + d.y * t, o.y + d.y * tExit) > CellMax(level, nx, nz);
+		if (!above && level > 0)
+		{
+			level--;
+			continue;
+		}
+		float s = 0.0f;
+		if (!above && IntersectCell(cx, cz, { o.x + d.x * t, o.y + d.y * t, o.z + d.z * t }, d, tExit - t, s))
+		{
+			hit.hit = true;
+			hit.distance = t + s;
+			hit.position = { o.x + d.x * hit.distance, o.y + d.y * hit.distance, o.z + d.z * hit.distance };
+			return true;
+		}
+		if (tExit >= t1) return false;
+		//a node border landing on t itself must still move the ray on, t1 itself is the last point tested
+		t = std::min(std::max(tExit, t + 1e-5f * (1.0f + t)), t1);
+		level = std::min(level + 1, top);
 	}
 }
 
+void Map::RaycastBatch(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, JobSystem& jobSystem)
+{
+	hits.resize(rays.size());
+	jobSystem.parallelFor(static_cast<int>(rays.size()), 64, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			Raycast(rays[i], hits[i]);
+		}
+	});
+}
+
+bool Map::LineOfSight(const DirectX::XMFLOAT3& from, const DirectX::XMFLOAT3& to)
+{
+	TerrainRay ray;
+	ray.origin = from;
+	ray.direction = { to.x - from.x, to.y - from.y, to.z - from.z };
+	ray.maxDistance = sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z);
+	TerrainHit hit;
+	return !Raycast(ray, hit);
+}
+
+bool Map::SaveTerrainTiles(const std::string& filename, int tileSize, int overviewStep)
+{
+	return TerrainTiles::write(filename, width, height, tileSize, overviewStep, [&](int x, int z) { return DecodeHeight(heightMap[z * width + x]); });
+}
+
+bool Map::OpenTerrainTiles(const std::string& filename)
+{
+	std::unique_ptr<TerrainTiles> tiles = std::make_unique<TerrainTiles>();
+	if (!tiles->open(filename)) return false;
+	terrainTiles = std::move(tiles);
+	return true;
+}
+
+int Map::WorldWidth() const
+{
+	return terrainTiles ? terrainTiles->width() : width;
+}
+
+int Map::WorldHeight() const
+{
+	return terrainTiles ? terrainTiles->height() : height;
+}
+
+void Map::UpdateTerrainStreaming(float x, float z)
+{
+	if (terrainTiles) terrainTiles->update(x, z);
+}
+
 void Map::CheckVerticalCollision_Player(Object& object)
 {
-	object.position.x = std::max(std::min(object.position.x, static_cast<float>(width)), 0.0f);
-	object.position.z = std::max(std::min(object.position.z, static_cast<float>(height)), 0.0f);
+	object.position.x = std::max(std::min(object.position.x, static_cast<float>(WorldWidth())), 0.0f);
+	object.position.z = std::max(std::min(object.position.z, static_cast<float>(WorldHeight())), 0.0f);
 
 	//check the collision with the terrain
 	DirectX::XMFLOAT3 minBound, maxBound;
 	object.getBound(minBound, maxBound);
 
-	float maxH = -FLT_MAX;
-
-	for (float x = minBound.x; x <= maxBound.x; x = x + 1.0f) {
-		for (float z = minBound.z; z <= maxBound.z; z = z + 1.0f) {
-			float h = GetHeight(x, z);
-			if (h > maxH) {
-				maxH = h;
-			}
-		}
-	}
-	object.position.y = maxH + object.collisionHalfY;
+	object.position.y = GetMaxHeight(minBound.x, minBound.z, maxBound.x, maxBound.z) + object.collisionHalfY;
 }
 
 void Map::CheckVerticalCollision_Object(Object& object)
@@ -167,22 +550,12 @@ void Map::CheckVerticalCollision_Object(Object& object)
 	//check the collision with the terrain
 	DirectX::XMFLOAT3 minBound, maxBound;
 	object.getBound(minBound, maxBound);
-	float maxH = -FLT_MAX;
-
-	for (float x = minBound.x; x <= maxBound.x; x = x + 1.0f) {
-		for (float z = minBound.z; z <= maxBound.z; z = z + 1.0f) {
-			float h = GetHeight(x, z);
-			if (h > maxH) {
-				maxH = h;
-			}
-		}
-	}
-	object.position.y = maxH;
+	object.position.y = GetMaxHeight(minBound.x, minBound.z, maxBound.x, maxBound.z);
 }
 
 bool Map::CanArrive(Object& object, float x, float z)
 {
-	if (x < 0 || x >= width || z < 0 || z >= height)
+	if (x < 0 || x >= WorldWidth() || z < 0 || z >= WorldHeight())
 	{
 		return false;
 	}
@@ -1,24 +1,101 @@
 #pragma once
 #include "Vertex.h"
 #include "Object.h"
+#include "TerrainChunks.h"
+#include "TerrainTiles.h"
+#include <memory>
+#include <string>
 #include <vector>
 //struct Vertex_Static;
 class Object;
+class JobSystem;
+
+//a ray in map space, direction does not have to be unit length, maxDistance is measured along it in map units
+struct TerrainRay
+{
+	DirectX::XMFLOAT3 origin = { 0.0f,0.0f,0.0f };
+	DirectX::XMFLOAT3 direction = { 0.0f,0.0f,1.0f };
+	float maxDistance = 0.0f;
+};
+struct TerrainHit
+{
+	bool hit = false;
+	float distance = 0.0f;
+	DirectX::XMFLOAT3 position = { 0.0f,0.0f,0.0f };
+};
 class Map
 {
 private:
-	float GetHeight(float x, float z);
 	DirectX::XMFLOAT3 GetTerrainNormal(float x, float z);
+
+	//max height pyramid, level 0 is heightMap itself and every texel of level l+1 is the max of a 2x2 block of level l
+	//maxPyramid[l - 1] holds level l, the last level is a single texel, stored quantized like heightMap
+	std::vector<std::vector<uint16_t>> maxPyramid;
+	std::vector<int> pyramidWidth;
+	std::vector<int> pyramidHeight;
+	uint16_t PyramidValue(int level, int x, int z);
+	//border nodes and whole queries up to this many texels a side are scanned instead of descended
+	static const int queryScanSize = 16;
+	//fill width, height and heightMap from a 16 or 8 bit image, or a .raw/.r16 file
+	bool ReadHeightFile(const std::string& filename);
+	//rebase heightMap's source samples onto the map's own min and max, heightScale and heightOffset decode them
+	void FitHeightRange(float sourceStep);
+	void QueryMaxHeight(int level, int x, int z, int x0, int z0, int x1, int z1, int& best);
+	//highest point of the bilinear cells under pyramid node (x, z), which also reach into the next node's first texels
+	float CellMax(int level, int x, int z);
+	//first s in [0, length] where p + d * s meets the bilinear patch of cell (cx, cz)
+	bool IntersectCell(int cx, int cz, const DirectX::XMFLOAT3& p, const DirectX::XMFLOAT3& d, float length, float& s);
 public:
+	//size of heightMap, normals and the max pyramid, open streamed tiles do not change it, see WorldWidth
 	int width=0;
 	int height=0;
 	int channel=0;
 	//float scale = 100.0f;
 
-	std::vector<float> heightMap;
-	std::vector<DirectX::XMFLOAT3> normals;
+	//a texel's height is heightOffset + heightScale * heightMap[i]
+	//set per map from its lowest and highest sample: the lowest is stored as 0 and the samples are spread over as
+	//much of the 16 bit range as a whole number of steps per source step allows, so no source sample is rounded
+	float heightScale = 1.0f / 256.0f;
+	float heightOffset = 0.0f;
+	std::vector<uint16_t> heightMap;
+	//octahedral, see packOctahedral
+	std::vector<uint16_t> normals;
+	//draw ranges of the terrain mesh built by LoadHeightMap
+	TerrainChunks terrainChunks;
+	//streamed heights, while open every height and normal query reads them instead of heightMap
+	std::unique_ptr<TerrainTiles> terrainTiles;
+
+	float DecodeHeight(uint16_t sample) const { return heightOffset + heightScale * static_cast<float>(sample); }
+
+	//builds the grid, its normals and the chunk index sets in parallel row bands on jobSystem,
+	//the mesh is the same for any thread count, a null jobSystem uses a temporary one
+	void LoadHeightMap(std::string filename, std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices, JobSystem* jobSystem = nullptr);
+	//called by LoadHeightMap, call again whenever heightMap is replaced
+	void BuildHeightPyramid();
+	//bilinear height of the texels around (x, z), 0 off the map, read from the streamed tiles while they are open
+	float GetHeight(float x, float z);
+	//highest terrain texel under the XZ rectangle, every bilinear sample inside the rectangle is at most this high
+	//returns at least 0 if the rectangle leaves the map, matching GetHeight
+	float GetMaxHeight(float minX, float minZ, float maxX, float maxZ);
+
+	//first point where the ray meets the surface GetHeight samples, over [0, width - 1] x [0, height - 1]
+	//walks the cells with a DDA and skips every max pyramid node the ray passes above, a ray starting under the terrain hits at once
+	//reads heightMap, not streamed tiles, and only reads, so any number of threads may cast at once
+	bool Raycast(const TerrainRay& ray, TerrainHit& hit);
+	void RaycastBatch(const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits, JobSystem& jobSystem);
+	//true if the terrain does not cut the segment between the two points
+	bool LineOfSight(const DirectX::XMFLOAT3& from, const DirectX::XMFLOAT3& to);
 
-	void LoadHeightMap(std::string filename, std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices);
+	//split heightMap into a tile file for OpenTerrainTiles
+	bool SaveTerrainTiles(const std::string& filename, int tileSize, int overviewStep);
+	//height, normal and max height queries read the tiles from then on, heightMap, its mesh, width, height
+	//and Raycast keep the data LoadHeightMap built
+	bool OpenTerrainTiles(const std::string& filename);
+	//size of the walkable world, the streamed tiles' while they are open and the height map's otherwise
+	int WorldWidth() const;
+	int WorldHeight() const;
+	//load the tiles around (x, z), call once per frame before the collision checks
+	void UpdateTerrainStreaming(float x, float z);
 
 	void CheckVerticalCollision_Player(Object& object);
 	void CheckVerticalCollision_Object(Object& object);
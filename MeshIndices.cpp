@@ -0,0 +1,32 @@
+#include "MeshIndices.h"
+
+bool fitsShortIndices(const unsigned int* indices, size_t count, unsigned int baseVertex)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (indices[i] < baseVertex || indices[i] - baseVertex > maxShortIndex) return false;
+	}
+	return true;
+}
+
+size_t appendIndices(const unsigned int* indices, size_t count, unsigned int baseVertex, std::vector<unsigned int>& indices32, std::vector<uint16_t>& indices16, bool& shortIndices)
+{
+	shortIndices = fitsShortIndices(indices, count, baseVertex);
+	if (shortIndices)
+	{
+		size_t offset = indices16.size();
+		indices16.resize(offset + count);
+		for (size_t i = 0; i < count; i++)
+		{
+			indices16[offset + i] = static_cast<uint16_t>(indices[i] - baseVertex);
+		}
+		return offset;
+	}
+	size_t offset = indices32.size();
+	indices32.resize(offset + count);
+	for (size_t i = 0; i < count; i++)
+	{
+		indices32[offset + i] = indices[i] - baseVertex;
+	}
+	return offset;
+}
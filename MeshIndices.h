@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//meshes are drawn with their first vertex as the base vertex, so their indices only need to reach their own vertices
+//a mesh whose indices all fit in 16 bits goes to a pool of uint16 indices and is drawn with a 16 bit index buffer
+//0xFFFF is never used, it is the strip cut value
+constexpr unsigned int maxShortIndex = 0xFFFE;
+
+//whether every index minus baseVertex fits in 16 bits, an index below baseVertex never does
+bool fitsShortIndices(const unsigned int* indices, size_t count, unsigned int baseVertex);
+
+//append the indices minus baseVertex to indices16 when they fit and to indices32 otherwise
+//baseVertex is 0 for indices that are already relative to the mesh's first vertex, no index may be below it
+//returns the offset of the first appended index in the pool it went to, shortIndices tells which one
+size_t appendIndices(const unsigned int* indices, size_t count, unsigned int baseVertex, std::vector<unsigned int>& indices32, std::vector<uint16_t>& indices16, bool& shortIndices);
@@ -1,39 +1,99 @@
 #include "Object.h"
+#include "LevelCache.h"
+#include "JobSystem.h"
+#include "Profiler.h"
 #include<algorithm>
+#include<cmath>
 Animation NPC::animation;
 Skeleton NPC::skeleton;
+PoseCache NPC::poseCache;
+BakedAnimation NPC::bakedAnimation;
 
-DirectX::XMFLOAT3 AnimationSequence::interpolateFloat3(DirectX::XMFLOAT3& p0, DirectX::XMFLOAT3& p1, float interpolationFact)
+void AnimationSequence::resize(int frames, int bones)
 {
-	DirectX::XMVECTOR v0 = DirectX::XMLoadFloat3(&p0);
-	DirectX::XMVECTOR v1 = DirectX::XMLoadFloat3(&p1);
-	DirectX::XMVECTOR result = DirectX::XMVectorLerp(v0, v1, interpolationFact);
-	DirectX::XMFLOAT3 resultF;
-	DirectX::XMStoreFloat3(&resultF, result);
-	return resultF;
+	frameCount = frames;
+	boneCount = bones;
+	boneStride = (bones + 3) & ~3;
+	positions.assign(static_cast<size_t>(frameCount) * boneStride, DirectX::XMFLOAT4A(0.0f, 0.0f, 0.0f, 0.0f));
+	quaternions.assign(static_cast<size_t>(frameCount) * boneStride, DirectX::XMFLOAT4A(0.0f, 0.0f, 0.0f, 1.0f));
+	scales.assign(static_cast<size_t>(frameCount) * boneStride, DirectX::XMFLOAT4A(1.0f, 1.0f, 1.0f, 0.0f));
+}
+
+void AnimationSequence::compress(const ClipCompressionSettings& settings)
+{
+	if (!compressed.empty()) return;
+	compressed.build(frameCount, boneCount, boneStride, positions, quaternions, scales, settings);
+	if (compressed.empty()) return;
+	std::vector<DirectX::XMFLOAT4A>().swap(positions);
+	std::vector<DirectX::XMFLOAT4A>().swap(quaternions);
+	std::vector<DirectX::XMFLOAT4A>().swap(scales);
+}
 
+size_t AnimationSequence::sizeInBytes() const
+{
+	return compressed.sizeInBytes() + (positions.size() + quaternions.size() + scales.size()) * sizeof(DirectX::XMFLOAT4A);
 }
 
-DirectX::XMFLOAT4 AnimationSequence::interpolateQuaternion(DirectX::XMFLOAT4& q0, DirectX::XMFLOAT4& q1, float interpolationFact)
+void AnimationSequence::sampleBlock(int frame1, int frame2, int bone, DirectX::XMVECTOR interpolationFact, DirectX::XMVECTOR position[4], DirectX::XMVECTOR quaternion[4], DirectX::XMVECTOR scale[4])
 {
-	DirectX::XMVECTOR v0 = DirectX::XMLoadFloat4(&q0);
-	DirectX::XMVECTOR v1 = DirectX::XMLoadFloat4(&q1);
-	DirectX::XMVECTOR result = DirectX::XMQuaternionSlerp(v0, v1, interpolationFact);
-	DirectX::XMFLOAT4 resultF;
-	DirectX::XMStoreFloat4(&resultF, result);
-	return resultF;
+	size_t i1 = static_cast<size_t>(frame1) * boneStride + bone;
+	size_t i2 = static_cast<size_t>(frame2) * boneStride + bone;
+
+	//positions and scales: one lerp per bone, xyz in the lanes
+	for (int k = 0; k < 4; k++)
+	{
+		DirectX::XMVECTOR p0 = DirectX::XMLoadFloat4A(&positions[i1 + k]);
+		DirectX::XMVECTOR p1 = DirectX::XMLoadFloat4A(&positions[i2 + k]);
+		position[k] = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSubtract(p1, p0), interpolationFact, p0);
+		DirectX::XMVECTOR s0 = DirectX::XMLoadFloat4A(&scales[i1 + k]);
+		DirectX::XMVECTOR s1 = DirectX::XMLoadFloat4A(&scales[i2 + k]);
+		scale[k] = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSubtract(s1, s0), interpolationFact, s0);
+	}
+
+	//quaternions: transpose four bones so each lane is one bone, then nlerp them together
+	DirectX::XMMATRIX q0 = DirectX::XMMatrixTranspose(DirectX::XMMATRIX(
+		DirectX::XMLoadFloat4A(&quaternions[i1]), DirectX::XMLoadFloat4A(&quaternions[i1 + 1]),
+		DirectX::XMLoadFloat4A(&quaternions[i1 + 2]), DirectX::XMLoadFloat4A(&quaternions[i1 + 3])));
+	DirectX::XMMATRIX q1 = DirectX::XMMatrixTranspose(DirectX::XMMATRIX(
+		DirectX::XMLoadFloat4A(&quaternions[i2]), DirectX::XMLoadFloat4A(&quaternions[i2 + 1]),
+		DirectX::XMLoadFloat4A(&quaternions[i2 + 2]), DirectX::XMLoadFloat4A(&quaternions[i2 + 3])));
+
+	DirectX::XMVECTOR dot = DirectX::XMVectorMultiply(q0.r[0], q1.r[0]);
+	dot = DirectX::XMVectorMultiplyAdd(q0.r[1], q1.r[1], dot);
+	dot = DirectX::XMVectorMultiplyAdd(q0.r[2], q1.r[2], dot);
+	dot = DirectX::XMVectorMultiplyAdd(q0.r[3], q1.r[3], dot);
+	//take the shortest path by flipping the second key where the dot product is negative
+	DirectX::XMVECTOR flip = DirectX::XMVectorAndInt(dot, DirectX::XMVectorSplatSignMask());
+
+	DirectX::XMVECTOR length = DirectX::XMVectorZero();
+	for (int c = 0; c < 4; c++)
+	{
+		DirectX::XMVECTOR b = DirectX::XMVectorXorInt(q1.r[c], flip);
+		q0.r[c] = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSubtract(b, q0.r[c]), interpolationFact, q0.r[c]);
+		length = DirectX::XMVectorMultiplyAdd(q0.r[c], q0.r[c], length);
+	}
+	DirectX::XMVECTOR invLength = DirectX::XMVectorReciprocalSqrt(length);
+	for (int c = 0; c < 4; c++)
+	{
+		q0.r[c] = DirectX::XMVectorMultiply(q0.r[c], invLength);
+	}
+	q0 = DirectX::XMMatrixTranspose(q0);
+	for (int k = 0; k < 4; k++)
+	{
+		quaternion[k] = q0.r[k];
+	}
 }
 
 float AnimationSequence::getDuration()
 {
-	return static_cast<float>(frames.size()) / ticksPerSecond;
+	return static_cast<float>(frameCount) / ticksPerSecond;
 }
 
 void AnimationSequence::calcFrame(float time, int& frame, float& interpolationFact)
 {
 	interpolationFact = time * ticksPerSecond;
 	frame = static_cast<int>(interpolationFact);
-	frame = std::max(0, std::min(frame, static_cast<int>(frames.size()) - 1));
+	frame = std::max(0, std::min(frame, frameCount - 1));
 	interpolationFact = interpolationFact - static_cast<float>(frame);
 	interpolationFact = std::min(interpolationFact, 1.0f);
 }
@@ -42,92 +102,263 @@ int AnimationSequence::getNextFrame(int frame, bool death)
 {
 	if (death) 
 	{ 
-		return std::min(frame + 1, static_cast<int>(frames.size()-1));
+		return std::min(frame + 1, frameCount - 1);
+	}
+	return (frame + 1) % frameCount;
+}
+
+void AnimationSequence::interpolateBonesToGlobal(std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, const Skeleton& skeleton, bool death, const std::vector<int>& boneSource)
+{
+	int nextFrame = getNextFrame(baseFrame, death);
+	DirectX::XMVECTOR t = DirectX::XMVectorReplicate(interpolationFact);
+	DirectX::XMVECTOR p[4];
+	DirectX::XMVECTOR q[4];
+	DirectX::XMVECTOR s[4];
+	int bones = std::min(boneCount, static_cast<int>(skeleton.bones.size()));
+
+	bool reduced = !boneSource.empty();
+
+	for (int block = 0; block < bones; block += 4)
+	{
+		if (reduced)
+		{
+			bool evaluated = false;
+			for (int k = 0; k < 4 && block + k < bones; k++)
+			{
+				evaluated = evaluated || boneSource[block + k] == block + k;
+			}
+			if (!evaluated) continue;
+		}
+		if (compressed.empty())
+		{
+			sampleBlock(baseFrame, nextFrame, block, t, p, q, s);
+		}
+		else
+		{
+			compressed.sampleBlock(baseFrame, nextFrame, interpolationFact, block, p, q, s);
+		}
+		for (int k = 0; k < 4 && block + k < bones; k++)
+		{
+			int i = block + k;
+			if (reduced && boneSource[i] != i) continue;
+			//local = scale * rotation * translation, stored transposed like the rest of the pose
+			DirectX::XMMATRIX m = DirectX::XMMatrixRotationQuaternion(q[k]);
+			m.r[0] = DirectX::XMVectorScale(m.r[0], DirectX::XMVectorGetX(s[k]));
+			m.r[1] = DirectX::XMVectorScale(m.r[1], DirectX::XMVectorGetY(s[k]));
+			m.r[2] = DirectX::XMVectorScale(m.r[2], DirectX::XMVectorGetZ(s[k]));
+			m.r[3] = DirectX::XMVectorSetW(p[k], 1.0f);
+			m = DirectX::XMMatrixTranspose(m);
+
+			if (skeleton.bones[i].parentIndex > -1) {
+				DirectX::XMMATRIX parentMatrix = DirectX::XMLoadFloat4x4(&boneTransforms[skeleton.bones[i].parentIndex]);
+				m = parentMatrix * m;
+			}
+			DirectX::XMStoreFloat4x4(&boneTransforms[i], m);
+		}
+	}
+}
+
+
+int Animation::findSequence(const std::string& name)
+{
+	auto it = sequenceHandles.find(name);
+	if (it == sequenceHandles.end()) return -1;
+	return it->second;
+}
+
+int Animation::addSequence(const std::string& name, const AnimationSequence& sequence)
+{
+	int handle = findSequence(name);
+	if (handle < 0)
+	{
+		handle = static_cast<int>(sequences.size());
+		sequences.push_back(sequence);
+		sequenceNames.push_back(name);
+		sequenceHandles[name] = handle;
+	}
+	else
+	{
+		sequences[handle] = sequence;
 	}
-	return (frame + 1) % frames.size();
+	if (name == "death") deathSequence = handle;
+	return handle;
 }
 
-DirectX::XMMATRIX AnimationSequence::interpolateBonesToGlobal(std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, Skeleton& skeleton, int boneIndex, bool death)
+void Animation::buildLODs()
 {
-	AnimationFrame frame1 = frames[baseFrame];
-	AnimationFrame frame2 = frames[getNextFrame(baseFrame,death)];
+	int bones = static_cast<int>(skeleton.bones.size());
+	//height of each bone's subtree, children come after their parents so walk backwards
+	std::vector<int> height(bones, 0);
+	for (int i = bones - 1; i >= 0; i--)
+	{
+		int parent = skeleton.bones[i].parentIndex;
+		if (parent > -1) height[parent] = std::max(height[parent], height[i] + 1);
+	}
+	//roots first since nothing could stand in for them, then the deepest subtrees
+	//a parent is always taller than its children, so every prefix of this order keeps the parents of its bones
+	std::vector<int> order(bones);
+	for (int i = 0; i < bones; i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+	{
+		bool rootA = skeleton.bones[a].parentIndex < 0;
+		bool rootB = skeleton.bones[b].parentIndex < 0;
+		if (rootA != rootB) return rootA;
+		return height[a] > height[b];
+	});
+
+	for (auto& level : lodLevels)
+	{
+		level.boneSource.clear();
+		int kept = static_cast<int>(std::ceil(level.boneFraction * bones));
+		if (kept >= bones) continue;
 
-	DirectX::XMFLOAT3 p = interpolateFloat3(frame1.position[boneIndex], frame2.position[boneIndex], interpolationFact);
-	DirectX::XMFLOAT4 q = interpolateQuaternion(frame1.quaternion[boneIndex], frame2.quaternion[boneIndex], interpolationFact);
-	DirectX::XMFLOAT3 s = interpolateFloat3(frame1.scale[boneIndex], frame2.scale[boneIndex], interpolationFact);
+		std::vector<char> evaluated(bones, 0);
+		for (int k = 0; k < bones; k++)
+		{
+			int i = order[k];
+			if (k < kept || skeleton.bones[i].parentIndex < 0) evaluated[i] = 1;
+		}
+		level.boneSource.resize(bones);
+		for (int i = 0; i < bones; i++)
+		{
+			level.boneSource[i] = evaluated[i] ? i : level.boneSource[skeleton.bones[i].parentIndex];
+		}
+	}
+}
 
-	DirectX::XMMATRIX m = DirectX::XMMatrixTranspose(DirectX::XMMatrixScaling(s.x, s.y, s.z));
-	m = DirectX::XMMatrixTranspose(DirectX::XMMatrixRotationQuaternion(DirectX::XMVectorSet(q.x, q.y, q.z, q.w))) * m;
-	m = DirectX::XMMatrixTranspose(DirectX::XMMatrixTranslation(p.x, p.y, p.z)) * m;
+void Animation::compressSequences()
+{
+	for (auto& sequence : sequences)
+	{
+		sequence.compress(compression);
+	}
+}
 
-	if (skeleton.bones[boneIndex].parentIndex > -1) {
-		DirectX::XMMATRIX parentMatrix = DirectX::XMLoadFloat4x4(&boneTransforms[skeleton.bones[boneIndex].parentIndex]);
-		m = parentMatrix * m;
+int Animation::selectLOD(float distance)
+{
+	int level = 0;
+	while (level + 1 < static_cast<int>(lodLevels.size()) && distance >= lodLevels[level + 1].distance)
+	{
+		level++;
 	}
-	return m;
+	return level;
 }
 
+void Animation::calcFrame(int sequence, float time, int& frame, float& interpolationFact)
+{
+	sequences[sequence].calcFrame(time, frame, interpolationFact);
+}
 
-void Animation::calcFrame(std::string sequenceName, float time, int& frame, float& interpolationFact)
+void Animation::interpolateBonesToGlobal(int sequence, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, bool death, const std::vector<int>& boneSource)
 {
-	sequences[sequenceName].calcFrame(time, frame, interpolationFact);
+	sequences[sequence].interpolateBonesToGlobal(boneTransforms, baseFrame, interpolationFact, skeleton, death, boneSource);
 }
 
-DirectX::XMMATRIX Animation::interpolateBonesToGlobal(std::string name, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, int boneIndex,bool death)
+void Skeleton::combineOffsets()
 {
-	return sequences[name].interpolateBonesToGlobal(boneTransforms, baseFrame, interpolationFact, skeleton, boneIndex,death);
+	finalOffsets.resize(bones.size());
+	for (size_t i = 0; i < bones.size(); i++)
+	{
+		finalOffsets[i] = bones[i].bindingOffset * globalInverse;
+	}
 }
 
-void Animation::calcFinalTransformations(std::vector<DirectX::XMFLOAT4X4>& transform)
+void Animation::calcFinalTransformations(std::vector<DirectX::XMFLOAT4X4>& transform, const std::vector<int>& boneSource)
 {
-	for (int i = 0; i < skeleton.bones.size(); i++)
+	bool reduced = !boneSource.empty();
+	//a skeleton built by hand without combineOffsets still gets the right result
+	bool combined = skeleton.finalOffsets.size() == skeleton.bones.size();
+	int bones = static_cast<int>(skeleton.bones.size());
+	for (int i = 0; i < bones; i++)
 	{
+		if (reduced && boneSource[i] != i) continue;
 		DirectX::XMMATRIX finalTransformation = DirectX::XMLoadFloat4x4(&transform[i]);
 		//finalTransformation = skeleton.globalInverse* skeleton.bones[i].bindingOffset * finalTransformation;
-		finalTransformation = finalTransformation * skeleton.bones[i].bindingOffset * skeleton.globalInverse;
+		finalTransformation = combined ? finalTransformation * skeleton.finalOffsets[i] : finalTransformation * skeleton.bones[i].bindingOffset * skeleton.globalInverse;
 		DirectX::XMStoreFloat4x4(&transform[i], finalTransformation);
 	}
+	if (reduced)
+	{
+		for (int i = 0; i < bones; i++)
+		{
+			if (boneSource[i] != i) transform[i] = transform[boneSource[i]];
+		}
+	}
 }
 bool AnimationInstance::animationFinished()
 {
-	if (time > animation->sequences[sequenceName].getDuration()) return true;
+	if (time > animation->sequences[sequence].getDuration()) return true;
 	return false;
 }
 
-void AnimationInstance::update(std::string name, float deltaTime)
+void AnimationInstance::update(const std::string& name, float deltaTime)
+{
+	update(animation->findSequence(name), deltaTime);
+}
+
+void AnimationInstance::setLOD(int level, int phase)
+{
+	lod = level;
+	updatePhase = phase;
+}
+
+void AnimationInstance::update(int sequenceHandle, float deltaTime)
 {
-	if (deathAnimationFinished) {
+	poseChanged = false;
+	if (deathAnimationFinished || sequenceHandle < 0) {
 		return;
 	}
-	if (name == sequenceName)
+	bool restarted = sequenceHandle != sequence;
+	if (!restarted)
 		time += deltaTime;
 	else
 	{
-		sequenceName = name;
+		sequence = sequenceHandle;
 		time = 0.0f;
 	}
 
+	//time always advances, the pose is only evaluated on this instance's ticks of the LOD interval
+	//a new clip is shown at once
+	static const AnimationLOD fullRate;
+	const AnimationLOD& level = lod < static_cast<int>(animation->lodLevels.size()) ? animation->lodLevels[lod] : fullRate;
+	int tick = updateTick++;
+	bool due = restarted || (tick + updatePhase) % std::max(1, level.updateInterval) == 0;
+
+	bool death = sequence == animation->deathSequence;
 	if (animationFinished()) {
-		if (sequenceName == "death") {
+		if (death) {
 			deathAnimationFinished = true;
-			return;
+			//a skipped tick would leave the body short of its last pose
+			if (!poseStale) return;
+			due = true;
 		}
 		else {
 			time = 0.0f;
 
 		}
 	}
+	if (!due) {
+		poseStale = true;
+		return;
+	}
 
 	int frame = 0;
 	float interpolationFact = 0.0f;
-	animation->calcFrame(sequenceName, time, frame, interpolationFact);
-	DirectX::XMMATRIX bt;
-	for (int i = 0; i < animation->skeleton.bones.size(); i++)
+	animation->calcFrame(sequence, poseCache ? poseCache->quantize(time) : time, frame, interpolationFact);
+	PoseCache::Key key;
+	key.sequence = sequence;
+	key.frame = frame;
+	key.interpolationFact = interpolationFact;
+	key.boneSet = level.boneSource.empty() ? -1 : lod;
+	int bones = static_cast<int>(animation->skeleton.bones.size());
+	if (!poseCache || !poseCache->find(key, BonesTransforms, bones))
 	{
-		bt = animation->interpolateBonesToGlobal(sequenceName, BonesTransforms, frame, interpolationFact, i,sequenceName=="death");
-		DirectX::XMStoreFloat4x4(&BonesTransforms[i], bt);
+		animation->interpolateBonesToGlobal(sequence, BonesTransforms, frame, interpolationFact, death, level.boneSource);
+		animation->calcFinalTransformations(BonesTransforms, level.boneSource);
+		if (poseCache) poseCache->insert(key, BonesTransforms, bones);
 	}
-	animation->calcFinalTransformations(BonesTransforms);
+	poseStale = false;
+	poseChanged = true;
 }
 
 Player::Player()
@@ -150,17 +381,19 @@ void Player::updateCamera(float dx, float dy)
 	up = DirectX::XMVector3TransformNormal({ 0,1,0 }, rotationMatrix);
 }
 
-void Player::move(Window& window, float deltaTime, Map& map,ObjectManager& objectManager)
+void Player::move(const bool* keys, float deltaTime, Map& map,ObjectManager& objectManager)
 {
+	PROFILE_ZONE("Player::move");
 	float f = 0;
 	float r = 0;
-	if (window.keys['W']) f = f + 1;
-	if (window.keys['S']) f = f - 1;
-	if (window.keys['A']) r = r - 1;
-	if (window.keys['D']) r = r + 1;
-
-	DirectX::XMVECTOR moveDir =
-		DirectX::XMVECTOR{ forward.m128_f32[0] * f + right.m128_f32[0] * r, 0 ,forward.m128_f32[2] * f + right.m128_f32[2] * r, 0 };
+	if (keys['W']) f = f + 1;
+	if (keys['S']) f = f - 1;
+	if (keys['A']) r = r - 1;
+	if (keys['D']) r = r + 1;
+
+	DirectX::XMVECTOR moveDir = DirectX::XMVectorSet(
+		DirectX::XMVectorGetX(forward) * f + DirectX::XMVectorGetX(right) * r, 0,
+		DirectX::XMVectorGetZ(forward) * f + DirectX::XMVectorGetZ(right) * r, 0);
 	moveDir = DirectX::XMVector3Normalize(moveDir);
 
 	moveDir = DirectX::XMVectorScale(moveDir, speed * deltaTime);
@@ -168,12 +401,11 @@ void Player::move(Window& window, float deltaTime, Map& map,ObjectManager& objec
 	DirectX::XMStoreFloat3(&p, DirectX::XMVectorAdd(DirectX::XMLoadFloat3(&position), moveDir));
 	if (map.CanArrive(*this, p.x, p.z))
 	{
-		for (auto & object : objectManager.objects)
+		//only objects in the cells around the new position can block it
+		const std::vector<int>& nearby = objectManager.objectGrid.query(p.x - collisionHalfX, p.z - collisionHalfZ, p.x + collisionHalfX, p.z + collisionHalfZ);
+		if (objectManager.collisionWorld.overlapsAny(nearby, p.x, p.z, collisionHalfX, collisionHalfZ))
 		{
-			if (object.preCheckCollisionWithPlayer(p.x, p.z, *this))
-			{
-				return;
-			}
+			return;
 		}
 		position = p;
 	}
@@ -182,6 +414,7 @@ void Player::move(Window& window, float deltaTime, Map& map,ObjectManager& objec
 NPC::NPC()
 {
 	animationInstance.animation = &animation;
+	animationInstance.poseCache = &poseCache;
 }
 
 void Object::getBound(DirectX::XMFLOAT3& minBound, DirectX::XMFLOAT3& maxBound)
@@ -204,6 +437,96 @@ void Object::setScaledCollision(float x, float y, float z)
 	collisionHalfZ = z * scale.z;
 }
 
+void ObjectManager::buildSpatialIndex()
+{
+	objectGrid.clear();
+	npcGrid.clear();
+	collisionWorld.build(objects);
+	for (int i = 0; i < static_cast<int>(objects.size()); i++)
+	{
+		updateObject(i);
+	}
+	for (int i = 0; i < static_cast<int>(npcs.size()); i++)
+	{
+		updateNPC(i);
+	}
+}
+
+void ObjectManager::updateObject(int index)
+{
+	DirectX::XMFLOAT3 minBound, maxBound;
+	objects[index].getBound(minBound, maxBound);
+	objectGrid.update(index, minBound.x, minBound.z, maxBound.x, maxBound.z);
+	collisionWorld.update(index, objects[index]);
+}
+
+void ObjectManager::updateNPC(int index)
+{
+	DirectX::XMFLOAT3 minBound, maxBound;
+	npcs[index].getBound(minBound, maxBound);
+	npcGrid.update(index, minBound.x, minBound.z, maxBound.x, maxBound.z);
+}
+
+void ObjectManager::findNPCsNearPlayer(Player& player)
+{
+	DirectX::XMFLOAT3 playerMin, playerMax;
+	player.getBound(playerMin, playerMax);
+	nearPlayer.assign(npcs.size(), 0);
+	for (int index : npcGrid.query(playerMin.x, playerMin.z, playerMax.x, playerMax.z))
+	{
+		nearPlayer[index] = 1;
+	}
+}
+
+void ObjectManager::updateNPCs(Player& player, float deltaTime, MeshManager& meshManager, JobSystem& jobSystem)
+{
+	findNPCsNearPlayer(player);
+	int deathSequence = NPC::animation.deathSequence;
+	NPC::poseCache.beginTick();
+	jobSystem.parallelFor(static_cast<int>(npcs.size()), 8, [&](int begin, int end)
+	{
+		PROFILE_ZONE("NPC update");
+		for (int i = begin; i < end; i++)
+		{
+			NPC& npc = npcs[i];
+			float dx = npc.position.x - player.position.x;
+			float dy = npc.position.y - player.position.y;
+			float dz = npc.position.z - player.position.z;
+			npc.animationInstance.setLOD(NPC::animation.selectLOD(std::sqrt(dx * dx + dy * dy + dz * dz)), i);
+			if (npc.isAlive && nearPlayer[i] && npc.checkCollisionWithPlayer(player)) {
+				npc.isAlive = false;
+				npc.animationInstance.update(deathSequence, 0.0f);
+			}
+			else {
+				npc.animationInstance.update(npc.animationInstance.sequence, deltaTime);
+			}
+			//the palette keeps the last packed pose, so unchanged poses are not packed again
+			if (npc.animationInstance.poseChanged) {
+				meshManager.updateBonesVector(npc.animationInstance.BonesTransforms, i);
+			}
+		}
+	});
+}
+
+const std::vector<SweepAndPrune::Pair>& ObjectManager::updateBroadPhase()
+{
+	int npcCount = static_cast<int>(npcs.size());
+	broadPhase.resize(npcCount + static_cast<int>(objects.size()));
+	DirectX::XMFLOAT3 minBound, maxBound;
+	for (int i = 0; i < npcCount; i++)
+	{
+		npcs[i].getBound(minBound, maxBound);
+		broadPhase.setBox(i, minBound, maxBound);
+	}
+	//placed objects never move, so they are not tested against each other
+	for (int i = 0; i < static_cast<int>(objects.size()); i++)
+	{
+		objects[i].getBound(minBound, maxBound);
+		broadPhase.setBox(npcCount + i, minBound, maxBound, true);
+	}
+	return broadPhase.update();
+}
+
 bool Object::checkCollisionWithPlayer(Object& object)
 {
 	float PDx = std::min(position.x + collisionHalfX, object.position.x + object.collisionHalfX) - std::max(position.x - collisionHalfX, object.position.x - object.collisionHalfX);
@@ -227,14 +550,59 @@ bool Object::preCheckCollisionWithPlayer(float x, float z, Object& object)
 	return false;
 }
 
-Vertex_Static MeshManager::GEMStaticVertexToStaticVertex(const GEMLoader::GEMStaticVertex& gemVertices)
+void MeshManager::loadGEMMesh(GEMLoader::GEMMaterial& gemmaterial, GEMLoader::GEMSpan<GEMLoader::GEMStaticVertex> verticesStatic, GEMLoader::GEMSpan<GEMLoader::GEMAnimatedVertex> verticesAnimated, GEMLoader::GEMSpan<unsigned int> gemindices, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName)
 {
-	return {
-		{ gemVertices.position.x, gemVertices.position.y, gemVertices.position.z },
-		{ gemVertices.normal.x, gemVertices.normal.y, gemVertices.normal.z },
-		{ gemVertices.tangent.x, gemVertices.tangent.y, gemVertices.tangent.z },
-		{ gemVertices.u, gemVertices.v }
-	};
+	//the GEM vertex layouts match the GPU vertex layouts, so vertices are copied in bulk
+	static_assert(sizeof(Vertex_Static) == sizeof(GEMLoader::GEMStaticVertex), "Vertex_Static must match GEMStaticVertex");
+	static_assert(sizeof(Vertex_Dynamic) == sizeof(GEMLoader::GEMAnimatedVertex), "Vertex_Dynamic must match GEMAnimatedVertex");
+
+	MeshDescriptor md;
+	std::vector<unsigned int>* indices;
+	std::vector<uint16_t>* indices16;
+	if (verticesAnimated.size > 0) {
+		md.isDynamic = true;
+		//load the vertices
+		md.vertexOffset = vertices_Dynamic.size();
+		md.vertexCount = verticesAnimated.size;
+		vertices_Dynamic.resize(vertices_Dynamic.size() + verticesAnimated.size);
+		memcpy(&vertices_Dynamic[md.vertexOffset], verticesAnimated.data, sizeof(Vertex_Dynamic) * verticesAnimated.size);
+		indices = &indices_Dynamic;
+		indices16 = &indices16_Dynamic;
+	}
+	else
+	{
+		md.isDynamic = false;
+		//load the vertices
+		md.vertexOffset = vertices_Static.size();
+		md.vertexCount = verticesStatic.size;
+		vertices_Static.resize(vertices_Static.size() + verticesStatic.size);
+		if (verticesStatic.size > 0) {
+			memcpy(&vertices_Static[md.vertexOffset], verticesStatic.data, sizeof(Vertex_Static) * verticesStatic.size);
+		}
+		indices = &indices_Static;
+		indices16 = &indices16_Static;
+	}
+	//load the indices, GEM indices are already relative to the mesh's first vertex
+	md.indexOffset = static_cast<int>(appendIndices(gemindices.data, gemindices.size, 0, *indices, *indices16, md.shortIndices));
+	md.indexCount = gemindices.size;
+
+	//load the materials
+	Material material;
+	for (auto& prop : gemmaterial.properties) {
+
+		material.properties.push_back({ prop.name, prop.value });
+	}
+	materials.push_back(material);
+	md.textureFile = material.find("diffuse").filePath;
+	md.normalMapFile = material.find("normals").filePath;
+
+	if (md.isDynamic) {
+		//load Skeleton
+		loadSkeleton(GEManimation, animation);
+		//load Animation
+		loadAnimation(GEManimation, animation);
+	}
+	objects[objectName] = md;
 }
 
 void MeshManager::loadGEMMeshAndAnimation(std::vector<GEMLoader::GEMMesh>& gemmeshes, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName)
@@ -244,79 +612,22 @@ void MeshManager::loadGEMMeshAndAnimation(std::vector<GEMLoader::GEMMesh>& gemme
 	}
 	for (auto& gemmesh : gemmeshes)
 	{
-		MeshDescriptor md;
-		if (gemmesh.isAnimated()) {
-			md.isDynamic = true;
-			//load the vertices
-			md.vertexOffset = vertices_Dynamic.size();
-			md.vertexCount = gemmesh.verticesAnimated.size();
-			Vertex_Dynamic v;
-			for (auto& vertex : gemmesh.verticesAnimated)
-			{
-				v.position = { vertex.position.x,vertex.position.y,vertex.position.z };
-				v.normal = { vertex.normal.x,vertex.normal.y,vertex.normal.z };
-				v.tangent = { vertex.tangent.x,vertex.tangent.y,vertex.tangent.z };
-				v.uvCoords = { vertex.u,vertex.v };
-				for (int i = 0; i < 4; i++)
-				{
-					v.bonesIDs[i] = vertex.bonesIDs[i];
-					v.boneWeights[i] = vertex.boneWeights[i];
-				}
-				vertices_Dynamic.push_back(v);
-			}
-			//load the indices
-			md.indexOffset = indices_Dynamic.size();
-			md.indexCount = gemmesh.indices.size();
-			for (auto& index : gemmesh.indices)
-			{
-				indices_Dynamic.push_back(index);
-			}
-			//load the materials
-			Material material;
-			for (auto& prop : gemmesh.material.properties) {
-
-				material.properties.push_back({ prop.name, prop.value });
-			}
-			materials.push_back(material);
-			md.textureFile = material.find("diffuse").filePath;
-			md.normalMapFile = material.find("normals").filePath;
-			//load Skeleton
-			loadSkeleton(GEManimation, animation);
-			//load Animation
-			loadAnimation(GEManimation, animation);
-		}
-		else
-		{
-			md.isDynamic = false;
-			//load the vertices
-			md.vertexOffset = vertices_Static.size();
-			md.vertexCount = gemmesh.verticesStatic.size();
-			Vertex_Static v;
-			for (auto& vertex : gemmesh.verticesStatic)
-			{
-				v = GEMStaticVertexToStaticVertex(vertex);
-				vertices_Static.push_back(v);
-			}
-			//load the indices
-			md.indexOffset = indices_Static.size();
-			md.indexCount = gemmesh.indices.size();
-			for (auto& index : gemmesh.indices)
-			{
-				indices_Static.push_back(index);
-			}
-			//load the materials
-			Material material;
-			for (auto& prop : gemmesh.material.properties) {
-
-				material.properties.push_back({ prop.name, prop.value });
-			}
-			materials.push_back(material);
-			md.textureFile = material.find("diffuse").filePath;
-			md.normalMapFile = material.find("normals").filePath;
-		}
-		objects[objectName] = md;
+		GEMLoader::GEMSpan<GEMLoader::GEMStaticVertex> verticesStatic = { gemmesh.verticesStatic.data(), gemmesh.verticesStatic.size() };
+		GEMLoader::GEMSpan<GEMLoader::GEMAnimatedVertex> verticesAnimated = { gemmesh.verticesAnimated.data(), gemmesh.verticesAnimated.size() };
+		GEMLoader::GEMSpan<unsigned int> indices = { gemmesh.indices.data(), gemmesh.indices.size() };
+		loadGEMMesh(gemmesh.material, verticesStatic, verticesAnimated, indices, GEManimation, animation, objectName);
 	}
+}
 
+void MeshManager::loadGEMMeshAndAnimation(std::vector<GEMLoader::GEMMappedMesh>& gemmeshes, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName)
+{
+	if (gemmeshes.size() > 1) {
+		std::runtime_error("The object has more than one mesh");
+	}
+	for (auto& gemmesh : gemmeshes)
+	{
+		loadGEMMesh(gemmesh.material, gemmesh.verticesStatic, gemmesh.verticesAnimated, gemmesh.indices, GEManimation, animation, objectName);
+	}
 }
 
 void MeshManager::loadSkeleton(GEMLoader::GEMAnimation& gemanimation, Animation& animation)
@@ -336,32 +647,31 @@ void MeshManager::loadSkeleton(GEMLoader::GEMAnimation& gemanimation, Animation&
 		gemanimation.globalInverse.m[4], gemanimation.globalInverse.m[5], gemanimation.globalInverse.m[6], gemanimation.globalInverse.m[7],
 		gemanimation.globalInverse.m[8], gemanimation.globalInverse.m[9], gemanimation.globalInverse.m[10], gemanimation.globalInverse.m[11],
 		gemanimation.globalInverse.m[12], gemanimation.globalInverse.m[13], gemanimation.globalInverse.m[14], gemanimation.globalInverse.m[15]);
-
+	animation.skeleton.combineOffsets();
 }
 
 void MeshManager::loadAnimation(GEMLoader::GEMAnimation& gemanimation, Animation& animation)
 {
+	int bones = static_cast<int>(gemanimation.bones.size());
 	for (auto& sequence : gemanimation.animations)
 	{
 		AnimationSequence seq;
 		seq.ticksPerSecond = sequence.ticksPerSecond;
+		seq.resize(static_cast<int>(sequence.frames.size()), bones);
 		//store all of the frames in the sequence
-		for (auto& frame : sequence.frames)
+		for (int f = 0; f < seq.frameCount; f++)
 		{
 			//store all of the bone transformation in the frame
-			AnimationFrame fr;
-			for (int i = 0; i < frame.positions.size(); i++)
+			GEMLoader::GEMAnimationFrame& frame = sequence.frames[f];
+			size_t offset = static_cast<size_t>(f) * seq.boneStride;
+			for (int i = 0; i < bones; i++)
 			{
-				DirectX::XMFLOAT3 position = { frame.positions[i].x,frame.positions[i].y,frame.positions[i].z };
-				DirectX::XMFLOAT4 rotation = { frame.rotations[i].q[0],frame.rotations[i].q[1],frame.rotations[i].q[2],frame.rotations[i].q[3] };
-				DirectX::XMFLOAT3 scale = { frame.scales[i].x,frame.scales[i].y,frame.scales[i].z };
-				fr.position.push_back(position);
-				fr.quaternion.push_back(rotation);
-				fr.scale.push_back(scale);
+				seq.positions[offset + i] = { frame.positions[i].x,frame.positions[i].y,frame.positions[i].z,0.0f };
+				seq.quaternions[offset + i] = { frame.rotations[i].q[0],frame.rotations[i].q[1],frame.rotations[i].q[2],frame.rotations[i].q[3] };
+				seq.scales[offset + i] = { frame.scales[i].x,frame.scales[i].y,frame.scales[i].z,0.0f };
 			}
-			seq.frames.push_back(fr);
 		}
-		animation.sequences[sequence.name] = seq;
+		animation.addSequence(sequence.name, seq);
 	}
 }
 void MeshManager::calculateW(float p1, float p2, float p3, float r1, float r2, float r3, float s1, float s2, float s3, InstanceData_General& instance)
@@ -376,21 +686,26 @@ void MeshManager::calculateW(float p1, float p2, float p3, float r1, float r2, f
 }
 void MeshManager::updateBonesVector(std::vector<DirectX::XMFLOAT4X4>& BonesTransforms,int index)
 {
-	for (int i = 0; i < BonesTransforms.size(); i++) {
-		for (int j = 0; j < 4; j++) {
-			for (int k = 0; k < 4; k++) {
-				bonesVector[4096*index+i * 16 + j * 4 + k] = BonesTransforms[i].m[j][k];
-			}
-		}
-	}
+	PROFILE_ZONE("updateBonesVector");
+	bonePalette.write(index, BonesTransforms);
 }
 
-void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager, Map& map)
+void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager, Map& map, JobSystem* jobSystem)
 {
+	PROFILE_ZONE("loadlevel");
+	//use the baked level if it is up to date with Input.txt and the files it references
+	LevelCache cache;
+	if (cache.load(filename, *this, objectManager, map))
+	{
+		NPC::animation.buildLODs();
+		if (NPC::animation.compressClips) NPC::animation.compressSequences();
+		if (packVertices) packVertexPools();
+		objectManager.buildSpatialIndex();
+		applyLevelOptions(filename, map);
+		return;
+	}
+
 	int materialIndex = 0;
-	GEMLoader::GEMModelLoader loader;
-	std::vector<GEMLoader::GEMMesh> gemmeshes;
-	GEMLoader::GEMAnimation gemanimation;
 
 	std::ifstream file(filename);
 	std::string line;
@@ -413,9 +728,17 @@ void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager,
 			md.isDynamic = false;
 			md.vertexOffset = vertices_Static.size();
 			md.indexOffset = indices_Static.size();
-			map.LoadHeightMap(tokens[1], vertices_Static, indices_Static);
+			map.LoadHeightMap(tokens[1], vertices_Static, indices_Static, jobSystem);
 			md.vertexCount = vertices_Static.size() - md.vertexOffset;
 			md.indexCount = indices_Static.size() - md.indexOffset;
+			//a terrain small enough moves its indices, chunk sets included, into the 16 bit pool
+			if (fitsShortIndices(indices_Static.data() + md.indexOffset, md.indexCount, 0))
+			{
+				int shortOffset = static_cast<int>(appendIndices(indices_Static.data() + md.indexOffset, md.indexCount, 0, indices_Static, indices16_Static, md.shortIndices));
+				indices_Static.resize(md.indexOffset);
+				map.terrainChunks.offsetIndices(shortOffset - md.indexOffset);
+				md.indexOffset = shortOffset;
+			}
 			md.textureFile = tokens[2];
 
 			//update instance
@@ -429,8 +752,9 @@ void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager,
 		}
 		else if (tokens[0] == "NPC")
 		{
-			loader.load(tokens[1], gemmeshes, gemanimation);
-			loadGEMMeshAndAnimation(gemmeshes, gemanimation, NPC::animation, "NPC");
+			GEMLoader::GEMMappedModel model;
+			model.open(tokens[1]);
+			loadGEMMeshAndAnimation(model.meshes, model.animation, NPC::animation, "NPC");
 			objects["NPC"].instanceOffset = instances.size();
 			for (int i = 2; i < tokens.size(); i=i+10)
 			{
@@ -447,6 +771,7 @@ void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager,
 				InstanceData_General instance;
 				calculateW(npc.position.x, npc.position.y, npc.position.z, npc.rotation.x, npc.rotation.y, npc.rotation.z, npc.scale.x, npc.scale.y, npc.scale.z, instance);
 				instance.MaterialIndex = materialIndex;
+				instance.BoneOffset = bonePalette.offsets[bonePalette.allocate(static_cast<int>(NPC::animation.skeleton.bones.size()))];
 				instances.push_back(instance);
 
 				npc.animationInstance.update(tokens[i + 9], 0.0f);
@@ -458,8 +783,9 @@ void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager,
 		{
 			Animation animation;
 
-			loader.load(tokens[1], gemmeshes);
-			loadGEMMeshAndAnimation(gemmeshes, gemanimation, animation, "Static");
+			GEMLoader::GEMMappedModel model;
+			model.open(tokens[1]);
+			loadGEMMeshAndAnimation(model.meshes, model.animation, animation, "Static");
 			objects["Static"].instanceOffset = instances.size();
 			for (int i = 2; i < tokens.size(); i=i+9)
 			{
@@ -484,5 +810,74 @@ void MeshManager::loadlevel(std::string& filename, ObjectManager &objectManager,
 
 		}
 	}
+	//the cache keeps the raw clips, so compression happens after saving on both paths
+	cache.save(filename, *this, objectManager, map);
+	NPC::animation.buildLODs();
+	if (NPC::animation.compressClips) NPC::animation.compressSequences();
+	//the cache keeps the float vertices too, packing is cheap enough to redo on every load
+	if (packVertices) packVertexPools();
+	objectManager.buildSpatialIndex();
+	applyLevelOptions(filename, map);
+}
+
+void MeshManager::applyLevelOptions(const std::string& filename, Map& map)
+{
+	options = LevelOptions();
+	std::ifstream file(filename);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::stringstream ss(line);
+		std::string name;
+		std::string value;
+		if (!std::getline(ss, name, ',') || !std::getline(ss, value, ',')) continue;
+		if (name == "TerrainTiles") options.terrainTiles = value;
+		else if (name == "BakedAnimation") options.bakedAnimation = std::stoi(value) != 0;
+	}
+	//a tile file that cannot be opened leaves the level on its own height map
+	if (!options.terrainTiles.empty()) map.OpenTerrainTiles(options.terrainTiles);
+}
+
+void MeshManager::packVertexPools()
+{
+	PROFILE_ZONE("packVertexPools");
+	//every mesh gets its own bounds, its instances carry them to the vertex shader
+	std::vector<Vertex_StaticPacked> packedStatic(vertices_Static.size());
+	std::vector<Vertex_DynamicPacked> packedDynamic(vertices_Dynamic.size());
+	bool dynamicFits = true;
+	for (auto& pair : objects)
+	{
+		MeshDescriptor& md = pair.second;
+		if (md.isDynamic)
+		{
+			const Vertex_Dynamic* vertices = vertices_Dynamic.data() + md.vertexOffset;
+			md.quantization = computePositionQuantization(vertices, md.vertexCount);
+			dynamicFits = ::packVertices(vertices, md.vertexCount, md.quantization, packedDynamic.data() + md.vertexOffset) && dynamicFits;
+		}
+		else
+		{
+			const Vertex_Static* vertices = vertices_Static.data() + md.vertexOffset;
+			md.quantization = computePositionQuantization(vertices, md.vertexCount);
+			::packVertices(vertices, md.vertexCount, md.quantization, packedStatic.data() + md.vertexOffset);
+		}
+	}
+
+	verticesPacked_Static.swap(packedStatic);
+	std::vector<Vertex_Static>().swap(vertices_Static);
+	if (dynamicFits)
+	{
+		verticesPacked_Dynamic.swap(packedDynamic);
+		std::vector<Vertex_Dynamic>().swap(vertices_Dynamic);
+	}
+	for (auto& pair : objects)
+	{
+		const MeshDescriptor& md = pair.second;
+		if (md.isDynamic && !dynamicFits) continue;
+		for (int i = md.instanceOffset; i < md.instanceOffset + md.instanceCount; i++)
+		{
+			instances[i].PositionScale = md.quantization.scale;
+			instances[i].PositionOffset = md.quantization.offset;
+		}
+	}
 }
 
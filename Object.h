@@ -1,13 +1,23 @@
 #pragma once
 #include <map>
-#include"Window.h"
 #include"Map.h"
-#include"vertex.h"
+#include"Vertex.h"
 #include"GEMLoader.h"
+#include"GEMMappedLoader.h"
+#include"BonePalette.h"
+#include"SpatialHash.h"
+#include"SweepAndPrune.h"
+#include"CollisionWorld.h"
+#include"PoseCache.h"
+#include"BakedAnimation.h"
+#include"ClipCompression.h"
+#include"VertexPacking.h"
+#include"MeshIndices.h"
 
 class Map;
-class Window;
 class ObjectManager;
+class MeshManager;
+class JobSystem;
 
 struct Bone
 {
@@ -19,22 +29,32 @@ struct Skeleton
 {
 	std::vector<Bone> bones;
 	DirectX::XMMATRIX globalInverse = DirectX::XMMatrixIdentity();
-
-};
-struct AnimationFrame {
-	//std::vector<DirectX::XMFLOAT4X4> boneTransforms;
-	std::vector<DirectX::XMFLOAT3> position;
-	std::vector<DirectX::XMFLOAT4> quaternion;
-	std::vector<DirectX::XMFLOAT3> scale;
+	//bindingOffset * globalInverse of every bone, so the final transform is one product per bone
+	//call combineOffsets after the bones or globalInverse change
+	std::vector<DirectX::XMMATRIX> finalOffsets;
+	void combineOffsets();
 };
-
+//structure-of-arrays clip layout
+//each channel is one contiguous 16-byte aligned array indexed [frame * boneStride + bone],
+//boneStride is the bone count rounded up to a multiple of 4 so the sampler can always work on four bones at a time
 class AnimationSequence {
 private:
-	DirectX::XMFLOAT3 interpolateFloat3(DirectX::XMFLOAT3& p0, DirectX::XMFLOAT3& p1, float interpolationFact);
-	DirectX::XMFLOAT4 interpolateQuaternion(DirectX::XMFLOAT4& q0, DirectX::XMFLOAT4& q1, float interpolationFact);
+	void sampleBlock(int frame1, int frame2, int bone, DirectX::XMVECTOR interpolationFact, DirectX::XMVECTOR position[4], DirectX::XMVECTOR quaternion[4], DirectX::XMVECTOR scale[4]);
 public:
-	std::vector<AnimationFrame> frames;
+	int frameCount = 0;
+	int boneCount = 0;
+	int boneStride = 0;
+	std::vector<DirectX::XMFLOAT4A> positions;
+	std::vector<DirectX::XMFLOAT4A> quaternions;
+	std::vector<DirectX::XMFLOAT4A> scales;
 	float ticksPerSecond = 0.f;
+	//when not empty it replaces the three channels above, which compress releases
+	CompressedClip compressed;
+
+	//allocate the channels, padding bones get the identity transform
+	void resize(int frames, int bones);
+	void compress(const ClipCompressionSettings& settings);
+	size_t sizeInBytes() const;
 
 	float getDuration();
 
@@ -42,16 +62,53 @@ public:
 
 	int getNextFrame(int frame, bool death);
 
-	DirectX::XMMATRIX interpolateBonesToGlobal(std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, Skeleton& skeleton, int boneIndex, bool death);
+	//evaluate the global transform of every bone in one pass, parents must come before their children
+	//a non-empty boneSource skips every bone that is not its own source
+	void interpolateBonesToGlobal(std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, const Skeleton& skeleton, bool death, const std::vector<int>& boneSource);
+};
+//one animation LOD level, used from distance on
+struct AnimationLOD {
+	float distance = 0.0f;
+	//evaluate the pose every updateInterval ticks, the ticks in between keep the last pose
+	int updateInterval = 1;
+	//share of the bones evaluated, the ones with the deepest subtrees are kept
+	float boneFraction = 1.0f;
+	//filled by Animation::buildLODs, the bone whose final transform each bone takes; empty when every bone is evaluated
+	//a skipped bone follows its nearest evaluated ancestor rigidly, as if it stayed in its bind pose relative to it
+	std::vector<int> boneSource;
 };
 class Animation {
 public:
-	std::map<std::string, AnimationSequence> sequences;
+	//clips are addressed by integer handles resolved at load time, the per-frame path never touches names
+	std::vector<AnimationSequence> sequences;
+	std::vector<std::string> sequenceNames;
+	std::map<std::string, int> sequenceHandles;
+	//handle of the clip that plays once and holds its last frame, -1 if there is none
+	int deathSequence = -1;
 	Skeleton skeleton;
+	//compressClips decides whether loadlevel compresses the sequences, with these error bounds
+	bool compressClips = true;
+	ClipCompressionSettings compression;
+	//sorted by distance, the first level starts at 0
+	std::vector<AnimationLOD> lodLevels = {
+		{ 0.0f, 1, 1.0f, {} },
+		{ 200.0f, 2, 1.0f, {} },
+		{ 500.0f, 4, 0.6f, {} },
+		{ 1000.0f, 8, 0.35f, {} },
+	};
+
+	//name-to-handle lookup for gameplay code, -1 if the clip does not exist
+	int findSequence(const std::string& name);
+	int addSequence(const std::string& name, const AnimationSequence& sequence);
+
+	//pick the bones of every LOD level, call after the skeleton is loaded or lodLevels changed
+	void buildLODs();
+	void compressSequences();
+	int selectLOD(float distance);
 
-	void calcFrame(std::string sequenceName, float time, int& frame, float& interpolationFact);
-	DirectX::XMMATRIX interpolateBonesToGlobal(std::string name, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, int boneIndex,bool death);
-	void calcFinalTransformations(std::vector<DirectX::XMFLOAT4X4>& transform);
+	void calcFrame(int sequence, float time, int& frame, float& interpolationFact);
+	void interpolateBonesToGlobal(int sequence, std::vector<DirectX::XMFLOAT4X4>& boneTransforms, int baseFrame, float interpolationFact, bool death, const std::vector<int>& boneSource);
+	void calcFinalTransformations(std::vector<DirectX::XMFLOAT4X4>& transform, const std::vector<int>& boneSource);
 };
 
 class AnimationInstance {
@@ -59,13 +116,26 @@ public:
 	Animation* animation = nullptr;
 	float time = 0;
 	bool deathAnimationFinished = false;
-	std::string sequenceName;
+	int sequence = -1;
+	//set by update when BonesTransforms was recomputed, a finished death pose stays unchanged
+	bool poseChanged = false;
 	std::vector<DirectX::XMFLOAT4X4> BonesTransforms;
+	//animation LOD level and the tick slot this instance evaluates in, see setLOD
+	int lod = 0;
+	int updatePhase = 0;
+	int updateTick = 0;
+	//a tick was skipped since the last evaluation
+	bool poseStale = false;
+	//poses shared with the other instances of the same Animation this tick, none if null
+	PoseCache* poseCache = nullptr;
 
 	AnimationInstance() :BonesTransforms(256) {}
 	//void resetAnimationTime();
 	bool animationFinished();
-	void update(std::string name, float deltaTime);
+	//call before update, instances with different phases spread their evaluations over the ticks of an interval
+	void setLOD(int level, int phase);
+	void update(int sequenceHandle, float deltaTime);
+	void update(const std::string& name, float deltaTime);
 };
 struct MaterialProperty {
 	std::string name;
@@ -91,14 +161,20 @@ struct MeshDescriptor {
 	int vertexOffset = 0;
 	int vertexCount = 0;
 
+	//indices are relative to vertexOffset, indexOffset points into the 16 bit pool of the mesh's kind when shortIndices is set
+	//and into the 32 bit pool otherwise
 	int indexOffset = 0;
 	int indexCount = 0;
+	bool shortIndices = false;
 
 	int instanceOffset = 0;
 	int instanceCount = 0;
 
 	std::string textureFile;
 	std::string normalMapFile;
+
+	//range of the mesh's packed positions, set by MeshManager::packVertexPools
+	PositionQuantization quantization;
 };
 class Object {
 public:
@@ -142,13 +218,20 @@ public:
 
 	void updateCamera(float dx, float dy);
 
-	void move(Window & window, float deltaTime,Map&map, ObjectManager& objectManager);
+	//keys is indexed by virtual key code like Window::keys
+	void move(const bool* keys, float deltaTime,Map&map, ObjectManager& objectManager);
 };
 
 class NPC : public Character {
 public:
 	static Animation animation;
 	static Skeleton skeleton;
+	//call beginTick once per tick before the NPCs update
+	static PoseCache poseCache;
+	//animation baked from NPC::animation, empty unless the baked mode baked it
+	static BakedAnimation bakedAnimation;
+	//the NPC's animation in the baked mode, animationInstance is not used there
+	BakedClipState bakedState;
 	NPC();
 };
 
@@ -156,18 +239,54 @@ class ObjectManager {
 public:
 	std::vector<NPC> npcs;
 	std::vector<Object> objects;
+
+	//XZ indices of objects and npcs by their position in the vectors above
+	//call updateObject/updateNPC after moving one, buildSpatialIndex after replacing the vectors
+	//updateObject also keeps collisionWorld in sync
+	SpatialHash objectGrid;
+	SpatialHash npcGrid;
+	//vectorized player-vs-object tests over the same objects
+	CollisionWorld collisionWorld;
+
+	void buildSpatialIndex();
+	void updateObject(int index);
+	void updateNPC(int index);
+
+	//1 for the NPCs in the npcGrid cells around the player's box, only they can touch it this tick
+	std::vector<char> nearPlayer;
+	void findNPCsNearPlayer(Player& player);
+	//one tick of every NPC: LOD by distance to the player, death on touching it, the pose and its bone palette rows
+	//refreshes nearPlayer and begins the pose cache's tick, each job only touches its own NPCs and their palette ranges
+	void updateNPCs(Player& player, float deltaTime, MeshManager& meshManager, JobSystem& jobSystem);
+
+	//NPC-NPC and NPC-object overlaps, ids below npcs.size() are NPCs and the rest are objects offset by npcs.size()
+	SweepAndPrune broadPhase;
+	//refresh every box and return this tick's overlapping pairs
+	//NPCs do not move and nothing reacts to overlaps yet, so the frame loop does not call it, sim_bench and the tests do
+	const std::vector<SweepAndPrune::Pair>& updateBroadPhase();
+};
+
+//settings a level file gives on lines of their own, which loadlevel applies on the parsed and the cached load alike
+//TerrainTiles,<file> streams height queries from a tile file of the same world, see Map::OpenTerrainTiles
+//BakedAnimation,1 skins the NPCs from poses baked at load instead of evaluating them every frame, for very large herds
+struct LevelOptions {
+	std::string terrainTiles;
+	bool bakedAnimation = false;
 };
 
 class MeshManager {
 private:
 
-	Vertex_Static GEMStaticVertexToStaticVertex(const GEMLoader::GEMStaticVertex& gemVertices);
+	void loadGEMMesh(GEMLoader::GEMMaterial& gemmaterial, GEMLoader::GEMSpan<GEMLoader::GEMStaticVertex> verticesStatic, GEMLoader::GEMSpan<GEMLoader::GEMAnimatedVertex> verticesAnimated, GEMLoader::GEMSpan<unsigned int> gemindices, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName);
 
 	void loadGEMMeshAndAnimation(std::vector<GEMLoader::GEMMesh>& gemmeshes, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName);
+	void loadGEMMeshAndAnimation(std::vector<GEMLoader::GEMMappedMesh>& gemmeshes, GEMLoader::GEMAnimation& GEManimation, Animation& animation, std::string objectName);
 	void loadSkeleton(GEMLoader::GEMAnimation& gemanimation, Animation& animation);
 	void loadAnimation(GEMLoader::GEMAnimation& gemanimation, Animation& animation);
 
 	void calculateW(float p1, float p2, float p3, float r1, float r2, float r3, float s1, float s2, float s3, InstanceData_General& instance);
+	//fill options from the level's option lines and apply them to the loaded level
+	void applyLevelOptions(const std::string& filename, Map& map);
 public:
 	//type name{Terrain,NPC,Static}
 	std::map<std::string, MeshDescriptor> objects;
@@ -183,7 +302,7 @@ public:
 		{DirectX::XMFLOAT3(1.0f, -1.0f, 1.0f)},
 		{DirectX::XMFLOAT3(-1.0f, -1.0f, 1.0f)}
 	};
-	std::vector<unsigned int> indices_Skybox = {
+	std::vector<uint16_t> indices_Skybox = {
 		//front
 		0,1,2,0,2,3,
 		//back
@@ -204,14 +323,29 @@ public:
 	std::vector<Vertex_Dynamic> vertices_Dynamic;
 	std::vector<unsigned int> indices_Dynamic;
 
-	std::vector<float> bonesVector = std::vector<float>(256 * 16 * 10);
+	//indices of the meshes that fit in 16 bits, see MeshIndices.h
+	std::vector<uint16_t> indices16_Static;
+	std::vector<uint16_t> indices16_Dynamic;
+
+	//loadlevel encodes the vertex pools into Vertex_StaticPacked and Vertex_DynamicPacked when packVertices is set,
+	//a pool that was packed is emptied and the renderer draws from its packed copy instead
+	//a dynamic pool whose bone indices do not fit in 8 bits stays in floats
+	bool packVertices = false;
+	std::vector<Vertex_StaticPacked> verticesPacked_Static;
+	std::vector<Vertex_DynamicPacked> verticesPacked_Dynamic;
+	void packVertexPools();
+
+	//skinning matrices of every NPC, indexed by the NPC's position in ObjectManager::npcs
+	BonePalette bonePalette;
 
 	std::vector<InstanceData_General> instances;
 	std::vector<Material> materials;
 
 	void updateBonesVector(std::vector<DirectX::XMFLOAT4X4>& BonesTransforms, int index);
 
-	void loadlevel(std::string& filename, ObjectManager& npcManager, Map& map);
+	LevelOptions options;
+
+	void loadlevel(std::string& filename, ObjectManager& npcManager, Map& map, JobSystem* jobSystem = nullptr);
 
 
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "PoseCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+size_t PoseCache::KeyHash::operator()(const Key& key) const
+{
+	uint32_t fact;
+	std::memcpy(&fact, &key.interpolationFact, sizeof(fact));
+	uint64_t h = static_cast<uint32_t>(key.sequence);
+	h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.frame);
+	h = h * 0x9E3779B97F4A7C15ull + fact;
+	h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.boneSet);
+	return static_cast<size_t>(h ^ (h >> 32));
+}
+
+void PoseCache::beginTick()
+{
+	entries.clear();
+	used = 0;
+}
+
+void PoseCache::resetCounters()
+{
+	hits = 0;
+	misses = 0;
+}
+
+float PoseCache::quantize(float time) const
+{
+	if (timeQuantum <= 0.0f) return time;
+	return std::floor(time / timeQuantum) * timeQuantum;
+}
+
+bool PoseCache::find(const Key& key, std::vector<DirectX::XMFLOAT4X4>& pose, int boneCount)
+{
+	const std::vector<DirectX::XMFLOAT4X4>* cached = nullptr;
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto it = entries.find(key);
+		if (it != entries.end()) cached = it->second;
+	}
+	if (!cached)
+	{
+		misses++;
+		return false;
+	}
+	//entries are not changed until the next beginTick, so the copy needs no lock
+	std::copy(cached->begin(), cached->begin() + std::min(boneCount, static_cast<int>(cached->size())), pose.begin());
+	hits++;
+	return true;
+}
+
+void PoseCache::insert(const Key& key, const std::vector<DirectX::XMFLOAT4X4>& pose, int boneCount)
+{
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	//another thread may have computed the same pose meanwhile, keep the first
+	if (entries.count(key)) return;
+	if (used == pool.size())
+	{
+		pool.push_back(std::make_unique<std::vector<DirectX::XMFLOAT4X4>>());
+	}
+	std::vector<DirectX::XMFLOAT4X4>& entry = *pool[used++];
+	entry.assign(pose.begin(), pose.begin() + boneCount);
+	entries[key] = &entry;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <DirectXMath.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+//finished poses of one Animation for the current tick, keyed by what the pose depends on:
+//clip, sampled frame, interpolation factor and LOD bone set
+//instances playing the same clip at the same time copy the pose the first of them computed
+//timeQuantum snaps the sampled time to a grid so instances with nearly the same phase share too, 0 samples exactly
+//lookups and inserts may come from several threads, beginTick must not run alongside them
+class PoseCache {
+public:
+	struct Key {
+		int sequence = -1;
+		int frame = 0;
+		float interpolationFact = 0.0f;
+		//-1 for every bone, otherwise the LOD level whose bone set was evaluated
+		int boneSet = -1;
+		bool operator==(const Key& other) const
+		{
+			return sequence == other.sequence && frame == other.frame && interpolationFact == other.interpolationFact && boneSet == other.boneSet;
+		}
+	};
+private:
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	std::shared_mutex mutex;
+	std::unordered_map<Key, const std::vector<DirectX::XMFLOAT4X4>*, KeyHash> entries;
+	//pose storage reused from tick to tick, the first used entries hold this tick's poses
+	std::vector<std::unique_ptr<std::vector<DirectX::XMFLOAT4X4>>> pool;
+	size_t used = 0;
+public:
+	float timeQuantum = 0.0f;
+	std::atomic<uint64_t> hits{ 0 };
+	std::atomic<uint64_t> misses{ 0 };
+
+	//forget the previous tick's poses, the counters keep running
+	void beginTick();
+	void resetCounters();
+
+	float quantize(float time) const;
+	//copy the first boneCount matrices of a cached pose, false on a miss
+	bool find(const Key& key, std::vector<DirectX::XMFLOAT4X4>& pose, int boneCount);
+	void insert(const Key& key, const std::vector<DirectX::XMFLOAT4X4>& pose, int boneCount);
+};
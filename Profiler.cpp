@@ -0,0 +1,137 @@
+#include "Profiler.h"
+
+#if PROFILER_ENABLED
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Profiler
+{
+	namespace
+	{
+		struct Zone
+		{
+			const char* name;
+			uint64_t start;
+			uint64_t end;
+		};
+
+		//written only by its thread, read by the exporter
+		struct ThreadBuffer
+		{
+			std::vector<Zone> zones;
+			std::atomic<uint64_t> written{ 0 };
+			int id = 0;
+			std::string name;
+		};
+
+		//buffers stay alive after their thread exits so its zones can still be exported
+		std::mutex registryMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> registry;
+		thread_local ThreadBuffer* current = nullptr;
+
+		ThreadBuffer* threadBuffer()
+		{
+			if (!current)
+			{
+				auto buffer = std::make_unique<ThreadBuffer>();
+				buffer->zones.resize(ringSize);
+				std::lock_guard<std::mutex> lock(registryMutex);
+				buffer->id = static_cast<int>(registry.size());
+				buffer->name = "thread " + std::to_string(buffer->id);
+				current = buffer.get();
+				registry.push_back(std::move(buffer));
+			}
+			return current;
+		}
+
+		void writeEscaped(std::ofstream& file, const std::string& text)
+		{
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\') file << '\\';
+				file << c;
+			}
+		}
+	}
+
+	uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	void record(const char* name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer* buffer = threadBuffer();
+		uint64_t n = buffer->written.load(std::memory_order_relaxed);
+		buffer->zones[n & (ringSize - 1)] = { name, start, end };
+		buffer->written.store(n + 1, std::memory_order_release);
+	}
+
+	void setThreadName(const char* name)
+	{
+		ThreadBuffer* buffer = threadBuffer();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->name = name;
+	}
+
+	bool exportChromeTrace(const std::string& filename)
+	{
+		std::ofstream file(filename);
+		if (!file) return false;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		//timestamps are written relative to the oldest zone still held
+		uint64_t origin = UINT64_MAX;
+		for (auto& buffer : registry)
+		{
+			uint64_t written = buffer->written.load(std::memory_order_acquire);
+			uint64_t first = written > static_cast<uint64_t>(ringSize) ? written - ringSize : 0;
+			for (uint64_t i = first; i < written; i++)
+			{
+				origin = std::min(origin, buffer->zones[i & (ringSize - 1)].start);
+			}
+		}
+
+		//trace event timestamps are microseconds, three decimals keep the nanoseconds
+		file << "{\"traceEvents\":[\n";
+		file.setf(std::ios::fixed);
+		file.precision(3);
+		bool comma = false;
+		for (auto& buffer : registry)
+		{
+			file << (comma ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"";
+			writeEscaped(file, buffer->name);
+			file << "\"}}";
+			comma = true;
+
+			uint64_t written = buffer->written.load(std::memory_order_acquire);
+			uint64_t first = written > static_cast<uint64_t>(ringSize) ? written - ringSize : 0;
+			for (uint64_t i = first; i < written; i++)
+			{
+				const Zone& zone = buffer->zones[i & (ringSize - 1)];
+				file << ",\n{\"name\":\"";
+				writeEscaped(file, zone.name);
+				file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->id
+					<< ",\"ts\":" << (zone.start - origin) / 1000.0
+					<< ",\"dur\":" << (zone.end - zone.start) / 1000.0 << "}";
+			}
+		}
+		file << "\n]}\n";
+		return static_cast<bool>(file);
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (auto& buffer : registry)
+		{
+			buffer->written.store(0, std::memory_order_release);
+		}
+	}
+}
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+//frame profiler
+//PROFILE_ZONE("name") times the rest of the enclosing scope and records it in a ring buffer owned by the calling thread,
+//so recording never takes a lock; the newest zones of every thread can be written out as a Chrome trace
+//(chrome://tracing or ui.perfetto.dev)
+//on in debug builds, or in any build that defines GAME_PROFILER; otherwise every macro expands to nothing
+#if !defined(NDEBUG) || defined(GAME_PROFILER)
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+
+#if PROFILER_ENABLED
+#include <cstdint>
+#include <string>
+
+namespace Profiler
+{
+	//zones kept per thread, older ones are overwritten
+	const int ringSize = 1 << 16;
+
+	//nanoseconds on a monotonic clock
+	uint64_t now();
+	void record(const char* name, uint64_t start, uint64_t end);
+	//label the calling thread in the trace
+	void setThreadName(const char* name);
+	//write the recorded zones as Chrome trace JSON, call it while no other thread is recording
+	bool exportChromeTrace(const std::string& filename);
+	void clear();
+
+	//name must outlive the export, string literals are the intended use
+	class ScopedZone {
+	private:
+		const char* name;
+		uint64_t start;
+	public:
+		ScopedZone(const char* name) : name(name), start(now()) {}
+		~ScopedZone() { record(name, start, now()); }
+		ScopedZone(const ScopedZone&) = delete;
+		ScopedZone& operator=(const ScopedZone&) = delete;
+	};
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) Profiler::ScopedZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) Profiler::setThreadName(name)
+#define PROFILE_EXPORT(filename) Profiler::exportChromeTrace(filename)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#define PROFILE_EXPORT(filename) ((void)0)
+#endif
@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "Profiler.h"
 #include <d3dcompiler.h>
 #include <vector>
 
@@ -101,10 +102,13 @@ void Renderer::InitializeRenderTarget(Window& window)
 
 void Renderer::InitializeShadersAndConstantBuffer()
 {
+	//the vertex shaders of a packed pool read the packed inputs
+	const D3D_SHADER_MACRO packedMacros[] = { { "PACKED_VERTICES", "1" }, { nullptr, nullptr } };
+
 	//-----------static shaders----------------//
 	//compile vertex shader and store it in vsBlob,then create vertex shader
 	Microsoft::WRL::ComPtr<ID3DBlob> vsBlob_S;
-	HRESULT hr = D3DCompileFromFile(L"VertexShader_Static.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob_S.GetAddressOf(), nullptr);
+	HRESULT hr = D3DCompileFromFile(L"VertexShader_Static.hlsl", packedStatic ? packedMacros : nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob_S.GetAddressOf(), nullptr);
 	if (FAILED(hr)) {
 		MessageBox(NULL, L"Failed to compile VertexShader_Static.hlsl", L"Shader Error", MB_OK);
 	}
@@ -117,7 +121,19 @@ void Renderer::InitializeShadersAndConstantBuffer()
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
-	device->CreateInputLayout(layout_S, _countof(layout_S), vsBlob_S->GetBufferPointer(), vsBlob_S->GetBufferSize(), &inputLayout_Static);
+	//Vertex_StaticPacked
+	D3D11_INPUT_ELEMENT_DESC layoutPacked_S[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R8G8_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R8G8_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+	if (packedStatic) {
+		device->CreateInputLayout(layoutPacked_S, _countof(layoutPacked_S), vsBlob_S->GetBufferPointer(), vsBlob_S->GetBufferSize(), &inputLayout_Static);
+	}
+	else {
+		device->CreateInputLayout(layout_S, _countof(layout_S), vsBlob_S->GetBufferPointer(), vsBlob_S->GetBufferSize(), &inputLayout_Static);
+	}
 
 	//compile pixel shader and store it in psBlob,then create pixel shader
 	Microsoft::WRL::ComPtr<ID3DBlob> psBlob;
@@ -130,7 +146,7 @@ void Renderer::InitializeShadersAndConstantBuffer()
 	//-----------dynamic shaders----------------//
 	//compile vertex shader and store it in vsBlob,then create vertex shader
 	Microsoft::WRL::ComPtr<ID3DBlob> vsBlob_D;
-	hr=D3DCompileFromFile(L"VertexShader_Dynamic.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob_D.GetAddressOf(), nullptr);
+	hr=D3DCompileFromFile(L"VertexShader_Dynamic.hlsl", packedDynamic ? packedMacros : nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob_D.GetAddressOf(), nullptr);
 	if (FAILED(hr)) {
 		MessageBox(NULL, L"Failed to compile VertexShader_Dynamic.hlsl", L"Shader Error", MB_OK);
 	}
@@ -145,7 +161,21 @@ void Renderer::InitializeShadersAndConstantBuffer()
 		{"BONEIDS",0,DXGI_FORMAT_R32G32B32A32_UINT,0,D3D11_APPEND_ALIGNED_ELEMENT,D3D11_INPUT_PER_VERTEX_DATA,0},
 		{"BONEWEIGHTS",0,DXGI_FORMAT_R32G32B32A32_FLOAT,0,D3D11_APPEND_ALIGNED_ELEMENT,D3D11_INPUT_PER_VERTEX_DATA,0}
 	};
-	device->CreateInputLayout(layout_D, _countof(layout_D), vsBlob_D->GetBufferPointer(), vsBlob_D->GetBufferSize(), &inputLayout_Dynamic);
+	//Vertex_DynamicPacked
+	D3D11_INPUT_ELEMENT_DESC layoutPacked_D[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R8G8_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R8G8_SNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{"BONEIDS",0,DXGI_FORMAT_R8G8B8A8_UINT,0,D3D11_APPEND_ALIGNED_ELEMENT,D3D11_INPUT_PER_VERTEX_DATA,0},
+		{"BONEWEIGHTS",0,DXGI_FORMAT_R8G8B8A8_UNORM,0,D3D11_APPEND_ALIGNED_ELEMENT,D3D11_INPUT_PER_VERTEX_DATA,0}
+	};
+	if (packedDynamic) {
+		device->CreateInputLayout(layoutPacked_D, _countof(layoutPacked_D), vsBlob_D->GetBufferPointer(), vsBlob_D->GetBufferSize(), &inputLayout_Dynamic);
+	}
+	else {
+		device->CreateInputLayout(layout_D, _countof(layout_D), vsBlob_D->GetBufferPointer(), vsBlob_D->GetBufferSize(), &inputLayout_Dynamic);
+	}
 
 	//create constant buffer
 	InitializeConstantBuffer(vsBlob_S, vsBlob_D, psBlob);
@@ -338,62 +368,85 @@ void Renderer::InitializeConstantBuffer(Microsoft::WRL::ComPtr<ID3DBlob> vsBlob_
 	}
 }
 
-void Renderer::initializeIndexAndVertexBuffer(std::vector<Vertex_Static>& vertices_Static, std::vector<unsigned int>& indices_Static, std::vector<Vertex_Dynamic>& vertices_dynamic, std::vector<unsigned int>& indices_dynamic)
+void Renderer::createIndexBuffer(const void* indices, size_t sizeInBytes, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer)
 {
-	//-------initialize the static buffer----------------//
-	int vertexSizeInBytes = sizeof(Vertex_Static);
-	size_t numVertics = vertices_Static.size();
-	UINT numIndics = static_cast<UINT>(indices_Static.size());
-	//indicesSize_Static = numIndics;
-	//create static index buffer
+	//an empty pool has no buffer, no mesh draws from it
+	if (sizeInBytes == 0) return;
 	D3D11_BUFFER_DESC bd = {};
 	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = static_cast<UINT>(sizeof(unsigned int) * numIndics);
+	bd.ByteWidth = static_cast<UINT>(sizeInBytes);
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	D3D11_SUBRESOURCE_DATA initData = {};
-	initData.pSysMem = indices_Static.data();
-	device->CreateBuffer(&bd, &initData, &indexBuffer_Static);
+	initData.pSysMem = indices;
+	HRESULT hr = device->CreateBuffer(&bd, &initData, buffer.GetAddressOf());
+	if (FAILED(hr)) {
+		MessageBox(NULL, L"Failed to create index buffer", L"Error", MB_OK);
+	}
+}
+
+void Renderer::initializeIndexAndVertexBuffer(MeshManager& meshmanager)
+{
+	//-------initialize the static buffer----------------//
+	size_t vertexSizeInBytes = stride_Static;
+	size_t numVertics = packedStatic ? meshmanager.verticesPacked_Static.size() : meshmanager.vertices_Static.size();
+	//create static index buffers, one per index size
+	createIndexBuffer(meshmanager.indices_Static.data(), sizeof(unsigned int) * meshmanager.indices_Static.size(), indexBuffer_Static);
+	createIndexBuffer(meshmanager.indices16_Static.data(), sizeof(uint16_t) * meshmanager.indices16_Static.size(), indexBuffer16_Static);
 
 	//create static vertex buffer
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DEFAULT;
 	bd.ByteWidth = static_cast<UINT>(vertexSizeInBytes * numVertics);
 	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	initData.pSysMem = vertices_Static.data();
+	D3D11_SUBRESOURCE_DATA initData = {};
+	initData.pSysMem = packedStatic ? static_cast<const void*>(meshmanager.verticesPacked_Static.data()) : meshmanager.vertices_Static.data();
 	device->CreateBuffer(&bd, &initData, &vertexBuffer_Static);
 
 
 	//-------initialize the dynamic buffer----------------//
-	vertexSizeInBytes = sizeof(Vertex_Dynamic);
-	numVertics = vertices_dynamic.size();
-	numIndics = static_cast<UINT>(indices_dynamic.size());
-	//indicesSize_Dynamic = numIndics;
-	//create dynamic index buffer
-	bd.ByteWidth = static_cast<UINT>(sizeof(unsigned int) * numIndics);
-	initData.pSysMem = indices_dynamic.data();
-	HRESULT hr=device->CreateBuffer(&bd, &initData, &indexBuffer_Dynamic);
-	if (FAILED(hr)) {
-		MessageBox(NULL, L"Failed to compile dynamic buffer.hlsl", L"Shader Error", MB_OK);
-	}
+	vertexSizeInBytes = stride_Dynamic;
+	numVertics = packedDynamic ? meshmanager.verticesPacked_Dynamic.size() : meshmanager.vertices_Dynamic.size();
+	//create dynamic index buffers
+	createIndexBuffer(meshmanager.indices_Dynamic.data(), sizeof(unsigned int) * meshmanager.indices_Dynamic.size(), indexBuffer_Dynamic);
+	createIndexBuffer(meshmanager.indices16_Dynamic.data(), sizeof(uint16_t) * meshmanager.indices16_Dynamic.size(), indexBuffer16_Dynamic);
 	//create dynamic vertex buffer
 	bd.ByteWidth = static_cast<UINT>(vertexSizeInBytes * numVertics);
-	initData.pSysMem = vertices_dynamic.data();
-	hr=device->CreateBuffer(&bd, &initData, &vertexBuffer_Dynamic);
+	initData.pSysMem = packedDynamic ? static_cast<const void*>(meshmanager.verticesPacked_Dynamic.data()) : meshmanager.vertices_Dynamic.data();
+	HRESULT hr=device->CreateBuffer(&bd, &initData, &vertexBuffer_Dynamic);
 	if (FAILED(hr)) {
 		MessageBox(NULL, L"Failed to create dynamic buffer", L"Shader Error", MB_OK);
 	}
 }
 
+void Renderer::setIndexBuffer(const MeshDescriptor& md)
+{
+	if (md.isDynamic) {
+		context->IASetIndexBuffer(md.shortIndices ? indexBuffer16_Dynamic.Get() : indexBuffer_Dynamic.Get(), md.shortIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+	}
+	else {
+		context->IASetIndexBuffer(md.shortIndices ? indexBuffer16_Static.Get() : indexBuffer_Static.Get(), md.shortIndices ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+	}
+}
+
 void Renderer::InitializeStructuredBuffer()
 {
-	//custom buffer size, you can change it
-	UINT bufferSize = 20;
+	//initial sizes, both buffers grow on demand
+	createInstanceBuffer(20);
+	createBonesBuffer(256 * 4 * 10);
+}
+
+void Renderer::createInstanceBuffer(UINT capacity)
+{
 	//initialize the instance buffer
 	D3D11_BUFFER_DESC id = {};
 	id.Usage = D3D11_USAGE_DYNAMIC;
 	id.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	id.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-	id.ByteWidth = sizeof(InstanceData_General) * bufferSize;
+	id.ByteWidth = sizeof(InstanceData_General) * capacity;
 	id.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	id.StructureByteStride = sizeof(InstanceData_General);
+	VSstructuredBuffer.Reset();
+	VSstructuredSRV.Reset();
 	device->CreateBuffer(&id, nullptr, &VSstructuredBuffer);
 
 	//create shader resource view for the instance buffer
@@ -401,35 +454,35 @@ void Renderer::InitializeStructuredBuffer()
 	srvd.Format = DXGI_FORMAT_UNKNOWN;
 	srvd.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
 	srvd.Buffer.FirstElement = 0;
-	srvd.Buffer.NumElements = bufferSize;
+	srvd.Buffer.NumElements = capacity;
 	device->CreateShaderResourceView(VSstructuredBuffer.Get(), &srvd, VSstructuredSRV.GetAddressOf());
+	instanceCapacity = capacity;
 
 	//bind the instance buffer to the vertex shader
 	context->VSSetShaderResources(0, 1, VSstructuredSRV.GetAddressOf());
+}
 
+void Renderer::createBonesBuffer(UINT capacity)
+{
+	//create buffer to store the bones data, capacity is counted in float4
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.ByteWidth = sizeof(float) * 4 * capacity;
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bonesBuffer.Reset();
+	bonesSRV.Reset();
+	device->CreateBuffer(&bd, nullptr, bonesBuffer.GetAddressOf());
+
+	//create shader resource view for the bones buffer
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvd = {};
+	srvd.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	srvd.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvd.Buffer.FirstElement = 0;
+	srvd.Buffer.NumElements = capacity;
+	device->CreateShaderResourceView(bonesBuffer.Get(), &srvd, bonesSRV.GetAddressOf());
+	bonesCapacity = capacity;
 
-	//create texture to store the bones data
-	D3D11_TEXTURE2D_DESC td = {};
-	td.Width = 256 * 4;
-	td.Height = 10;
-	td.MipLevels = 1;
-	td.ArraySize = 1;
-	td.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	td.SampleDesc.Count = 1;
-	td.SampleDesc.Quality = 0;
-	td.Usage = D3D11_USAGE_DYNAMIC;
-	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	td.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	device->CreateTexture2D(&td, nullptr, bonesTexture.GetAddressOf());
-
-	//create shader resource view for the bones texture
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvd2 = {};
-	srvd2.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	srvd2.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvd2.Texture2D.MostDetailedMip = 0;
-	srvd2.Texture2D.MipLevels = 1;
-	device->CreateShaderResourceView(bonesTexture.Get(), &srvd2, bonesSRV.GetAddressOf());
-	
 	//bind the bones data to the vertex shader
 	context->VSSetShaderResources(2, 1, bonesSRV.GetAddressOf());
 }
@@ -476,7 +529,7 @@ void Renderer::InitializeSampler()
 	context->PSSetSamplers(0, 1, sampler.GetAddressOf());
 }
 
-void Renderer::InitializeSkybox(std::vector<Vertex_Sky>& vertices_Sky, std::vector<unsigned int>& indices_Sky)
+void Renderer::InitializeSkybox(std::vector<Vertex_Sky>& vertices_Sky, std::vector<uint16_t>& indices_Sky)
 {
 	//create skybox vertex buffer
 	D3D11_BUFFER_DESC bd = {};
@@ -489,7 +542,7 @@ void Renderer::InitializeSkybox(std::vector<Vertex_Sky>& vertices_Sky, std::vect
 	device->CreateBuffer(&bd, &initData, skyVertexBuffer.GetAddressOf());
 
 	//create skybox index buffer
-	bd.ByteWidth = sizeof(unsigned int) * indices_Sky.size();
+	bd.ByteWidth = sizeof(uint16_t) * indices_Sky.size();
 	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	initData.pSysMem = indices_Sky.data();
 	device->CreateBuffer(&bd, &initData, skyIndexBuffer.GetAddressOf());
@@ -628,7 +681,8 @@ void Renderer::InitializeGBuffer(Window& window)
 	}
 
 	Microsoft::WRL::ComPtr<ID3DBlob> vsBlob;
-	D3DCompileFromFile(L"VertexShader_GBuffer.hlsl", nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob.GetAddressOf(), nullptr);
+	const D3D_SHADER_MACRO packedMacros[] = { { "PACKED_VERTICES", "1" }, { nullptr, nullptr } };
+	D3DCompileFromFile(L"VertexShader_GBuffer.hlsl", packedStatic ? packedMacros : nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "mainVS", "vs_5_0", 0, 0, vsBlob.GetAddressOf(), nullptr);
 	device->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), nullptr, gBufferVertexShader.GetAddressOf());
 
 
@@ -696,7 +750,7 @@ void Renderer::SwitchShader(int mode)
 		UINT stride = sizeof(Vertex_Sky);
 		UINT offset = 0;
 		context->IASetVertexBuffers(0, 1, skyVertexBuffer.GetAddressOf(), &stride, &offset);
-		context->IASetIndexBuffer(skyIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+		context->IASetIndexBuffer(skyIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
 	}
 	else if (mode==1) {
 		//set the input layout
@@ -704,11 +758,10 @@ void Renderer::SwitchShader(int mode)
 		//set the shaders
 		context->VSSetShader(vertexShader_Static.Get(), NULL, 0);
 		context->PSSetShader(pixelShader_General.Get(), NULL, 0);
-		//set the vertex and index buffer
-		UINT stride = sizeof(Vertex_Static);
+		//set the vertex buffer, the index buffer depends on the mesh
+		UINT stride = stride_Static;
 		UINT offset = 0;
 		context->IASetVertexBuffers(0, 1, vertexBuffer_Static.GetAddressOf(), &stride, &offset);
-		context->IASetIndexBuffer(indexBuffer_Static.Get(), DXGI_FORMAT_R32_UINT, 0);
 	}
 	else if(mode==2) {
 		//set the input layout
@@ -716,11 +769,10 @@ void Renderer::SwitchShader(int mode)
 		//set the shaders
 		context->VSSetShader(vertexShader_Dynamic.Get(), NULL, 0);
 		context->PSSetShader(pixelShader_General.Get(), NULL, 0);
-		//set the vertex and index buffer
-		UINT stride = sizeof(Vertex_Dynamic);
+		//set the vertex buffer, the index buffer depends on the mesh
+		UINT stride = stride_Dynamic;
 		UINT offset = 0;
 		context->IASetVertexBuffers(0, 1, vertexBuffer_Dynamic.GetAddressOf(), &stride, &offset);
-		context->IASetIndexBuffer(indexBuffer_Dynamic.Get(), DXGI_FORMAT_R32_UINT, 0);
 	}
 
 }
@@ -765,10 +817,9 @@ void Renderer::GeometryPass(MeshManager& meshManager)
 	context->VSSetShader(gBufferVertexShader.Get(), NULL, 0);
 	context->PSSetShader(gBufferPixelShader.Get(), NULL, 0);
 
-	UINT stride = sizeof(Vertex_Static);
+	UINT stride = stride_Static;
 	UINT offset = 0;
 	context->IASetVertexBuffers(0, 1, vertexBuffer_Static.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(indexBuffer_Static.Get(), DXGI_FORMAT_R32_UINT, 0);
 }
 
 void Renderer::LightPass()
@@ -844,47 +895,83 @@ void Renderer::updataLightingConstantBuffer(lightingConstants& lighting)
 
 void Renderer::updateInstanceBuffer(MeshManager& meshmanager,int mode)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	MeshDescriptor md;
 	if (mode == 0) {
-		context->Map(VSstructuredBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		MeshDescriptor md = meshmanager.objects["Terrain"];
-		memcpy(mappedResource.pData, &meshmanager.instances[md.instanceOffset], sizeof(InstanceData_General) * md.instanceCount);
-		context->Unmap(VSstructuredBuffer.Get(), 0);
+		md = meshmanager.objects["Terrain"];
 	}
 	else if (mode == 1) {
-		context->Map(VSstructuredBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		MeshDescriptor md = meshmanager.objects["Static"];
-		memcpy(mappedResource.pData, &meshmanager.instances[md.instanceOffset], sizeof(InstanceData_General) * md.instanceCount);
-		context->Unmap(VSstructuredBuffer.Get(), 0);
+		md = meshmanager.objects["Static"];
 	}
 	else {
-		context->Map(VSstructuredBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-		MeshDescriptor md = meshmanager.objects["NPC"];
-		memcpy(mappedResource.pData, &meshmanager.instances[md.instanceOffset], sizeof(InstanceData_General) * md.instanceCount);
-		context->Unmap(VSstructuredBuffer.Get(), 0);
+		md = meshmanager.objects["NPC"];
+	}
+	if (md.instanceCount == 0) return;
+	if (static_cast<UINT>(md.instanceCount) > instanceCapacity) {
+		createInstanceBuffer(std::max(static_cast<UINT>(md.instanceCount), instanceCapacity * 2));
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	context->Map(VSstructuredBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, &meshmanager.instances[md.instanceOffset], sizeof(InstanceData_General) * md.instanceCount);
+	context->Unmap(VSstructuredBuffer.Get(), 0);
+}
 
+void Renderer::setBakedAnimation(const BakedAnimation& baked)
+{
+	//three half4 texels per bone, the vertex shader sees the same float4 rows as from the live palette
+	D3D11_BUFFER_DESC bd = {};
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = static_cast<UINT>(baked.sizeInBytes());
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	D3D11_SUBRESOURCE_DATA initData = {};
+	initData.pSysMem = baked.data.data();
+	bakedBonesBuffer.Reset();
+	bakedBonesSRV.Reset();
+	HRESULT hr = device->CreateBuffer(&bd, &initData, bakedBonesBuffer.GetAddressOf());
+	if (FAILED(hr)) {
+		MessageBox(NULL, L"Failed to create baked animation buffer", L"Error", MB_OK);
+		return;
 	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvd = {};
+	srvd.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	srvd.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvd.Buffer.FirstElement = 0;
+	srvd.Buffer.NumElements = static_cast<UINT>(baked.data.size() / 4);
+	device->CreateShaderResourceView(bakedBonesBuffer.Get(), &srvd, bakedBonesSRV.GetAddressOf());
+	useBakedBones = true;
 }
 
 void Renderer::updataBonesBuffer(std::vector<float>& bonesVector)
 {
 	if (bonesVector.size())
 	{
+		UINT needed = static_cast<UINT>((bonesVector.size() + 3) / 4);
+		if (needed > bonesCapacity) {
+			createBonesBuffer(std::max(needed, bonesCapacity * 2));
+		}
 		D3D11_MAPPED_SUBRESOURCE mappedResource;
-		context->Map(bonesTexture.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		context->Map(bonesBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		//only the live part of the palette is uploaded
 		memcpy(mappedResource.pData, bonesVector.data(), sizeof(float) * bonesVector.size());
-		context->Unmap(bonesTexture.Get(), 0);
+		context->Unmap(bonesBuffer.Get(), 0);
 	}
 }
 
 
 void Renderer::Initialize(Window& window, MeshManager& meshmanager)
 {
+	//a pool loadlevel packed is only left in its packed copy
+	packedStatic = meshmanager.vertices_Static.empty() && !meshmanager.verticesPacked_Static.empty();
+	packedDynamic = meshmanager.vertices_Dynamic.empty() && !meshmanager.verticesPacked_Dynamic.empty();
+	stride_Static = packedStatic ? sizeof(Vertex_StaticPacked) : sizeof(Vertex_Static);
+	stride_Dynamic = packedDynamic ? sizeof(Vertex_DynamicPacked) : sizeof(Vertex_Dynamic);
+
 	InitializeDeviceAndContext(window);
 	InitializeRenderTarget(window);
 	InitializeShadersAndConstantBuffer();
 	InitializeSkybox(meshmanager.vertices_Skybox, meshmanager.indices_Skybox);
-	initializeIndexAndVertexBuffer(meshmanager.vertices_Static, meshmanager.indices_Static, meshmanager.vertices_Dynamic, meshmanager.indices_Dynamic);
+	initializeIndexAndVertexBuffer(meshmanager);
 	InitializeStructuredBuffer();
 	InitializeState();
 	InitializeSampler();
@@ -894,34 +981,56 @@ void Renderer::Initialize(Window& window, MeshManager& meshmanager)
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 }
 
-void Renderer::Render(MeshManager & meshManager)
+void Renderer::Render(MeshManager & meshManager, std::vector<TerrainDraw>& terrainDraws)
 {
+	PROFILE_ZONE("Renderer::Render");
 	cleanFrame();
 	updateConstantBufferManager();
 	
-	
-	GeometryPass(meshManager);
-	updateInstanceBuffer(meshManager, 1);
-	MeshDescriptor md = meshManager.objects["Static"];
-	context->DrawIndexedInstanced(md.indexCount, md.instanceCount, md.indexOffset, md.vertexOffset, 0);
-	LightPass();
-	context->Draw(3, 0);
-
+	//zones time the CPU side of each pass, the GPU runs it later
+	MeshDescriptor md;
+	{
+		PROFILE_ZONE("geometry pass");
+		GeometryPass(meshManager);
+		updateInstanceBuffer(meshManager, 1);
+		md = meshManager.objects["Static"];
+		setIndexBuffer(md);
+		context->DrawIndexedInstanced(md.indexCount, md.instanceCount, md.indexOffset, md.vertexOffset, 0);
+	}
+	{
+		PROFILE_ZONE("light pass");
+		LightPass();
+		context->Draw(3, 0);
+	}
 
-	SwitchShader(0);
-	context->OMSetDepthStencilState(skyDepthStencilState.Get(), 0);
-	context->DrawIndexed(static_cast<UINT>(meshManager.indices_Skybox.size()), 0,0);
-	context->OMSetDepthStencilState(depthStencilState.Get(), 0);
+	{
+		PROFILE_ZONE("sky pass");
+		SwitchShader(0);
+		context->OMSetDepthStencilState(skyDepthStencilState.Get(), 0);
+		context->DrawIndexed(static_cast<UINT>(meshManager.indices_Skybox.size()), 0,0);
+		context->OMSetDepthStencilState(depthStencilState.Get(), 0);
+	}
 
-	SwitchShader(1);
-	updateInstanceBuffer(meshManager, 0);
-	md = meshManager.objects["Terrain"];
-	context->DrawIndexedInstanced(md.indexCount, md.instanceCount, md.indexOffset, md.vertexOffset, 0);
+	{
+		PROFILE_ZONE("terrain pass");
+		SwitchShader(1);
+		updateInstanceBuffer(meshManager, 0);
+		md = meshManager.objects["Terrain"];
+		setIndexBuffer(md);
+		for (auto& draw : terrainDraws) {
+			context->DrawIndexedInstanced(draw.indexCount, md.instanceCount, draw.indexOffset, md.vertexOffset, 0);
+		}
+	}
 
-	SwitchShader(2);
-	updateInstanceBuffer(meshManager, 2);
-	md = meshManager.objects["NPC"];
-	context->DrawIndexedInstanced(md.indexCount, md.instanceCount, md.indexOffset, md.vertexOffset, 0);
+	{
+		PROFILE_ZONE("npc pass");
+		SwitchShader(2);
+		context->VSSetShaderResources(2, 1, useBakedBones ? bakedBonesSRV.GetAddressOf() : bonesSRV.GetAddressOf());
+		updateInstanceBuffer(meshManager, 2);
+		md = meshManager.objects["NPC"];
+		setIndexBuffer(md);
+		context->DrawIndexedInstanced(md.indexCount, md.instanceCount, md.indexOffset, md.vertexOffset, 0);
+	}
 	
 }
 
@@ -1,12 +1,15 @@
 #pragma once
 #include "Window.h"
 #include "Vertex.h"
+#include "TerrainChunks.h"
 #include <d3d11.h>
 #include <wrl.h>
 #include <d3d11shader.h>
 #include <map>
 #include "stb_image.h"
 
+class BakedAnimation;
+
 class Renderer {
 private:
 	
@@ -58,20 +61,33 @@ private:
 	//two shaders, one for static objects and the other for dynamic objects
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader_Static;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer_Static;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer16_Static;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer_Static;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout_Static;
 
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader_Dynamic;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer_Dynamic;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer16_Dynamic;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer_Dynamic;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout_Dynamic;
-	//used in transferring bone data to GPU
+	//whether each pool is drawn from MeshManager's packed vertices, decided in Initialize
+	bool packedStatic = false;
+	bool packedDynamic = false;
+	UINT stride_Static = sizeof(Vertex_Static);
+	UINT stride_Dynamic = sizeof(Vertex_Dynamic);
+	//used in transferring bone data to GPU, a typed buffer of float4 that is recreated when the palette outgrows it
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bonesSRV;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> bonesTexture;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> bonesBuffer;
+	UINT bonesCapacity = 0;
+	//the baked animation atlas, read through the same slot as halfs when useBakedBones is set
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bakedBonesSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> bakedBonesBuffer;
+	bool useBakedBones = false;
 
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader_General;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> VSstructuredSRV;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> VSstructuredBuffer;
+	UINT instanceCapacity = 0;
 
 	//used in transferring texture data to GPU
 	std::map<std::string, int> textureBindPoints;
@@ -108,15 +124,21 @@ private:
 	void InitializeRenderTarget(Window&window);
 	void InitializeShadersAndConstantBuffer();
 	void InitializeConstantBuffer(Microsoft::WRL::ComPtr<ID3DBlob> vsBlob_S, Microsoft::WRL::ComPtr<ID3DBlob> vsBlob_D, Microsoft::WRL::ComPtr<ID3DBlob> psBlob);
-	void initializeIndexAndVertexBuffer(std::vector<Vertex_Static> &vertices_Static,std::vector<unsigned int>& indices_Static, std::vector<Vertex_Dynamic> &vertices_dynamic, std::vector<unsigned int> &indices_dynamic);
+	void initializeIndexAndVertexBuffer(MeshManager& meshmanager);
+	void createIndexBuffer(const void* indices, size_t sizeInBytes, Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer);
 	void InitializeStructuredBuffer();
+	//(re)create the buffers with room for at least capacity elements and rebind them
+	void createInstanceBuffer(UINT capacity);
+	void createBonesBuffer(UINT capacity);
 	void InitializeState();
 	void InitializeSampler();
-	void InitializeSkybox(std::vector<Vertex_Sky>& vertices_Sky, std::vector<unsigned int>& indices_Sky);
+	void InitializeSkybox(std::vector<Vertex_Sky>& vertices_Sky, std::vector<uint16_t>& indices_Sky);
 	void InitializeGBuffer(Window & window);
 	void InitializeLightingBuffer();
 
 	void SwitchShader(int mode);
+	//bind the index buffer and format of the pool md's indices are in
+	void setIndexBuffer(const MeshDescriptor& md);
 	void updateConstantBufferManager();
 
 	void GeometryPass(MeshManager& meshManager);
@@ -133,8 +155,10 @@ public:
 	void updateInstanceBuffer(MeshManager &meshmanager, int mode);
 
 	void updataBonesBuffer(std::vector<float>& bonesVector);
-	//call every frame
-	void Render(MeshManager & meshManager);
+	//upload the atlas once and skin NPCs from it, their BoneOffset must then point at baked frames
+	void setBakedAnimation(const BakedAnimation& baked);
+	//call every frame, terrainDraws are the terrain chunks picked for this frame
+	void Render(MeshManager & meshManager, std::vector<TerrainDraw>& terrainDraws);
 
 	//call every frame
 	void cleanFrame();
@@ -5,8 +5,49 @@ struct VS_INSTANCE_GENERAL
 {
     float4x4 W;
     int MaterialIndex;
+    int BoneOffset;
+    float3 PositionScale;
+    float3 PositionOffset;
 };
 
+//the renderer defines PACKED_VERTICES when it draws Vertex_StaticPacked and Vertex_DynamicPacked
+#ifdef PACKED_VERTICES
+//positions arrive as unorm over the mesh bounds, normals and tangents as octahedral snorm pairs
+struct VS_INPUT_STATIC
+{
+    float4 position : POSITION;
+    float2 normal : NORMAL;
+    float2 tangent : TANGENT;
+    float2 TexCoords : TEXCOORD;
+    uint InstanceID : SV_InstanceID;
+};
+
+struct VS_INPUT_DYNAMIC{
+    float4 position : POSITION;
+    float2 normal : NORMAL;
+    float2 tangent : TANGENT;
+    float2 TexCoords : TEXCOORD;
+    uint4 BoneIDs : BONEIDS;
+    float4 BoneWeights : BONEWEIGHTS;
+    uint InstanceID : SV_InstanceID;
+};
+
+float4 decodePosition(float4 position, VS_INSTANCE_GENERAL instance)
+{
+    return float4(position.xyz * instance.PositionScale + instance.PositionOffset, 1.0f);
+}
+
+//same unfolding as unpackOctahedral
+float3 decodeDirection(float2 packed)
+{
+    float3 direction = float3(packed.x, 1.0f - abs(packed.x) - abs(packed.y), packed.y);
+    if (direction.y < 0.0f)
+    {
+        direction.xz = (1.0f - abs(direction.zx)) * (direction.xz >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(direction);
+}
+#else
 struct VS_INPUT_STATIC
 {
     float4 position : POSITION;
@@ -25,6 +66,17 @@ struct VS_INPUT_DYNAMIC{
     float4 BoneWeights : BONEWEIGHTS;
     uint InstanceID : SV_InstanceID;
 };
+
+float4 decodePosition(float4 position, VS_INSTANCE_GENERAL instance)
+{
+    return position;
+}
+
+float3 decodeDirection(float3 direction)
+{
+    return direction;
+}
+#endif
 struct PS_INPUT_GENERAL
 {
     float4 position : SV_POSITION;
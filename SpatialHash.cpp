@@ -0,0 +1,118 @@
+#include "SpatialHash.h"
+#include <algorithm>
+#include <cmath>
+
+SpatialHash::SpatialHash(float _cellSize)
+{
+	cellSize = _cellSize;
+	invCellSize = 1.0f / _cellSize;
+}
+
+uint64_t SpatialHash::key(int x, int z)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
+
+SpatialHash::CellRange SpatialHash::cellRange(float minX, float minZ, float maxX, float maxZ) const
+{
+	CellRange range;
+	range.x0 = static_cast<int>(std::floor(minX * invCellSize));
+	range.z0 = static_cast<int>(std::floor(minZ * invCellSize));
+	range.x1 = static_cast<int>(std::floor(maxX * invCellSize));
+	range.z1 = static_cast<int>(std::floor(maxZ * invCellSize));
+	return range;
+}
+
+void SpatialHash::addToCells(int id, const CellRange& range)
+{
+	for (int z = range.z0; z <= range.z1; z++)
+	{
+		for (int x = range.x0; x <= range.x1; x++)
+		{
+			cells[key(x, z)].push_back(id);
+		}
+	}
+}
+
+void SpatialHash::removeFromCells(int id, const CellRange& range)
+{
+	for (int z = range.z0; z <= range.z1; z++)
+	{
+		for (int x = range.x0; x <= range.x1; x++)
+		{
+			auto it = cells.find(key(x, z));
+			if (it == cells.end()) continue;
+			std::vector<int>& items = it->second;
+			auto item = std::find(items.begin(), items.end(), id);
+			if (item != items.end())
+			{
+				*item = items.back();
+				items.pop_back();
+			}
+			if (items.empty())
+			{
+				cells.erase(it);
+			}
+		}
+	}
+}
+
+void SpatialHash::clear()
+{
+	cells.clear();
+	ranges.clear();
+	stamps.clear();
+	stamp = 0;
+}
+
+void SpatialHash::update(int id, float minX, float minZ, float maxX, float maxZ)
+{
+	if (id >= static_cast<int>(ranges.size()))
+	{
+		ranges.resize(id + 1);
+		stamps.resize(id + 1, 0);
+	}
+	CellRange range = cellRange(minX, minZ, maxX, maxZ);
+	if (range == ranges[id]) return;
+
+	removeFromCells(id, ranges[id]);
+	addToCells(id, range);
+	ranges[id] = range;
+}
+
+void SpatialHash::remove(int id)
+{
+	if (id >= static_cast<int>(ranges.size())) return;
+	removeFromCells(id, ranges[id]);
+	ranges[id] = CellRange();
+}
+
+const std::vector<int>& SpatialHash::query(float minX, float minZ, float maxX, float maxZ)
+{
+	result.clear();
+	//restart the stamps before they wrap around
+	if (++stamp == 0)
+	{
+		std::fill(stamps.begin(), stamps.end(), 0);
+		stamp = 1;
+	}
+
+	CellRange range = cellRange(minX, minZ, maxX, maxZ);
+	for (int z = range.z0; z <= range.z1; z++)
+	{
+		for (int x = range.x0; x <= range.x1; x++)
+		{
+			auto it = cells.find(key(x, z));
+			if (it == cells.end()) continue;
+			for (int id : it->second)
+			{
+				if (stamps[id] != stamp)
+				{
+					stamps[id] = stamp;
+					result.push_back(id);
+				}
+			}
+		}
+	}
+	return result;
+}
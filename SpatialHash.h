@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//uniform grid over the XZ plane, hashed so the world needs no fixed bounds
+//an item is listed in every cell its box touches, update only touches the grid when the item changes cells
+//queries are conservative, they return every item whose cells touch the query box, each item once
+class SpatialHash {
+private:
+	struct CellRange {
+		int x0 = 0;
+		int z0 = 0;
+		int x1 = -1;
+		int z1 = -1;
+		bool empty() const { return x1 < x0; }
+		bool operator==(const CellRange& other) const { return x0 == other.x0 && z0 == other.z0 && x1 == other.x1 && z1 == other.z1; }
+	};
+
+	float cellSize;
+	float invCellSize;
+	std::unordered_map<uint64_t, std::vector<int>> cells;
+	//cells covered by each item, empty if the item is not in the grid
+	std::vector<CellRange> ranges;
+
+	//used to return each item once per query
+	std::vector<unsigned int> stamps;
+	unsigned int stamp = 0;
+	std::vector<int> result;
+
+	static uint64_t key(int x, int z);
+	CellRange cellRange(float minX, float minZ, float maxX, float maxZ) const;
+	void addToCells(int id, const CellRange& range);
+	void removeFromCells(int id, const CellRange& range);
+public:
+	SpatialHash(float cellSize = 32.0f);
+
+	void clear();
+	//insert the item or move it to its new box
+	void update(int id, float minX, float minZ, float maxX, float maxZ);
+	void remove(int id);
+
+	//items that may overlap the box, the returned vector is reused by the next query
+	const std::vector<int>& query(float minX, float minZ, float maxX, float maxZ);
+};
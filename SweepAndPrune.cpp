@@ -0,0 +1,145 @@
+#include "SweepAndPrune.h"
+#include <algorithm>
+
+void SweepAndPrune::resize(int count)
+{
+	int old = size();
+	mins.resize(count, { 0.0f,0.0f,0.0f });
+	maxs.resize(count, { 0.0f,0.0f,0.0f });
+	isStatic.resize(count, 0);
+
+	//drop removed ids and append new ones, the next update sorts them in
+	order.erase(std::remove_if(order.begin(), order.end(), [count](int id) { return id >= count; }), order.end());
+	for (int id = old; id < count; id++)
+	{
+		order.push_back(id);
+		fullSort = true;
+	}
+}
+
+int SweepAndPrune::size() const
+{
+	return static_cast<int>(mins.size());
+}
+
+void SweepAndPrune::setBox(int id, const DirectX::XMFLOAT3& minBound, const DirectX::XMFLOAT3& maxBound, bool staticItem)
+{
+	mins[id] = minBound;
+	maxs[id] = maxBound;
+	isStatic[id] = staticItem ? 1 : 0;
+}
+
+float SweepAndPrune::axisMin(int id) const
+{
+	return axis == 0 ? mins[id].x : mins[id].z;
+}
+
+float SweepAndPrune::axisMax(int id) const
+{
+	return axis == 0 ? maxs[id].x : maxs[id].z;
+}
+
+//sweep along the horizontal axis with the larger spread of box centres, fewer intervals overlap on it
+int SweepAndPrune::chooseAxis() const
+{
+	int n = size();
+	if (n < 2) return axis;
+	double sum[2] = { 0.0,0.0 };
+	double sumSq[2] = { 0.0,0.0 };
+	for (int i = 0; i < n; i++)
+	{
+		double c[2] = { 0.5 * (mins[i].x + maxs[i].x), 0.5 * (mins[i].z + maxs[i].z) };
+		for (int k = 0; k < 2; k++)
+		{
+			sum[k] += c[k];
+			sumSq[k] += c[k] * c[k];
+		}
+	}
+	double varX = sumSq[0] - sum[0] * sum[0] / n;
+	double varZ = sumSq[1] - sum[1] * sum[1] / n;
+	//only switch on a clear difference, every switch costs a full sort
+	if (axis == 0 && varZ > varX * 1.5) return 2;
+	if (axis == 2 && varX > varZ * 1.5) return 0;
+	return axis;
+}
+
+const std::vector<SweepAndPrune::Pair>& SweepAndPrune::update()
+{
+	pairs.clear();
+	int n = size();
+
+	int newAxis = chooseAxis();
+	if (newAxis != axis || fullSort)
+	{
+		axis = newAxis;
+		fullSort = false;
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return axisMin(a) < axisMin(b); });
+	}
+	else
+	{
+		//insertion sort, nearly sorted from the last tick
+		for (int i = 1; i < n; i++)
+		{
+			int id = order[i];
+			float key = axisMin(id);
+			int j = i - 1;
+			while (j >= 0 && axisMin(order[j]) > key)
+			{
+				order[j + 1] = order[j];
+				j--;
+			}
+			order[j + 1] = id;
+		}
+	}
+
+	int other = axis == 0 ? 2 : 0;
+	for (int k = 0; k < 3; k++)
+	{
+		sortedMin[k].resize(n);
+		sortedMax[k].resize(n);
+	}
+	sortedStatic.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		int id = order[i];
+		sortedMin[0][i] = axisMin(id);
+		sortedMax[0][i] = axisMax(id);
+		sortedMin[1][i] = mins[id].y;
+		sortedMax[1][i] = maxs[id].y;
+		sortedMin[2][i] = other == 0 ? mins[id].x : mins[id].z;
+		sortedMax[2][i] = other == 0 ? maxs[id].x : maxs[id].z;
+		sortedStatic[i] = isStatic[id];
+	}
+
+	//every later item starting before this one ends overlaps it on the sweep axis
+	const float* min0 = sortedMin[0].data();
+	const float* max0 = sortedMax[0].data();
+	const float* min1 = sortedMin[1].data();
+	const float* max1 = sortedMax[1].data();
+	const float* min2 = sortedMin[2].data();
+	const float* max2 = sortedMax[2].data();
+	for (int i = 0; i < n; i++)
+	{
+		float end = max0[i];
+		char staticI = sortedStatic[i];
+		for (int j = i + 1; j < n && min0[j] < end; j++)
+		{
+			//evaluated without branches, only the rare hit is a branch the CPU can mispredict
+			bool hit = (max0[j] > min0[i]) & (min1[i] < max1[j]) & (min1[j] < max1[i]) & (min2[i] < max2[j]) & (min2[j] < max2[i]) & !(staticI & sortedStatic[j]);
+			if (hit)
+			{
+				int a = order[i];
+				int b = order[j];
+				pairs.push_back({ std::min(a, b), std::max(a, b) });
+			}
+		}
+	}
+
+	std::sort(pairs.begin(), pairs.end(), [](const Pair& p, const Pair& q) { return p.a != q.a ? p.a < q.a : p.b < q.b; });
+	return pairs;
+}
+
+const std::vector<SweepAndPrune::Pair>& SweepAndPrune::overlaps() const
+{
+	return pairs;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+//sort based broad phase over AABBs
+//items stay sorted by their min along the sweep axis between ticks, boxes move a little per frame
+//so the insertion sort in update is close to linear, the sweep then only compares items whose intervals overlap
+//boxes overlap when they overlap with positive depth on all three axes, the same test as Object::checkCollisionWithPlayer
+class SweepAndPrune {
+public:
+	struct Pair {
+		//a < b
+		int a;
+		int b;
+	};
+private:
+	std::vector<DirectX::XMFLOAT3> mins;
+	std::vector<DirectX::XMFLOAT3> maxs;
+	//static items never pair with each other
+	std::vector<char> isStatic;
+
+	//0 sweeps along x, 2 along z
+	int axis = 0;
+	//item ids sorted by their min on the sweep axis, kept from the last tick
+	std::vector<int> order;
+	//set when items were added, their place in order is unknown
+	bool fullSort = false;
+	//structure-of-arrays copies in sweep order, so the sweep reads memory front to back
+	//index 0 is the sweep axis, 1 is y and 2 the other horizontal axis
+	std::vector<float> sortedMin[3];
+	std::vector<float> sortedMax[3];
+	std::vector<char> sortedStatic;
+
+	std::vector<Pair> pairs;
+
+	float axisMin(int id) const;
+	float axisMax(int id) const;
+	int chooseAxis() const;
+public:
+	//resize the item list, new items start as empty boxes at the origin
+	void resize(int count);
+	int size() const;
+	void setBox(int id, const DirectX::XMFLOAT3& minBound, const DirectX::XMFLOAT3& maxBound, bool staticItem = false);
+
+	//sort and sweep, returns every overlapping pair of this tick ordered by a then b
+	const std::vector<Pair>& update();
+	const std::vector<Pair>& overlaps() const;
+};
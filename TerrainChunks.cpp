@@ -0,0 +1,220 @@
+#include "TerrainChunks.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+
+void TerrainChunks::Build(int width, int height, std::vector<Vertex_Static>& vertices, size_t vertexOffset, std::vector<unsigned int>& indices, JobSystem& jobSystem)
+{
+	chunks.clear();
+	if (width < 2 || height < 2) return;
+
+	int chunksX = (width - 2) / chunkSize + 1;
+	int chunksZ = (height - 2) / chunkSize + 1;
+	int chunkCount = chunksX * chunksZ;
+	chunks.resize(chunkCount);
+	std::vector<float> skirtDepth(chunkCount);
+
+	//bounds
+	jobSystem.parallelFor(chunkCount, 8, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			int x0 = (c % chunksX) * chunkSize;
+			int z0 = (c / chunksX) * chunkSize;
+			int x1 = std::min(x0 + chunkSize, width - 1);
+			int z1 = std::min(z0 + chunkSize, height - 1);
+
+			float minY = FLT_MAX;
+			float maxY = -FLT_MAX;
+			for (int z = z0; z <= z1; z++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					minY = std::min(minY, vertices[vertexOffset + z * width + x].position.y);
+					maxY = std::max(maxY, vertices[vertexOffset + z * width + x].position.y);
+				}
+			}
+			//deep enough to cover any crack inside the chunk's height range
+			skirtDepth[c] = maxY - minY + 1.0f;
+
+			chunks[c].minBound = { static_cast<float>(x0), minY - skirtDepth[c], static_cast<float>(z0) };
+			chunks[c].maxBound = { static_cast<float>(x1), maxY, static_cast<float>(z1) };
+		}
+	});
+
+	//the skirt and index counts of a chunk only depend on its size, so every chunk gets its own ranges up front
+	//and the fill below writes them without touching anything shared
+	//first skirt vertex of each chunk, relative to vertexOffset
+	std::vector<unsigned int> skirtBase(chunkCount);
+	size_t vertexCount = vertices.size();
+	for (int c = 0; c < chunkCount; c++)
+	{
+		int sizeX = static_cast<int>(chunks[c].maxBound.x - chunks[c].minBound.x);
+		int sizeZ = static_cast<int>(chunks[c].maxBound.z - chunks[c].minBound.z);
+		skirtBase[c] = static_cast<unsigned int>(vertexCount - vertexOffset);
+		vertexCount += static_cast<size_t>(sizeX + 1) * 2 + static_cast<size_t>(sizeZ + 1) * 2;
+	}
+	//index sets are stored LOD by LOD
+	size_t indexCount = indices.size();
+	for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+	{
+		int step = 1 << lod;
+		for (TerrainChunk& chunk : chunks)
+		{
+			int quadsX = (static_cast<int>(chunk.maxBound.x - chunk.minBound.x) + step - 1) / step;
+			int quadsZ = (static_cast<int>(chunk.maxBound.z - chunk.minBound.z) + step - 1) / step;
+			chunk.indexOffset[lod] = static_cast<int>(indexCount);
+			chunk.indexCount[lod] = (quadsX * quadsZ + quadsX * 2 + quadsZ * 2) * 6;
+			indexCount += chunk.indexCount[lod];
+		}
+	}
+	vertices.resize(vertexCount);
+	indices.resize(indexCount);
+
+	jobSystem.parallelFor(chunkCount, 8, [&](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			const TerrainChunk& chunk = chunks[c];
+			int x0 = static_cast<int>(chunk.minBound.x);
+			int z0 = static_cast<int>(chunk.minBound.z);
+			int x1 = static_cast<int>(chunk.maxBound.x);
+			int z1 = static_cast<int>(chunk.maxBound.z);
+
+			//edges in order z0, z1, x0, x1, one skirt vertex per grid vertex
+			Vertex_Static* skirt = &vertices[vertexOffset + skirtBase[c]];
+			auto addSkirt = [&](int x, int z)
+			{
+				*skirt = vertices[vertexOffset + z * width + x];
+				skirt->position.y -= skirtDepth[c];
+				skirt++;
+			};
+			for (int x = x0; x <= x1; x++) addSkirt(x, z0);
+			for (int x = x0; x <= x1; x++) addSkirt(x, z1);
+			for (int z = z0; z <= z1; z++) addSkirt(x0, z);
+			for (int z = z0; z <= z1; z++) addSkirt(x1, z);
+
+			for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+			{
+				int step = 1 << lod;
+				unsigned int* out = &indices[chunk.indexOffset[lod]];
+
+				//same winding as the full resolution grid
+				for (int z = z0; z < z1; z = std::min(z + step, z1))
+				{
+					int nz = std::min(z + step, z1);
+					for (int x = x0; x < x1; x = std::min(x + step, x1))
+					{
+						int nx = std::min(x + step, x1);
+						*out++ = z * width + x;
+						*out++ = nz * width + x;
+						*out++ = z * width + nx;
+
+						*out++ = z * width + nx;
+						*out++ = nz * width + x;
+						*out++ = nz * width + nx;
+					}
+				}
+
+				//skirt quads between consecutive edge samples, the rasterizer does not cull so winding does not matter
+				unsigned int rowSkirts = static_cast<unsigned int>(x1 - x0 + 1);
+				unsigned int columnSkirts = static_cast<unsigned int>(z1 - z0 + 1);
+				unsigned int edgeBase[4] = {
+					skirtBase[c],
+					skirtBase[c] + rowSkirts,
+					skirtBase[c] + rowSkirts * 2,
+					skirtBase[c] + rowSkirts * 2 + columnSkirts };
+				auto addQuad = [&](unsigned int gridA, unsigned int gridB, unsigned int skirtA, unsigned int skirtB)
+				{
+					*out++ = gridA;
+					*out++ = skirtA;
+					*out++ = gridB;
+
+					*out++ = gridB;
+					*out++ = skirtA;
+					*out++ = skirtB;
+				};
+				for (int x = x0; x < x1; x = std::min(x + step, x1))
+				{
+					int nx = std::min(x + step, x1);
+					addQuad(z0 * width + x, z0 * width + nx, edgeBase[0] + (x - x0), edgeBase[0] + (nx - x0));
+					addQuad(z1 * width + x, z1 * width + nx, edgeBase[1] + (x - x0), edgeBase[1] + (nx - x0));
+				}
+				for (int z = z0; z < z1; z = std::min(z + step, z1))
+				{
+					int nz = std::min(z + step, z1);
+					addQuad(z * width + x0, nz * width + x0, edgeBase[2] + (z - z0), edgeBase[2] + (nz - z0));
+					addQuad(z * width + x1, nz * width + x1, edgeBase[3] + (z - z0), edgeBase[3] + (nz - z0));
+				}
+			}
+		}
+	});
+}
+
+void TerrainChunks::offsetIndices(int delta)
+{
+	for (auto& chunk : chunks)
+	{
+		for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+		{
+			chunk.indexOffset[lod] += delta;
+		}
+	}
+}
+
+void TerrainChunks::Select(const DirectX::XMMATRIX& terrainToClip, const DirectX::XMFLOAT3& eye, std::vector<TerrainDraw>& draws) const
+{
+	draws.clear();
+
+	//frustum planes from the columns of terrainToClip, pointing inwards
+	DirectX::XMMATRIX m = DirectX::XMMatrixTranspose(terrainToClip);
+	DirectX::XMVECTOR planes[6] = {
+		DirectX::XMVectorAdd(m.r[3], m.r[0]),
+		DirectX::XMVectorSubtract(m.r[3], m.r[0]),
+		DirectX::XMVectorAdd(m.r[3], m.r[1]),
+		DirectX::XMVectorSubtract(m.r[3], m.r[1]),
+		m.r[2],
+		DirectX::XMVectorSubtract(m.r[3], m.r[2]) };
+	DirectX::XMVECTOR eyeV = DirectX::XMLoadFloat3(&eye);
+
+	for (const TerrainChunk& chunk : chunks)
+	{
+		DirectX::XMVECTOR minB = DirectX::XMLoadFloat3(&chunk.minBound);
+		DirectX::XMVECTOR maxB = DirectX::XMLoadFloat3(&chunk.maxBound);
+
+		//the box is outside if its corner furthest along a plane's normal is behind that plane
+		bool visible = true;
+		for (const DirectX::XMVECTOR& plane : planes)
+		{
+			DirectX::XMVECTOR corner = DirectX::XMVectorSelect(minB, maxB, DirectX::XMVectorGreaterOrEqual(plane, DirectX::XMVectorZero()));
+			corner = DirectX::XMVectorSetW(corner, 1.0f);
+			if (DirectX::XMVectorGetX(DirectX::XMVector4Dot(plane, corner)) < 0.0f)
+			{
+				visible = false;
+				break;
+			}
+		}
+		if (!visible) continue;
+
+		//distance from the eye to the closest point of the box
+		DirectX::XMVECTOR closest = DirectX::XMVectorClamp(eyeV, minB, maxB);
+		float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(eyeV, closest)));
+		int lod = 0;
+		while (lod < TerrainChunk::lodCount - 1 && distance >= lodDistance * static_cast<float>(1 << lod))
+		{
+			lod++;
+		}
+
+		TerrainDraw draw;
+		draw.indexOffset = chunk.indexOffset[lod];
+		draw.indexCount = chunk.indexCount[lod];
+		if (!draws.empty() && draws.back().indexOffset + draws.back().indexCount == draw.indexOffset)
+		{
+			draws.back().indexCount += draw.indexCount;
+		}
+		else
+		{
+			draws.push_back(draw);
+		}
+	}
+}
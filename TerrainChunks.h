@@ -0,0 +1,48 @@
+#pragma once
+#include "Vertex.h"
+#include <vector>
+
+class JobSystem;
+
+//one range of the terrain's static index buffer to draw
+struct TerrainDraw
+{
+	int indexOffset = 0;
+	int indexCount = 0;
+};
+
+//a square block of the terrain grid with one index set per LOD
+//every set covers the block with quads of (1 << lod) texels plus a skirt hanging down from its four edges,
+//the skirts hide the cracks between neighbouring chunks drawn at different LODs
+struct TerrainChunk
+{
+	static const int lodCount = 4;
+
+	//terrain space, minBound.y includes the skirts
+	DirectX::XMFLOAT3 minBound = { 0.0f,0.0f,0.0f };
+	DirectX::XMFLOAT3 maxBound = { 0.0f,0.0f,0.0f };
+	int indexOffset[lodCount] = {};
+	int indexCount[lodCount] = {};
+};
+
+//chunked terrain with CPU side LOD and frustum selection, no GPU state so it can run headless
+//index sets are stored LOD by LOD, so neighbouring chunks at the same LOD merge into one draw
+class TerrainChunks
+{
+public:
+	//texels per chunk side, a multiple of 1 << (lodCount - 1)
+	int chunkSize = 64;
+	//chunks closer than lodDistance use LOD 0, the distance doubles for every further LOD
+	float lodDistance = 128.0f;
+	std::vector<TerrainChunk> chunks;
+
+	//vertices[vertexOffset..] must hold the width x height grid row by row, the bounds come from its positions,
+	//appends the skirt vertices and all index sets, indices are relative to vertexOffset
+	//chunks are filled in parallel into ranges sized up front, the output does not depend on the thread count
+	void Build(int width, int height, std::vector<Vertex_Static>& vertices, size_t vertexOffset, std::vector<unsigned int>& indices, JobSystem& jobSystem);
+	//shift every index set after the indices were moved delta places, e.g. into another index pool
+	void offsetIndices(int delta);
+
+	//terrainToClip takes terrain space positions to clip space (row vectors), eye is in terrain space
+	void Select(const DirectX::XMMATRIX& terrainToClip, const DirectX::XMFLOAT3& eye, std::vector<TerrainDraw>& draws) const;
+};
@@ -0,0 +1,517 @@
+#include "TerrainTiles.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+
+TerrainTiles::~TerrainTiles()
+{
+	close();
+}
+
+bool TerrainTiles::write(const std::string& filename, int width, int height, int tileSize, int overviewStep, const std::function<float(int, int)>& heightAt)
+{
+	if (width < 2 || height < 2 || tileSize < 1 || overviewStep < 1) return false;
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+
+	Header header;
+	header.magic = magic;
+	header.version = version;
+	header.width = width;
+	header.height = height;
+	header.tileSize = tileSize;
+	header.overviewStep = overviewStep;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	int overviewX = (width - 1 + overviewStep - 1) / overviewStep + 1;
+	int overviewZ = (height - 1 + overviewStep - 1) / overviewStep + 1;
+	std::vector<float> overview(static_cast<size_t>(overviewX) * overviewZ);
+	for (int z = 0; z < overviewZ; z++)
+	{
+		for (int x = 0; x < overviewX; x++)
+		{
+			overview[z * overviewX + x] = heightAt(std::min(x * overviewStep, width - 1), std::min(z * overviewStep, height - 1));
+		}
+	}
+	out.write(reinterpret_cast<const char*>(overview.data()), overview.size() * sizeof(float));
+
+	//the maxes are only known once every tile is written, so they are filled in at the end
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesZ = (height + tileSize - 1) / tileSize;
+	std::vector<float> tileMax(static_cast<size_t>(tilesX) * tilesZ, -FLT_MAX);
+	std::streampos tileMaxPosition = out.tellp();
+	out.write(reinterpret_cast<const char*>(tileMax.data()), tileMax.size() * sizeof(float));
+
+	//texels past the world's edge repeat the edge, the apron included
+	int stride = tileSize + 2;
+	std::vector<float> heights(static_cast<size_t>(stride) * stride);
+	for (int tz = 0; tz < tilesZ; tz++)
+	{
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			float& maxHeight = tileMax[tz * tilesX + tx];
+			for (int lz = -1; lz <= tileSize; lz++)
+			{
+				int z = tz * tileSize + lz;
+				bool insideZ = lz >= 0 && lz < tileSize && z < height;
+				z = std::max(std::min(z, height - 1), 0);
+				for (int lx = -1; lx <= tileSize; lx++)
+				{
+					int x = tx * tileSize + lx;
+					bool inside = insideZ && lx >= 0 && lx < tileSize && x < width;
+					x = std::max(std::min(x, width - 1), 0);
+					float h = heightAt(x, z);
+					heights[(lz + 1) * stride + lx + 1] = h;
+					if (inside) maxHeight = std::max(maxHeight, h);
+				}
+			}
+			out.write(reinterpret_cast<const char*>(heights.data()), heights.size() * sizeof(float));
+		}
+	}
+
+	out.seekp(tileMaxPosition);
+	out.write(reinterpret_cast<const char*>(tileMax.data()), tileMax.size() * sizeof(float));
+	return static_cast<bool>(out);
+}
+
+bool TerrainTiles::open(const std::string& filename)
+{
+	close();
+	file.open(filename, std::ios::binary);
+	if (!file) return false;
+
+	Header h;
+	file.read(reinterpret_cast<char*>(&h), sizeof(h));
+	if (!file || h.magic != magic || h.version != version || h.width < 2 || h.height < 2 || h.tileSize < 1 || h.overviewStep < 1)
+	{
+		file.close();
+		return false;
+	}
+	header = h;
+	tilesX = (header.width + header.tileSize - 1) / header.tileSize;
+	tilesZ = (header.height + header.tileSize - 1) / header.tileSize;
+	overviewX = (header.width - 1 + header.overviewStep - 1) / header.overviewStep + 1;
+	overviewZ = (header.height - 1 + header.overviewStep - 1) / header.overviewStep + 1;
+	size_t tileCount = static_cast<size_t>(tilesX) * tilesZ;
+
+	//reject a truncated file here, so the loader never reads past the end
+	overview.resize(static_cast<size_t>(overviewX) * overviewZ);
+	tileMax.resize(tileCount);
+	tilesOffset = sizeof(Header) + (overview.size() + tileMax.size()) * sizeof(float);
+	std::error_code ec;
+	uint64_t fileSize = std::filesystem::file_size(filename, ec);
+	file.read(reinterpret_cast<char*>(overview.data()), overview.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(tileMax.data()), tileMax.size() * sizeof(float));
+	if (!file || ec || fileSize < tilesOffset + tileCount * tileBytes())
+	{
+		close();
+		return false;
+	}
+
+	tiles.resize(tileCount);
+	state.assign(tileCount, Absent);
+	loader = std::thread(&TerrainTiles::loaderLoop, this);
+	return true;
+}
+
+void TerrainTiles::close()
+{
+	if (loader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		loader.join();
+	}
+	file.close();
+	file.clear();
+	quit = false;
+	requests.clear();
+	loaded.clear();
+	loading = 0;
+
+	header = Header();
+	tilesX = 0;
+	tilesZ = 0;
+	overviewX = 0;
+	overviewZ = 0;
+	overview.clear();
+	tileMax.clear();
+	tiles.clear();
+	state.clear();
+	resident.clear();
+	updateCount = 0;
+	tilesLoaded = 0;
+	tilesEvicted = 0;
+}
+
+void TerrainTiles::loaderLoop()
+{
+	PROFILE_THREAD_NAME("terrain streaming");
+	while (true)
+	{
+		int index = 0;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || !requests.empty(); });
+			if (quit) return;
+			index = requests.front();
+			requests.pop_front();
+			loading++;
+		}
+
+		std::unique_ptr<Tile> tile = std::make_unique<Tile>();
+		{
+			PROFILE_ZONE("load terrain tile");
+			tile->index = index;
+			tile->heights.resize(static_cast<size_t>(tileStride()) * tileStride());
+			file.seekg(tilesOffset + index * tileBytes());
+			file.read(reinterpret_cast<char*>(tile->heights.data()), tileBytes());
+			//an unreadable tile comes back empty and is asked for again later
+			if (!file)
+			{
+				file.clear();
+				tile->heights.clear();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			loaded.push_back(std::move(tile));
+			loading--;
+		}
+		idle.notify_all();
+	}
+}
+
+int TerrainTiles::maxResidentTiles() const
+{
+	return std::max(1, static_cast<int>(memoryBudget / tileBytes()));
+}
+
+void TerrainTiles::collect()
+{
+	std::vector<std::unique_ptr<Tile>> finished;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.swap(loaded);
+	}
+	for (std::unique_ptr<Tile>& tile : finished)
+	{
+		int index = tile->index;
+		if (tile->heights.empty())
+		{
+			state[index] = Absent;
+			continue;
+		}
+		tile->lastWanted = updateCount;
+		tiles[index] = std::move(tile);
+		state[index] = Resident;
+		resident.push_back(index);
+		tilesLoaded++;
+	}
+}
+
+void TerrainTiles::evict()
+{
+	int maxTiles = maxResidentTiles();
+	while (static_cast<int>(resident.size()) > maxTiles)
+	{
+		size_t oldest = 0;
+		for (size_t i = 1; i < resident.size(); i++)
+		{
+			if (tiles[resident[i]]->lastWanted < tiles[resident[oldest]]->lastWanted) oldest = i;
+		}
+		int index = resident[oldest];
+		tiles[index].reset();
+		state[index] = Absent;
+		resident[oldest] = resident.back();
+		resident.pop_back();
+		tilesEvicted++;
+	}
+}
+
+void TerrainTiles::update(float x, float z)
+{
+	if (!isOpen()) return;
+	PROFILE_ZONE("terrain streaming");
+	updateCount++;
+	collect();
+
+	//tiles touching the load radius, nearest first, no more than the budget can hold
+	int ts = header.tileSize;
+	int tx0 = std::max(static_cast<int>(std::floor((x - loadRadius) / ts)), 0);
+	int tz0 = std::max(static_cast<int>(std::floor((z - loadRadius) / ts)), 0);
+	int tx1 = std::min(static_cast<int>(std::floor((x + loadRadius) / ts)), tilesX - 1);
+	int tz1 = std::min(static_cast<int>(std::floor((z + loadRadius) / ts)), tilesZ - 1);
+	std::vector<std::pair<float, int>> wanted;
+	for (int tz = tz0; tz <= tz1; tz++)
+	{
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			float dx = std::max({ static_cast<float>(tx * ts) - x, x - static_cast<float>((tx + 1) * ts), 0.0f });
+			float dz = std::max({ static_cast<float>(tz * ts) - z, z - static_cast<float>((tz + 1) * ts), 0.0f });
+			float distance = std::sqrt(dx * dx + dz * dz);
+			if (distance <= loadRadius) wanted.push_back({ distance, tz * tilesX + tx });
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+	wanted.resize(std::min(wanted.size(), static_cast<size_t>(maxResidentTiles())));
+
+	//the queue is replaced every update so tiles the point has moved away from are never loaded,
+	//a tile the loader already took stays Requested and is collected whether it is still wanted or not
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int index : requests) state[index] = Absent;
+		requests.clear();
+		for (const std::pair<float, int>& w : wanted)
+		{
+			if (state[w.second] == Resident)
+			{
+				tiles[w.second]->lastWanted = updateCount;
+			}
+			else if (state[w.second] == Absent)
+			{
+				requests.push_back(w.second);
+				state[w.second] = Requested;
+			}
+		}
+	}
+	wake.notify_one();
+
+	evict();
+}
+
+void TerrainTiles::flush()
+{
+	if (!isOpen()) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle.wait(lock, [&] { return requests.empty() && loading == 0; });
+	}
+	collect();
+	evict();
+}
+
+bool TerrainTiles::isResident(float x, float z) const
+{
+	if (!isOpen() || x < 0.0f || z < 0.0f || x >= header.width || z >= header.height) return false;
+	int index = (static_cast<int>(z) / header.tileSize) * tilesX + static_cast<int>(x) / header.tileSize;
+	return tiles[index] != nullptr;
+}
+
+size_t TerrainTiles::residentBytes() const
+{
+	return resident.size() * tileBytes();
+}
+
+size_t TerrainTiles::overviewBytes() const
+{
+	return (overview.size() + tileMax.size()) * sizeof(float);
+}
+
+const float* TerrainTiles::texel(int x, int z) const
+{
+	int tx = x / header.tileSize;
+	int tz = z / header.tileSize;
+	const Tile* tile = tiles[tz * tilesX + tx].get();
+	if (!tile) return nullptr;
+	return &tile->heights[(z - tz * header.tileSize + 1) * tileStride() + (x - tx * header.tileSize + 1)];
+}
+
+float TerrainTiles::sampleOverview(float x, float z) const
+{
+	//the last interval may be shorter than overviewStep
+	auto locate = [&](float v, int count, int size, int& i0, float& t)
+	{
+		int step = header.overviewStep;
+		i0 = std::min(std::max(static_cast<int>(v) / step, 0), count - 2);
+		float p0 = static_cast<float>(std::min(i0 * step, size - 1));
+		float p1 = static_cast<float>(std::min((i0 + 1) * step, size - 1));
+		t = std::min(std::max((v - p0) / (p1 - p0), 0.0f), 1.0f);
+	};
+	int x0, z0;
+	float dx, dz;
+	locate(x, overviewX, header.width, x0, dx);
+	locate(z, overviewZ, header.height, z0, dz);
+
+	float h00 = overview[z0 * overviewX + x0];
+	float h01 = overview[z0 * overviewX + x0 + 1];
+	float h10 = overview[(z0 + 1) * overviewX + x0];
+	float h11 = overview[(z0 + 1) * overviewX + x0 + 1];
+	float h0 = h00 + (h01 - h00) * dx;
+	float h1 = h10 + (h11 - h10) * dx;
+	return h0 + (h1 - h0) * dz;
+}
+
+//central differences, one sided on the world's border, like Map::LoadHeightMap
+DirectX::XMFLOAT3 TerrainTiles::texelNormal(int x, int z) const
+{
+	const float* p = texel(x, z);
+	int stride = tileStride();
+	float left = x > 0 ? p[-1] : p[0];
+	float right = x < header.width - 1 ? p[1] : p[0];
+	float up = z > 0 ? p[-stride] : p[0];
+	float down = z < header.height - 1 ? p[stride] : p[0];
+	float dx = (right - left) / static_cast<float>(std::max(std::min(x + 1, header.width - 1) - std::max(x - 1, 0), 1));
+	float dz = (down - up) / static_cast<float>(std::max(std::min(z + 1, header.height - 1) - std::max(z - 1, 0), 1));
+	DirectX::XMFLOAT3 normal;
+	DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMVectorSet(-dx, 1.0f, -dz, 0.0f)));
+	return normal;
+}
+
+DirectX::XMFLOAT3 TerrainTiles::overviewNormal(float x, float z) const
+{
+	float step = static_cast<float>(header.overviewStep);
+	float maxX = static_cast<float>(header.width - 1);
+	float maxZ = static_cast<float>(header.height - 1);
+	float x0 = std::max(x - step, 0.0f);
+	float x1 = std::min(x + step, maxX);
+	float z0 = std::max(z - step, 0.0f);
+	float z1 = std::min(z + step, maxZ);
+	float dx = (sampleOverview(x1, z) - sampleOverview(x0, z)) / std::max(x1 - x0, 1.0f);
+	float dz = (sampleOverview(x, z1) - sampleOverview(x, z0)) / std::max(z1 - z0, 1.0f);
+	DirectX::XMFLOAT3 normal;
+	DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMVectorSet(-dx, 1.0f, -dz, 0.0f)));
+	return normal;
+}
+
+float TerrainTiles::GetHeight(float x, float z) const
+{
+	int x0 = static_cast<int>(std::floor(x));
+	int z0 = static_cast<int>(std::floor(z));
+	int x1 = x0 + 1;
+	int z1 = z0 + 1;
+
+	if (x0 < 0 || x1 >= header.width || z0 < 0 || z1 >= header.height)
+	{
+		return 0.0f;
+	}
+	const float* p00 = texel(x0, z0);
+	const float* p01 = texel(x1, z0);
+	const float* p10 = texel(x0, z1);
+	const float* p11 = texel(x1, z1);
+	//a cell across a missing tile uses the overview as a whole so there is no step inside it
+	if (!p00 || !p01 || !p10 || !p11) return sampleOverview(x, z);
+
+	float dx = x - static_cast<float>(x0);
+	float dz = z - static_cast<float>(z0);
+
+	float h0 = *p00 + (*p01 - *p00) * dx;
+	float h1 = *p10 + (*p11 - *p10) * dx;
+	return h0 + (h1 - h0) * dz;
+}
+
+DirectX::XMFLOAT3 TerrainTiles::GetTerrainNormal(float x, float z) const
+{
+	int x0 = static_cast<int>(std::floor(x));
+	int z0 = static_cast<int>(std::floor(z));
+	int x1 = x0 + 1;
+	int z1 = z0 + 1;
+
+	if (x0 < 0 || x1 >= header.width || z0 < 0 || z1 >= header.height)
+	{
+		return { 0.0f,1.0f,0.0f };
+	}
+	if (!texel(x0, z0) || !texel(x1, z0) || !texel(x0, z1) || !texel(x1, z1)) return overviewNormal(x, z);
+
+	DirectX::XMFLOAT3 v00 = texelNormal(x0, z0);
+	DirectX::XMFLOAT3 v01 = texelNormal(x1, z0);
+	DirectX::XMFLOAT3 v10 = texelNormal(x0, z1);
+	DirectX::XMFLOAT3 v11 = texelNormal(x1, z1);
+
+	float dx = x - static_cast<float>(x0);
+	float dz = z - static_cast<float>(z0);
+
+	DirectX::XMFLOAT3 v0 = {
+		v00.x + (v01.x - v00.x) * dx,
+		v00.y + (v01.y - v00.y) * dx,
+		v00.z + (v01.z - v00.z) * dx };
+	DirectX::XMFLOAT3 v1 = {
+		v10.x + (v11.x - v10.x) * dx,
+		v10.y + (v11.y - v10.y) * dx,
+		v10.z + (v11.z - v10.z) * dx };
+
+	DirectX::XMFLOAT3 v = {
+		v0.x + (v1.x - v0.x) * dz,
+		v0.y + (v1.y - v0.y) * dz,
+		v0.z + (v1.z - v0.z) * dz };
+
+	float l = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	v.x /= l;
+	v.y /= l;
+	v.z /= l;
+	return v;
+}
+
+float TerrainTiles::GetMaxHeight(float minX, float minZ, float maxX, float maxZ) const
+{
+	int width = header.width;
+	int height = header.height;
+	int x0 = static_cast<int>(std::floor(minX));
+	int z0 = static_cast<int>(std::floor(minZ));
+	int cellX1 = static_cast<int>(std::floor(maxX));
+	int cellZ1 = static_cast<int>(std::floor(maxZ));
+	int x1 = cellX1 + (static_cast<float>(cellX1) < maxX ? 1 : 0);
+	int z1 = cellZ1 + (static_cast<float>(cellZ1) < maxZ ? 1 : 0);
+
+	//GetHeight returns 0 for any sample whose cell is not fully inside the map
+	bool outside = x0 < 0 || z0 < 0 || cellX1 + 1 >= width || cellZ1 + 1 >= height;
+	float best = outside ? 0.0f : -FLT_MAX;
+
+	x0 = std::max(x0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, width - 1);
+	z1 = std::min(z1, height - 1);
+	if (x0 > x1 || z0 > z1 || !isOpen()) return best;
+
+	//a tile the rectangle covers answers with its stored max, a resident one is scanned,
+	//one still loading answers from the overview, which is no bound but keeps objects near the ground instead of on the tile's peak
+	int ts = header.tileSize;
+	int step = header.overviewStep;
+	for (int tz = z0 / ts; tz <= z1 / ts; tz++)
+	{
+		for (int tx = x0 / ts; tx <= x1 / ts; tx++)
+		{
+			int index = tz * tilesX + tx;
+			if (tileMax[index] <= best) continue;
+			int rx0 = std::max(x0, tx * ts);
+			int rz0 = std::max(z0, tz * ts);
+			int rx1 = std::min(x1, std::min((tx + 1) * ts, width) - 1);
+			int rz1 = std::min(z1, std::min((tz + 1) * ts, height) - 1);
+			bool covered = rx0 == tx * ts && rz0 == tz * ts && rx1 == std::min((tx + 1) * ts, width) - 1 && rz1 == std::min((tz + 1) * ts, height) - 1;
+			if (covered)
+			{
+				best = tileMax[index];
+				continue;
+			}
+			if (!tiles[index])
+			{
+				//the corners and every overview sample inside
+				best = std::max({ best, sampleOverview(static_cast<float>(rx0), static_cast<float>(rz0)), sampleOverview(static_cast<float>(rx1), static_cast<float>(rz0)),
+					sampleOverview(static_cast<float>(rx0), static_cast<float>(rz1)), sampleOverview(static_cast<float>(rx1), static_cast<float>(rz1)) });
+				for (int oz = (rz0 + step - 1) / step; oz * step <= rz1; oz++)
+				{
+					for (int ox = (rx0 + step - 1) / step; ox * step <= rx1; ox++)
+					{
+						best = std::max(best, overview[oz * overviewX + ox]);
+					}
+				}
+				continue;
+			}
+			for (int z = rz0; z <= rz1; z++)
+			{
+				const float* row = texel(rx0, z);
+				for (int x = 0; x <= rx1 - rx0; x++)
+				{
+					best = std::max(best, row[x]);
+				}
+			}
+		}
+	}
+	return best;
+}
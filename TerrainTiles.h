@@ -0,0 +1,124 @@
+#pragma once
+#include <DirectXMath.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//out of core terrain heights
+//the tile file holds the world split into square tiles of tileSize texels, each with a one texel apron copied from its
+//neighbours so a tile alone is enough for its normals, plus a small overview that stays resident:
+//every overviewStep-th texel and the max height of every tile
+//a background thread loads the tiles around the point passed to update, the cache holds at most memoryBudget bytes
+//of tiles and evicts the tile that was wanted longest ago
+//queries use a tile's full resolution once it is resident and fall back to the overview while it is not,
+//they only read state that update changes, so any number of threads may query between two updates
+class TerrainTiles {
+private:
+	struct Header {
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		int32_t width = 0;
+		int32_t height = 0;
+		int32_t tileSize = 0;
+		int32_t overviewStep = 0;
+	};
+	struct Tile {
+		int index = 0;
+		//(tileSize + 2)^2 heights including the apron
+		std::vector<float> heights;
+		//update count when the tile was last wanted
+		uint64_t lastWanted = 0;
+	};
+	enum TileState : uint8_t { Absent, Requested, Resident };
+
+	static constexpr uint32_t magic = 0x454C4954; //"TILE"
+	static constexpr uint32_t version = 1;
+
+	Header header;
+	int tilesX = 0;
+	int tilesZ = 0;
+	//overview sample i sits on texel min(i * overviewStep, width - 1)
+	int overviewX = 0;
+	int overviewZ = 0;
+	std::vector<float> overview;
+	std::vector<float> tileMax;
+	uint64_t tilesOffset = 0;
+
+	//owned by the thread calling update
+	std::vector<std::unique_ptr<Tile>> tiles;
+	std::vector<TileState> state;
+	std::vector<int> resident;
+	uint64_t updateCount = 0;
+
+	//shared with the loader thread
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<int> requests;
+	std::vector<std::unique_ptr<Tile>> loaded;
+	bool quit = false;
+	std::ifstream file;
+	std::thread loader;
+
+	//tiles the loader has taken but not handed back
+	int loading = 0;
+	std::condition_variable idle;
+
+	void loaderLoop();
+	//move finished tiles into the cache
+	void collect();
+	//drop the least recently wanted tiles until the budget holds
+	void evict();
+	int maxResidentTiles() const;
+	int tileStride() const { return header.tileSize + 2; }
+	size_t tileBytes() const { return static_cast<size_t>(tileStride()) * tileStride() * sizeof(float); }
+	//a resident texel, nullptr if its tile is not loaded
+	const float* texel(int x, int z) const;
+	float sampleOverview(float x, float z) const;
+	DirectX::XMFLOAT3 texelNormal(int x, int z) const;
+	DirectX::XMFLOAT3 overviewNormal(float x, float z) const;
+public:
+	//bytes of tile data the cache may hold, the overview is not counted
+	size_t memoryBudget = 64 << 20;
+	//tiles closer than this to the point passed to update are loaded, nearest first
+	float loadRadius = 512.0f;
+
+	//counters since open
+	uint64_t tilesLoaded = 0;
+	uint64_t tilesEvicted = 0;
+
+	TerrainTiles() = default;
+	~TerrainTiles();
+	TerrainTiles(const TerrainTiles&) = delete;
+	TerrainTiles& operator=(const TerrainTiles&) = delete;
+
+	//heightAt(x, z) gives the texel at integer coordinates, it is called tile by tile so the world never has to fit in memory
+	static bool write(const std::string& filename, int width, int height, int tileSize, int overviewStep, const std::function<float(int, int)>& heightAt);
+
+	bool open(const std::string& filename);
+	void close();
+	bool isOpen() const { return !tiles.empty(); }
+	int width() const { return header.width; }
+	int height() const { return header.height; }
+
+	//take in finished tiles, request the ones around (x, z) and evict over the budget, call once per frame from one thread
+	void update(float x, float z);
+	//block until every requested tile is resident
+	void flush();
+
+	bool isResident(float x, float z) const;
+	size_t residentBytes() const;
+	size_t overviewBytes() const;
+
+	//same sampling as Map::GetHeight and Map::GetTerrainNormal
+	float GetHeight(float x, float z) const;
+	DirectX::XMFLOAT3 GetTerrainNormal(float x, float z) const;
+	//same bound as Map::GetMaxHeight while the tiles under the rectangle are resident
+	float GetMaxHeight(float minX, float minZ, float maxX, float maxZ) const;
+};
@@ -1,29 +1,27 @@
 #pragma once
-#include<iostream>
-#include<Windows.h>
+#include<chrono>
 class Timer {
 private:
-	LARGE_INTEGER StartTime;
-	LARGE_INTEGER LastTime;
-	LARGE_INTEGER CurrentTime;
-	LARGE_INTEGER Frequency;
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point StartTime;
+	Clock::time_point LastTime;
+	Clock::time_point CurrentTime;
 public:
 	Timer() {
-		QueryPerformanceFrequency(&Frequency);
-		QueryPerformanceCounter(&StartTime);
-		QueryPerformanceCounter(&CurrentTime);
-		QueryPerformanceCounter(&LastTime);
+		StartTime = Clock::now();
+		CurrentTime = StartTime;
+		LastTime = StartTime;
 
 	}
 	float dt() {
-		QueryPerformanceCounter(&CurrentTime);
-		float dt = static_cast<float>(CurrentTime.QuadPart - LastTime.QuadPart) / static_cast<float>(Frequency.QuadPart);
+		CurrentTime = Clock::now();
+		float dt = std::chrono::duration<float>(CurrentTime - LastTime).count();
 		LastTime = CurrentTime;
 		return dt;
 	}
 	float time() {
-		QueryPerformanceCounter(&CurrentTime);
-		return static_cast<float>(CurrentTime.QuadPart - StartTime.QuadPart) / static_cast<float>(Frequency.QuadPart);
+		CurrentTime = Clock::now();
+		return std::chrono::duration<float>(CurrentTime - StartTime).count();
 	}
 
-};
\ No newline at end of file
+};
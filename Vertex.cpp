@@ -1,4 +1,5 @@
 #include "Vertex.h"
+#include <cmath>
 
 void ComputeTangent(DirectX::XMFLOAT3 normal, DirectX::XMFLOAT3& tangent)
 {
@@ -15,6 +16,43 @@ void ComputeTangent(DirectX::XMFLOAT3 normal, DirectX::XMFLOAT3& tangent)
 	DirectX::XMStoreFloat3(&tangent, t);
 }
 
+uint16_t packOctahedral(const DirectX::XMFLOAT3& normal)
+{
+	float l = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	//a degenerate normal points up
+	if (!(l > 0.0f)) return 0;
+	float u = normal.x / l;
+	float v = normal.z / l;
+	//the lower half folds over the diagonals
+	if (normal.y < 0.0f)
+	{
+		float fu = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float fv = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+	int8_t qu = static_cast<int8_t>(lroundf(fmaxf(-1.0f, fminf(1.0f, u)) * 127.0f));
+	int8_t qv = static_cast<int8_t>(lroundf(fmaxf(-1.0f, fminf(1.0f, v)) * 127.0f));
+	return static_cast<uint16_t>(static_cast<uint8_t>(qu) | (static_cast<uint8_t>(qv) << 8));
+}
+
+DirectX::XMFLOAT3 unpackOctahedral(uint16_t packed)
+{
+	float u = fmaxf(static_cast<float>(static_cast<int8_t>(packed & 0xFF)) / 127.0f, -1.0f);
+	float v = fmaxf(static_cast<float>(static_cast<int8_t>(packed >> 8)) / 127.0f, -1.0f);
+	float y = 1.0f - fabs(u) - fabs(v);
+	if (y < 0.0f)
+	{
+		float fu = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float fv = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+	DirectX::XMFLOAT3 normal;
+	DirectX::XMStoreFloat3(&normal, DirectX::XMVector3Normalize(DirectX::XMVectorSet(u, y, v, 0.0f)));
+	return normal;
+}
+
 Vertex_Static addVertex(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 normal, DirectX::XMFLOAT2 uvCoords)
 {
 	Vertex_Static vertex;
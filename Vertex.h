@@ -1,5 +1,7 @@
 #pragma once
 #include <DirectXMath.h> 
+#include <DirectXPackedVector.h>
+#include <cstdint>
 #include <vector>
 
 #ifndef M_PI
@@ -20,6 +22,11 @@ struct InstanceData_General
 {
 	DirectX::XMFLOAT4X4 W;
 	int MaterialIndex;
+	//first bone of this instance in the bone palette, unused by static meshes
+	int BoneOffset = 0;
+	//range of the mesh's packed positions, position = unorm * PositionScale + PositionOffset, unused by float vertices
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 PositionOffset = { 0.0f, 0.0f, 0.0f };
 };
 struct Vertex_Dynamic
 {
@@ -30,6 +37,25 @@ struct Vertex_Dynamic
 	unsigned int bonesIDs[4];
 	float boneWeights[4];
 };
+//compact forms of Vertex_Static and Vertex_Dynamic built by packVertices (VertexPacking.h)
+//position is unorm16 over the mesh bounds (w unused), normal and tangent are packOctahedral, uvCoords are halfs
+struct Vertex_StaticPacked
+{
+	uint16_t position[4];
+	uint16_t normal;
+	uint16_t tangent;
+	DirectX::PackedVector::HALF uvCoords[2];
+};
+//bone weights are unorm8 and always sum to 255
+struct Vertex_DynamicPacked
+{
+	uint16_t position[4];
+	uint16_t normal;
+	uint16_t tangent;
+	DirectX::PackedVector::HALF uvCoords[2];
+	uint8_t bonesIDs[4];
+	uint8_t boneWeights[4];
+};
 struct lightingConstants
 {
 	DirectX::XMFLOAT3 lightDirection;
@@ -40,6 +66,10 @@ struct lightingConstants
 
 
 void ComputeTangent(DirectX::XMFLOAT3 normal, DirectX::XMFLOAT3& tangent);
+//unit normal folded onto the octahedron and unwrapped around the y axis, two 8 bit snorm components (x in the low byte, z in the high byte)
+//the worst case error is just under one degree
+uint16_t packOctahedral(const DirectX::XMFLOAT3& normal);
+DirectX::XMFLOAT3 unpackOctahedral(uint16_t packed);
 Vertex_Static addVertex(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 normal, DirectX::XMFLOAT2 uvCoords);
 void drawACube(std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices);
 void drawASphere(std::vector<Vertex_Static>& vertices, std::vector<unsigned int>& indices);
\ No newline at end of file
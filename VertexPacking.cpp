@@ -0,0 +1,150 @@
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static_assert(sizeof(Vertex_StaticPacked) == 16, "Vertex_StaticPacked must match the packed static input layout");
+static_assert(sizeof(Vertex_DynamicPacked) == 24, "Vertex_DynamicPacked must match the packed dynamic input layout");
+
+namespace {
+
+template <typename Vertex>
+PositionQuantization boundsOf(const Vertex* vertices, size_t count)
+{
+	PositionQuantization quantization;
+	if (count == 0) return quantization;
+	DirectX::XMFLOAT3 lo = { FLT_MAX, FLT_MAX, FLT_MAX };
+	DirectX::XMFLOAT3 hi = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < count; i++)
+	{
+		const DirectX::XMFLOAT3& p = vertices[i].position;
+		lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+		hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+	}
+	quantization.offset = lo;
+	quantization.scale = { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z };
+	return quantization;
+}
+
+uint16_t quantize(float value, float offset, float scale)
+{
+	//a flat axis stores zero
+	if (!(scale > 0.0f)) return 0;
+	float unorm = std::min(std::max((value - offset) / scale, 0.0f), 1.0f);
+	return static_cast<uint16_t>(lroundf(unorm * 65535.0f));
+}
+
+float dequantize(uint16_t value, float offset, float scale)
+{
+	return value / 65535.0f * scale + offset;
+}
+
+//position, normal, tangent and uv are laid out alike in both packed vertices
+template <typename Vertex, typename Packed>
+void packCommon(const Vertex& vertex, const PositionQuantization& quantization, Packed& packed)
+{
+	packed.position[0] = quantize(vertex.position.x, quantization.offset.x, quantization.scale.x);
+	packed.position[1] = quantize(vertex.position.y, quantization.offset.y, quantization.scale.y);
+	packed.position[2] = quantize(vertex.position.z, quantization.offset.z, quantization.scale.z);
+	packed.position[3] = 0;
+	packed.normal = packOctahedral(vertex.normal);
+	packed.tangent = packOctahedral(vertex.tangent);
+	packed.uvCoords[0] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.uvCoords.x);
+	packed.uvCoords[1] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.uvCoords.y);
+}
+
+template <typename Packed, typename Vertex>
+void unpackCommon(const Packed& packed, const PositionQuantization& quantization, Vertex& vertex)
+{
+	vertex.position.x = dequantize(packed.position[0], quantization.offset.x, quantization.scale.x);
+	vertex.position.y = dequantize(packed.position[1], quantization.offset.y, quantization.scale.y);
+	vertex.position.z = dequantize(packed.position[2], quantization.offset.z, quantization.scale.z);
+	vertex.normal = unpackOctahedral(packed.normal);
+	vertex.tangent = unpackOctahedral(packed.tangent);
+	vertex.uvCoords.x = DirectX::PackedVector::XMConvertHalfToFloat(packed.uvCoords[0]);
+	vertex.uvCoords.y = DirectX::PackedVector::XMConvertHalfToFloat(packed.uvCoords[1]);
+}
+
+//round the normalized weights to 8 bits, handing the rounding remainder to the largest fractions so they sum to 255
+void packWeights(const float weights[4], uint8_t packed[4])
+{
+	float sum = 0.0f;
+	for (int i = 0; i < 4; i++) sum += std::max(weights[i], 0.0f);
+	if (!(sum > 0.0f))
+	{
+		std::fill(packed, packed + 4, static_cast<uint8_t>(0));
+		return;
+	}
+	float fraction[4];
+	int total = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		float scaled = std::max(weights[i], 0.0f) / sum * 255.0f;
+		int whole = std::min(static_cast<int>(scaled), 255);
+		packed[i] = static_cast<uint8_t>(whole);
+		fraction[i] = scaled - whole;
+		total += whole;
+	}
+	for (; total < 255; total++)
+	{
+		int best = static_cast<int>(std::max_element(fraction, fraction + 4) - fraction);
+		packed[best]++;
+		fraction[best] = -1.0f;
+	}
+}
+
+}
+
+PositionQuantization computePositionQuantization(const Vertex_Static* vertices, size_t count)
+{
+	return boundsOf(vertices, count);
+}
+
+PositionQuantization computePositionQuantization(const Vertex_Dynamic* vertices, size_t count)
+{
+	return boundsOf(vertices, count);
+}
+
+void packVertices(const Vertex_Static* vertices, size_t count, const PositionQuantization& quantization, Vertex_StaticPacked* packed)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		packCommon(vertices[i], quantization, packed[i]);
+	}
+}
+
+bool packVertices(const Vertex_Dynamic* vertices, size_t count, const PositionQuantization& quantization, Vertex_DynamicPacked* packed)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex_Dynamic& vertex = vertices[i];
+		packCommon(vertex, quantization, packed[i]);
+		for (int k = 0; k < 4; k++)
+		{
+			//an unused slot may hold any index
+			if (vertex.bonesIDs[k] > 255 && vertex.boneWeights[k] > 0.0f) return false;
+			packed[i].bonesIDs[k] = vertex.bonesIDs[k] > 255 ? 0 : static_cast<uint8_t>(vertex.bonesIDs[k]);
+		}
+		packWeights(vertex.boneWeights, packed[i].boneWeights);
+	}
+	return true;
+}
+
+Vertex_Static unpackVertex(const Vertex_StaticPacked& packed, const PositionQuantization& quantization)
+{
+	Vertex_Static vertex;
+	unpackCommon(packed, quantization, vertex);
+	return vertex;
+}
+
+Vertex_Dynamic unpackVertex(const Vertex_DynamicPacked& packed, const PositionQuantization& quantization)
+{
+	Vertex_Dynamic vertex;
+	unpackCommon(packed, quantization, vertex);
+	for (int k = 0; k < 4; k++)
+	{
+		vertex.bonesIDs[k] = packed.bonesIDs[k];
+		vertex.boneWeights[k] = packed.boneWeights[k] / 255.0f;
+	}
+	return vertex;
+}
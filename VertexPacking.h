@@ -0,0 +1,22 @@
+#pragma once
+#include "Vertex.h"
+#include <cstddef>
+
+//range the packed positions of one mesh are quantized over, position = unorm * scale + offset on each axis
+struct PositionQuantization {
+	DirectX::XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 offset = { 0.0f, 0.0f, 0.0f };
+};
+
+//the mesh's bounds, packing then moves a position by at most its axis' extent / 131070
+PositionQuantization computePositionQuantization(const Vertex_Static* vertices, size_t count);
+PositionQuantization computePositionQuantization(const Vertex_Dynamic* vertices, size_t count);
+
+//encode count vertices into packed, the weights of a vertex are renormalized before they are rounded to 8 bits
+void packVertices(const Vertex_Static* vertices, size_t count, const PositionQuantization& quantization, Vertex_StaticPacked* packed);
+//false, with packed partly written, if a bone index does not fit in 8 bits
+bool packVertices(const Vertex_Dynamic* vertices, size_t count, const PositionQuantization& quantization, Vertex_DynamicPacked* packed);
+
+//what the vertex shaders decode from a packed vertex
+Vertex_Static unpackVertex(const Vertex_StaticPacked& packed, const PositionQuantization& quantization);
+Vertex_Dynamic unpackVertex(const Vertex_DynamicPacked& packed, const PositionQuantization& quantization);
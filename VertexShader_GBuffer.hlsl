@@ -12,13 +12,13 @@ PS_INPUT_GBuffer mainVS(VS_INPUT_STATIC input)
     
     PS_INPUT_GBuffer output;
    
-    output.worldPosition = mul(input.position, instance.W);
+    output.worldPosition = mul(decodePosition(input.position, instance), instance.W);
     output.position = mul(output.worldPosition, VP);
     
-    output.normal = mul(input.normal, (float3x3) instance.W);
+    output.normal = mul(decodeDirection(input.normal), (float3x3) instance.W);
     output.normal = normalize(output.normal);
     
-    output.tangent = normalize(mul(input.tangent, (float3x3) instance.W));
+    output.tangent = normalize(mul(decodeDirection(input.tangent), (float3x3) instance.W));
     
     output.bitangent = normalize(cross(output.normal, output.tangent));
     
@@ -12,13 +12,13 @@ PS_INPUT_GENERAL mainVS(VS_INPUT_STATIC input)
     
     PS_INPUT_GENERAL output;
    
-    output.position = mul(input.position, instance.W);
+    output.position = mul(decodePosition(input.position, instance), instance.W);
     output.position = mul(output.position, VP);
     
-    output.Normal = mul(input.normal, (float3x3) instance.W);
+    output.Normal = mul(decodeDirection(input.normal), (float3x3) instance.W);
     output.Normal = normalize(output.Normal);
     
-    output.Tangent = mul(input.tangent, (float3x3) instance.W);
+    output.Tangent = mul(decodeDirection(input.tangent), (float3x3) instance.W);
     output.Tangent = normalize(output.Tangent);
     
     output.TexCoords = input.TexCoords;
@@ -0,0 +1,467 @@
+//animation benchmarks, all of them run on the NPC animation of a level
+#include "BenchModes.h"
+#include "Object.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+	//loads the level for its NPC animation only, with clips kept raw so a mode can compress them itself
+	bool loadNPCAnimation(std::string level)
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		NPC::animation.compressClips = false;
+		meshManager.loadlevel(level, objectManager, map);
+		if (NPC::animation.sequences.empty())
+		{
+			printf("%s has no animated NPCs\n", level.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	//the clips every instance cycles through, the death clip stops evaluating once it has played
+	std::vector<int> loopingSequences()
+	{
+		std::vector<int> sequences;
+		for (int i = 0; i < static_cast<int>(NPC::animation.sequences.size()); i++)
+		{
+			if (i != NPC::animation.deathSequence) sequences.push_back(i);
+		}
+		return sequences;
+	}
+
+	//full rate, every bone and no pose cache, so every update evaluates a pose
+	double timeUpdates(int count, int ticks, const std::vector<int>& sequences)
+	{
+		const float dt = 1.0f / 60.0f;
+		std::vector<AnimationInstance> instances(count);
+		for (int i = 0; i < count; i++)
+		{
+			instances[i].animation = &NPC::animation;
+			//spread the instances over their clips so they do not all sample the same frames
+			int sequence = sequences[i % sequences.size()];
+			instances[i].update(sequence, 0.0f);
+			instances[i].time = std::fmod(0.37f * i, NPC::animation.sequences[sequence].getDuration());
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			for (AnimationInstance& instance : instances)
+			{
+				instance.update(instance.sequence, dt);
+			}
+		}
+		return benchElapsedMs(start);
+	}
+
+	//the array-of-structures clip layout the animation code had before the structure-of-arrays one, kept as the reference
+	struct LegacyFrame
+	{
+		std::vector<DirectX::XMFLOAT3> position;
+		std::vector<DirectX::XMFLOAT4> quaternion;
+		std::vector<DirectX::XMFLOAT3> scale;
+	};
+
+	struct LegacySequence
+	{
+		std::vector<LegacyFrame> frames;
+
+		explicit LegacySequence(const AnimationSequence& sequence)
+		{
+			frames.resize(sequence.frameCount);
+			for (int f = 0; f < sequence.frameCount; f++)
+			{
+				for (int b = 0; b < sequence.boneCount; b++)
+				{
+					size_t i = static_cast<size_t>(f) * sequence.boneStride + b;
+					frames[f].position.push_back({ sequence.positions[i].x, sequence.positions[i].y, sequence.positions[i].z });
+					frames[f].quaternion.push_back(sequence.quaternions[i]);
+					frames[f].scale.push_back({ sequence.scales[i].x, sequence.scales[i].y, sequence.scales[i].z });
+				}
+			}
+		}
+
+		int nextFrame(int frame) const
+		{
+			return (frame + 1) % static_cast<int>(frames.size());
+		}
+
+		static DirectX::XMMATRIX localMatrix(const DirectX::XMFLOAT3& p0, const DirectX::XMFLOAT3& p1, const DirectX::XMFLOAT4& q0, const DirectX::XMFLOAT4& q1,
+			const DirectX::XMFLOAT3& s0, const DirectX::XMFLOAT3& s1, float t)
+		{
+			DirectX::XMVECTOR p = DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&p0), DirectX::XMLoadFloat3(&p1), t);
+			DirectX::XMVECTOR q = DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4(&q0), DirectX::XMLoadFloat4(&q1), t);
+			DirectX::XMVECTOR s = DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&s0), DirectX::XMLoadFloat3(&s1), t);
+			DirectX::XMMATRIX m = DirectX::XMMatrixTranspose(DirectX::XMMatrixScalingFromVector(s));
+			m = DirectX::XMMatrixTranspose(DirectX::XMMatrixRotationQuaternion(q)) * m;
+			return DirectX::XMMatrixTranspose(DirectX::XMMatrixTranslationFromVector(p)) * m;
+		}
+
+		//the original evaluation, both keyframes copied by value for every bone
+		void poseCopying(std::vector<DirectX::XMFLOAT4X4>& transforms, int frame, float t, const Skeleton& skeleton) const
+		{
+			for (int i = 0; i < static_cast<int>(skeleton.bones.size()); i++)
+			{
+				LegacyFrame frame1 = frames[frame];
+				LegacyFrame frame2 = frames[nextFrame(frame)];
+				DirectX::XMMATRIX m = localMatrix(frame1.position[i], frame2.position[i], frame1.quaternion[i], frame2.quaternion[i], frame1.scale[i], frame2.scale[i], t);
+				if (skeleton.bones[i].parentIndex > -1) m = DirectX::XMLoadFloat4x4(&transforms[skeleton.bones[i].parentIndex]) * m;
+				DirectX::XMStoreFloat4x4(&transforms[i], m);
+			}
+		}
+
+		//one pass over referenced keyframes, the baseline the structure-of-arrays sampler replaced
+		void poseOnePass(std::vector<DirectX::XMFLOAT4X4>& transforms, int frame, float t, const Skeleton& skeleton) const
+		{
+			const LegacyFrame& frame1 = frames[frame];
+			const LegacyFrame& frame2 = frames[nextFrame(frame)];
+			for (int i = 0; i < static_cast<int>(skeleton.bones.size()); i++)
+			{
+				DirectX::XMMATRIX m = localMatrix(frame1.position[i], frame2.position[i], frame1.quaternion[i], frame2.quaternion[i], frame1.scale[i], frame2.scale[i], t);
+				if (skeleton.bones[i].parentIndex > -1) m = DirectX::XMLoadFloat4x4(&transforms[skeleton.bones[i].parentIndex]) * m;
+				DirectX::XMStoreFloat4x4(&transforms[i], m);
+			}
+		}
+	};
+
+	struct PoseSample
+	{
+		int sequence;
+		int frame;
+		float t;
+	};
+
+	template<typename Evaluate>
+	double timePoses(const std::vector<PoseSample>& samples, int repetitions, Evaluate evaluate)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repetitions; r++)
+		{
+			for (const PoseSample& sample : samples) evaluate(sample);
+		}
+		return benchElapsedMs(start) * 1000.0 / (static_cast<double>(samples.size()) * repetitions);
+	}
+}
+
+//AnimationInstance::update for growing instance counts, with raw and with compressed clips
+//usage: sim_bench anim-update [level file] [updates per count] [instance counts...]
+int benchAnimUpdate(const std::vector<std::string>& args)
+{
+	std::string level = args.size() > 0 ? args[0] : "Input.txt";
+	int updates = std::max(benchArg(args, 1, 300000), 1);
+	std::vector<int> counts;
+	for (size_t i = 2; i < args.size(); i++) counts.push_back(std::max(std::atoi(args[i].c_str()), 1));
+	if (counts.empty()) counts = { 1, 100, 10000 };
+
+	if (!loadNPCAnimation(level)) return 1;
+	std::vector<int> sequences = loopingSequences();
+	NPC::animation.lodLevels.clear();
+	printf("%zu bones, %zu clips\n", NPC::animation.skeleton.bones.size(), NPC::animation.sequences.size());
+
+	std::vector<double> raw, compressed;
+	std::vector<int> ticks;
+	for (int count : counts)
+	{
+		ticks.push_back(std::max(updates / count, 10));
+		raw.push_back(timeUpdates(count, ticks.back(), sequences));
+	}
+	NPC::animation.compressSequences();
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		compressed.push_back(timeUpdates(counts[i], ticks[i], sequences));
+	}
+
+	printf("%10s %8s %16s %18s %18s\n", "instances", "ticks", "raw ns/update", "compressed ns/update", "raw updates/s");
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		double n = static_cast<double>(counts[i]) * ticks[i];
+		printf("%10d %8d %16.1f %18.1f %18.0f\n", counts[i], ticks[i], raw[i] * 1e6 / n, compressed[i] * 1e6 / n, n * 1000.0 / raw[i]);
+	}
+	return 0;
+}
+
+//one skeleton pose (sampling and hierarchy, then the final transforms) with each clip layout the animation code has had
+//usage: sim_bench pose [level file] [repetitions]
+int benchPose(const std::vector<std::string>& args)
+{
+	std::string level = args.size() > 0 ? args[0] : "Input.txt";
+	int repetitions = std::max(benchArg(args, 1, 200), 1);
+	if (!loadNPCAnimation(level)) return 1;
+	Animation& animation = NPC::animation;
+	const Skeleton& skeleton = animation.skeleton;
+
+	std::vector<LegacySequence> legacy;
+	std::vector<PoseSample> samples;
+	for (int s : loopingSequences())
+	{
+		AnimationSequence& sequence = animation.sequences[s];
+		legacy.emplace_back(sequence);
+		//every frame of every clip, at a different point between the frame and the next
+		for (int f = 0; f < sequence.frameCount; f++)
+		{
+			samples.push_back({ s, f, (f % 7 + 0.5f) / 7.0f });
+		}
+	}
+	std::vector<int> legacyIndex(animation.sequences.size(), 0);
+	for (size_t i = 0, k = 0; i < animation.sequences.size(); i++)
+	{
+		if (static_cast<int>(i) != animation.deathSequence) legacyIndex[i] = static_cast<int>(k++);
+	}
+
+	//the reference and the current sampler must agree before their times mean anything
+	std::vector<DirectX::XMFLOAT4X4> expected(skeleton.bones.size());
+	std::vector<DirectX::XMFLOAT4X4> actual(skeleton.bones.size());
+	std::vector<int> allBones;
+	float worst = 0.0f;
+	for (const PoseSample& sample : samples)
+	{
+		legacy[legacyIndex[sample.sequence]].poseOnePass(expected, sample.frame, sample.t, skeleton);
+		animation.interpolateBonesToGlobal(sample.sequence, actual, sample.frame, sample.t, false, allBones);
+		for (size_t b = 0; b < skeleton.bones.size(); b++)
+		{
+			for (int k = 0; k < 16; k++)
+			{
+				float e = expected[b].m[k / 4][k % 4];
+				worst = std::max(worst, std::fabs(actual[b].m[k / 4][k % 4] - e) / std::max(1.0f, std::fabs(e)));
+			}
+		}
+	}
+
+	std::vector<DirectX::XMFLOAT4X4> transforms(skeleton.bones.size());
+	double copying = timePoses(samples, std::max(repetitions / 20, 1), [&](const PoseSample& sample)
+	{
+		legacy[legacyIndex[sample.sequence]].poseCopying(transforms, sample.frame, sample.t, skeleton);
+	});
+	double onePass = timePoses(samples, repetitions, [&](const PoseSample& sample)
+	{
+		legacy[legacyIndex[sample.sequence]].poseOnePass(transforms, sample.frame, sample.t, skeleton);
+	});
+	double soa = timePoses(samples, repetitions, [&](const PoseSample& sample)
+	{
+		animation.interpolateBonesToGlobal(sample.sequence, transforms, sample.frame, sample.t, false, allBones);
+	});
+	//the final transforms used to take two products per bone, the combined offsets make it one
+	double legacyFinal = timePoses(samples, repetitions, [&](const PoseSample&)
+	{
+		for (size_t i = 0; i < skeleton.bones.size(); i++)
+		{
+			DirectX::XMMATRIX m = DirectX::XMLoadFloat4x4(&transforms[i]) * skeleton.bones[i].bindingOffset * skeleton.globalInverse;
+			DirectX::XMStoreFloat4x4(&transforms[i], m);
+		}
+	});
+	double final = timePoses(samples, repetitions, [&](const PoseSample&)
+	{
+		animation.calcFinalTransformations(transforms, allBones);
+	});
+
+	printf("%zu bones, %zu poses, largest relative difference to the one pass reference %.2g\n", skeleton.bones.size(), samples.size(), worst);
+	printf("%-36s %12s %12s %14s %12s\n", "layout", "us/pose", "vs one pass", "with final us", "vs one pass");
+	printf("%-36s %12.3f %11.2fx %14.3f %11.2fx\n", "array of structures, frame copies", copying, onePass / copying, copying + legacyFinal, (onePass + legacyFinal) / (copying + legacyFinal));
+	printf("%-36s %12.3f %11.2fx %14.3f %11.2fx\n", "array of structures, one pass", onePass, 1.0, onePass + legacyFinal, 1.0);
+	printf("%-36s %12.3f %11.2fx %14.3f %11.2fx\n", "structure of arrays, four bones", soa, onePass / soa, soa + final, (onePass + legacyFinal) / (soa + final));
+	printf("final transforms %.3f us/pose with two products per bone, %.3f with the combined offsets\n", legacyFinal, final);
+	return 0;
+}
+
+//the NPC animation and bone palette packing of the frame loop fanned out over 1 to N threads,
+//every thread count must leave the same palette as the serial run
+//usage: sim_bench anim-jobs [level file] [instances] [ticks] [max threads]
+int benchAnimJobs(const std::vector<std::string>& args)
+{
+	std::string level = args.size() > 0 ? args[0] : "Input.txt";
+	int count = std::max(benchArg(args, 1, 2000), 1);
+	int ticks = std::max(benchArg(args, 2, 60), 1);
+	int hardware = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+	int maxThreads = std::max(benchArg(args, 3, std::max(hardware, 4)), 1);
+
+	if (!loadNPCAnimation(level)) return 1;
+	NPC::animation.compressSequences();
+	NPC::animation.buildLODs();
+	std::vector<int> sequences = loopingSequences();
+	int bones = static_cast<int>(NPC::animation.skeleton.bones.size());
+	printf("%d instances, %d bones, %d ticks, %d hardware threads\n", count, bones, ticks, hardware);
+
+	std::vector<int> threadCounts;
+	for (int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(maxThreads);
+
+	const float dt = 1.0f / 60.0f;
+	std::vector<float> serialPalette;
+	double serialMs = 0.0;
+	printf("%8s %14s %10s %12s %12s\n", "threads", "ms per tick", "speedup", "efficiency", "identical");
+	for (int threads : threadCounts)
+	{
+		//same starting state for every thread count, LOD levels spread the way the frame loop spreads them
+		std::vector<AnimationInstance> instances(count);
+		BonePalette palette;
+		for (int i = 0; i < count; i++)
+		{
+			instances[i].animation = &NPC::animation;
+			instances[i].setLOD(i % static_cast<int>(NPC::animation.lodLevels.size()), i);
+			instances[i].update(sequences[i % sequences.size()], 0.0f);
+			palette.allocate(bones);
+		}
+		JobSystem jobSystem(threads);
+		auto start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			jobSystem.parallelFor(count, 8, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; i++)
+				{
+					instances[i].update(instances[i].sequence, dt);
+					if (instances[i].poseChanged) palette.write(i, instances[i].BonesTransforms);
+				}
+			});
+		}
+		double ms = benchElapsedMs(start) / ticks;
+		if (threads == 1)
+		{
+			serialPalette = palette.data;
+			serialMs = ms;
+		}
+		bool identical = palette.data.size() == serialPalette.size() &&
+			memcmp(palette.data.data(), serialPalette.data(), palette.data.size() * sizeof(float)) == 0;
+		printf("%8d %14.3f %9.2fx %11.0f%% %12s\n", threads, ms, serialMs / ms, 100.0 * serialMs / ms / threads, identical ? "yes" : "NO");
+		if (!identical) return 1;
+	}
+	return 0;
+}
+
+//a crowd standing on a disc around the viewer at a fixed density, so a larger crowd reaches further out into the
+//cheaper LOD levels, timed with the level's LOD table and with every instance at full rate and every bone
+//usage: sim_bench anim-lod [level file] [ticks] [instance counts...]
+int benchAnimLOD(const std::vector<std::string>& args)
+{
+	std::string level = args.size() > 0 ? args[0] : "Input.txt";
+	int ticks = std::max(benchArg(args, 1, 60), 1);
+	std::vector<int> counts;
+	for (size_t i = 2; i < args.size(); i++) counts.push_back(std::max(std::atoi(args[i].c_str()), 1));
+	if (counts.empty()) counts = { 100, 1000, 10000, 40000 };
+
+	if (!loadNPCAnimation(level)) return 1;
+	NPC::animation.compressSequences();
+	NPC::animation.buildLODs();
+	std::vector<int> sequences = loopingSequences();
+	int levels = static_cast<int>(NPC::animation.lodLevels.size());
+	printf("%zu bones, LOD levels from", NPC::animation.skeleton.bones.size());
+	for (const AnimationLOD& lod : NPC::animation.lodLevels) printf(" %.0f", lod.distance);
+	printf(", one instance per 400 square units\n");
+
+	const float dt = 1.0f / 60.0f;
+	printf("%10s %10s %14s %14s %14s %10s   %s\n", "instances", "radius", "full us/tick", "LOD us/tick", "LOD ns/npc", "saving", "instances per level");
+	for (int count : counts)
+	{
+		float radius = std::sqrt(static_cast<float>(count) * 400.0f / 3.14159265f);
+		double ms[2] = {};
+		std::vector<int> perLevel(levels, 0);
+		for (int useLOD = 0; useLOD < 2; useLOD++)
+		{
+			std::vector<AnimationInstance> instances(count);
+			for (int i = 0; i < count; i++)
+			{
+				//evenly over the disc area, only the distance matters, instance i stands where the disc holds i of them
+				float distance = radius * std::sqrt((i + 0.5f) / count);
+				int lod = useLOD ? NPC::animation.selectLOD(distance) : 0;
+				if (useLOD) perLevel[lod]++;
+				instances[i].animation = &NPC::animation;
+				//a level past the end of the table is full rate with every bone
+				instances[i].setLOD(useLOD ? lod : levels, i);
+				instances[i].update(sequences[i % sequences.size()], 0.0f);
+			}
+			auto start = std::chrono::steady_clock::now();
+			for (int tick = 0; tick < ticks; tick++)
+			{
+				for (AnimationInstance& instance : instances) instance.update(instance.sequence, dt);
+			}
+			ms[useLOD] = benchElapsedMs(start) / ticks;
+		}
+		printf("%10d %10.0f %14.1f %14.1f %14.1f %9.1fx  ", count, radius, ms[0] * 1000.0, ms[1] * 1000.0, ms[1] * 1e6 / count, ms[0] / ms[1]);
+		for (int n : perLevel) printf(" %d", n);
+		printf("\n");
+	}
+	return 0;
+}
+
+//memory, sampling time and error of every clip raw and compressed with the level's error bounds,
+//a sample is one full pose the way AnimationInstance::update evaluates it, the error is the largest distance
+//between a bone's raw and compressed final transform applied to the origin, in model units
+//usage: sim_bench anim-clips [level file] [samples per clip]
+int benchAnimClips(const std::vector<std::string>& args)
+{
+	std::string level = args.size() > 0 ? args[0] : "Input.txt";
+	int samples = std::max(benchArg(args, 1, 2000), 1);
+	if (!loadNPCAnimation(level)) return 1;
+	Animation raw = NPC::animation;
+	Animation compressed = NPC::animation;
+	compressed.compressSequences();
+	int bones = static_cast<int>(raw.skeleton.bones.size());
+	const std::vector<int> allBones;
+
+	//time every pose, then replay the same times for the error
+	auto samplePoses = [&](Animation& animation, int clip, std::vector<DirectX::XMFLOAT4X4>& pose, std::vector<DirectX::XMFLOAT4X4>* keep)
+	{
+		float duration = animation.sequences[clip].getDuration();
+		bool death = clip == animation.deathSequence;
+		auto start = std::chrono::steady_clock::now();
+		for (int s = 0; s < samples; s++)
+		{
+			int frame = 0;
+			float interpolationFact = 0.0f;
+			animation.calcFrame(clip, duration * (s + 0.5f) / samples, frame, interpolationFact);
+			animation.interpolateBonesToGlobal(clip, pose, frame, interpolationFact, death, allBones);
+			animation.calcFinalTransformations(pose, allBones);
+			if (keep) std::copy(pose.begin(), pose.begin() + bones, keep->begin() + static_cast<size_t>(s) * bones);
+		}
+		return benchElapsedMs(start);
+	};
+
+	printf("%zu clips, %d bones, error bounds position %g rotation %g scale %g\n", raw.sequences.size(), bones,
+		compressed.compression.positionError, compressed.compression.rotationError, compressed.compression.scaleError);
+	printf("%-12s %7s %11s %11s %7s %10s %10s %12s\n", "clip", "frames", "raw bytes", "packed", "ratio", "raw ns", "packed ns", "max error");
+	size_t rawTotal = 0;
+	size_t packedTotal = 0;
+	double rawMsTotal = 0.0;
+	double packedMsTotal = 0.0;
+	std::vector<DirectX::XMFLOAT4X4> pose(256);
+	std::vector<DirectX::XMFLOAT4X4> rawPoses(static_cast<size_t>(samples) * bones);
+	std::vector<DirectX::XMFLOAT4X4> packedPoses(static_cast<size_t>(samples) * bones);
+	for (int clip = 0; clip < static_cast<int>(raw.sequences.size()); clip++)
+	{
+		//one untimed pass each, so neither layout is timed on a cold cache
+		samplePoses(raw, clip, pose, &rawPoses);
+		samplePoses(compressed, clip, pose, &packedPoses);
+		double rawMs = samplePoses(raw, clip, pose, nullptr);
+		double packedMs = samplePoses(compressed, clip, pose, nullptr);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < rawPoses.size(); i++)
+		{
+			//column-vector matrices, the translation is the last column
+			float dx = rawPoses[i]._14 - packedPoses[i]._14;
+			float dy = rawPoses[i]._24 - packedPoses[i]._24;
+			float dz = rawPoses[i]._34 - packedPoses[i]._34;
+			maxError = std::max(maxError, std::sqrt(dx * dx + dy * dy + dz * dz));
+		}
+
+		size_t rawBytes = raw.sequences[clip].sizeInBytes();
+		size_t packedBytes = compressed.sequences[clip].sizeInBytes();
+		rawTotal += rawBytes;
+		packedTotal += packedBytes;
+		rawMsTotal += rawMs;
+		packedMsTotal += packedMs;
+		printf("%-12s %7d %11zu %11zu %6.1fx %10.0f %10.0f %12.5f\n", raw.sequenceNames[clip].c_str(), raw.sequences[clip].frameCount, rawBytes, packedBytes,
+			static_cast<double>(rawBytes) / packedBytes, rawMs * 1e6 / samples, packedMs * 1e6 / samples, maxError);
+	}
+	size_t clips = raw.sequences.size();
+	printf("%-12s %7s %11zu %11zu %6.1fx %10.0f %10.0f\n", "all", "", rawTotal, packedTotal, static_cast<double>(rawTotal) / packedTotal,
+		rawMsTotal * 1e6 / (samples * clips), packedMsTotal * 1e6 / (samples * clips));
+	return 0;
+}
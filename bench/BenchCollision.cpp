@@ -0,0 +1,189 @@
+//broad phase benchmarks on synthetic worlds of boxes, the world grows with the box count so the density stays fixed
+#include "BenchModes.h"
+#include "SpatialHash.h"
+#include "SweepAndPrune.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	struct Box
+	{
+		float minX, minZ, maxX, maxZ;
+	};
+
+	//boxes 2 to 10 units wide, about one per 400 square units like the placed objects of the shipped level
+	std::vector<Box> randomBoxes(int count, float side, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> position(0.0f, side);
+		std::uniform_real_distribution<float> size(2.0f, 10.0f);
+		std::vector<Box> boxes(count);
+		for (Box& box : boxes)
+		{
+			box.minX = position(random);
+			box.minZ = position(random);
+			box.maxX = box.minX + size(random);
+			box.maxZ = box.minZ + size(random);
+		}
+		return boxes;
+	}
+
+	bool overlaps(const Box& a, const Box& b)
+	{
+		return a.minX <= b.maxX && b.minX <= a.maxX && a.minZ <= b.maxZ && b.minZ <= a.maxZ;
+	}
+}
+
+//insert, move a tenth of the items per tick and query 64x64 boxes, against a linear scan of every box
+int benchSpatialHash(const std::vector<std::string>& args)
+{
+	int queries = benchArg(args, 0, 10000);
+	std::vector<int> counts;
+	for (size_t i = 1; i < args.size(); i++) counts.push_back(std::atoi(args[i].c_str()));
+	if (counts.empty()) counts = { 1000, 10000, 100000 };
+
+	printf("%10s %12s %14s %14s %14s %12s %10s\n", "items", "insert ms", "move us/tick", "query ns", "scan ns", "candidates", "speedup");
+	for (int count : counts)
+	{
+		std::mt19937 random(count);
+		float side = std::sqrt(static_cast<float>(count) * 400.0f);
+		std::vector<Box> boxes = randomBoxes(count, side, random);
+		std::vector<Box> queryBoxes = randomBoxes(queries, side, random);
+		for (Box& box : queryBoxes)
+		{
+			box.maxX = box.minX + 64.0f;
+			box.maxZ = box.minZ + 64.0f;
+		}
+
+		SpatialHash grid;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) grid.update(i, boxes[i].minX, boxes[i].minZ, boxes[i].maxX, boxes[i].maxZ);
+		double insertMs = benchElapsedMs(start);
+
+		//a tenth of the items walk half a unit per tick, most of them stay in their cells
+		const int ticks = 20;
+		std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+		start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			for (int i = tick % 10; i < count; i += 10)
+			{
+				float dx = step(random);
+				float dz = step(random);
+				Box& box = boxes[i];
+				box = { box.minX + dx, box.minZ + dz, box.maxX + dx, box.maxZ + dz };
+				grid.update(i, box.minX, box.minZ, box.maxX, box.maxZ);
+			}
+		}
+		double moveMs = benchElapsedMs(start);
+
+		//every hit of the scan has to be among the candidates, the hash is allowed to return more
+		long long candidates = 0;
+		start = std::chrono::steady_clock::now();
+		for (const Box& query : queryBoxes)
+		{
+			candidates += static_cast<long long>(grid.query(query.minX, query.minZ, query.maxX, query.maxZ).size());
+		}
+		double queryMs = benchElapsedMs(start);
+		long long hits = 0;
+		start = std::chrono::steady_clock::now();
+		for (const Box& query : queryBoxes)
+		{
+			for (const Box& box : boxes) hits += overlaps(query, box) ? 1 : 0;
+		}
+		double scanMs = benchElapsedMs(start);
+
+		long long found = 0;
+		for (const Box& query : queryBoxes)
+		{
+			for (int id : grid.query(query.minX, query.minZ, query.maxX, query.maxZ)) found += overlaps(query, boxes[id]) ? 1 : 0;
+		}
+		if (found != hits)
+		{
+			printf("%d items: the hash found %lld of %lld overlapping boxes\n", count, found, hits);
+			return 1;
+		}
+
+		printf("%10d %12.2f %14.1f %14.1f %14.1f %12.1f %9.1fx\n", count, insertMs, moveMs * 1000.0 / ticks, queryMs * 1e6 / queries,
+			scanMs * 1e6 / queries, static_cast<double>(candidates) / queries, scanMs / queryMs);
+	}
+	return 0;
+}
+
+//moving agents, about one per 400 square units like the NPCs, a tick moves every agent and sweeps, the pairs of the
+//last tick are checked against a brute force test of every pair, which is also timed
+int benchSweepAndPrune(const std::vector<std::string>& args)
+{
+	int count = benchArg(args, 0, 10000);
+	int ticks = benchArg(args, 1, 200);
+	std::mt19937 random(count);
+	float side = std::sqrt(static_cast<float>(count) * 400.0f);
+	std::vector<Box> boxes = randomBoxes(count, side, random);
+	std::vector<DirectX::XMFLOAT2> velocity(count);
+	std::uniform_real_distribution<float> speed(-0.5f, 0.5f);
+	for (DirectX::XMFLOAT2& v : velocity) v = { speed(random), speed(random) };
+
+	SweepAndPrune sap;
+	sap.resize(count);
+	auto setBoxes = [&]()
+	{
+		for (int i = 0; i < count; i++) sap.setBox(i, { boxes[i].minX, 0.0f, boxes[i].minZ }, { boxes[i].maxX, 4.0f, boxes[i].maxZ });
+	};
+	setBoxes();
+	auto start = std::chrono::steady_clock::now();
+	sap.update();
+	double firstMs = benchElapsedMs(start);
+
+	double sweepMs = 0.0;
+	double worstMs = 0.0;
+	long long pairs = 0;
+	start = std::chrono::steady_clock::now();
+	for (int tick = 0; tick < ticks; tick++)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			//bounce off the world's edges so the density stays the same
+			Box& box = boxes[i];
+			if (box.minX + velocity[i].x < 0.0f || box.maxX + velocity[i].x > side) velocity[i].x = -velocity[i].x;
+			if (box.minZ + velocity[i].y < 0.0f || box.maxZ + velocity[i].y > side) velocity[i].y = -velocity[i].y;
+			box = { box.minX + velocity[i].x, box.minZ + velocity[i].y, box.maxX + velocity[i].x, box.maxZ + velocity[i].y };
+		}
+		setBoxes();
+		auto tickStart = std::chrono::steady_clock::now();
+		pairs += static_cast<long long>(sap.update().size());
+		double ms = benchElapsedMs(tickStart);
+		sweepMs += ms;
+		worstMs = std::max(worstMs, ms);
+	}
+	double totalMs = benchElapsedMs(start);
+
+	start = std::chrono::steady_clock::now();
+	std::vector<SweepAndPrune::Pair> brute;
+	for (int a = 0; a < count; a++)
+	{
+		for (int b = a + 1; b < count; b++)
+		{
+			const Box& p = boxes[a];
+			const Box& q = boxes[b];
+			if (p.minX < q.maxX && q.minX < p.maxX && p.minZ < q.maxZ && q.minZ < p.maxZ) brute.push_back({ a, b });
+		}
+	}
+	double bruteMs = benchElapsedMs(start);
+	const std::vector<SweepAndPrune::Pair>& last = sap.overlaps();
+	bool same = last.size() == brute.size();
+	for (size_t i = 0; same && i < brute.size(); i++) same = last[i].a == brute[i].a && last[i].b == brute[i].b;
+	if (!same)
+	{
+		printf("the last tick's %zu pairs differ from the brute force %zu\n", last.size(), brute.size());
+		return 1;
+	}
+
+	printf("%d agents, %d ticks, %.1f pairs per tick\n", count, ticks, static_cast<double>(pairs) / ticks);
+	printf("first sort and sweep  %10.3f ms\n", firstMs);
+	printf("tick (move + sweep)   %10.3f ms\n", totalMs / ticks);
+	printf("sweep                 %10.3f ms avg, %.3f ms worst\n", sweepMs / ticks, worstMs);
+	printf("brute force pairs     %10.3f ms\n", bruteMs);
+	return 0;
+}
@@ -0,0 +1,106 @@
+//asset loading benchmarks
+#include "BenchModes.h"
+#include "GEMMappedLoader.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+namespace
+{
+	//folds every vertex and index into one value so both loaders touch all of the data they return
+	template<typename V>
+	uint32_t touch(const V* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+	{
+		uint32_t sum = 0;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(vertices);
+		for (size_t i = 0; i < vertexCount * sizeof(V); i += 64) sum += bytes[i];
+		for (size_t i = 0; i < indexCount; i += 16) sum += indices[i];
+		return sum;
+	}
+
+	struct LoadTiming
+	{
+		double best = 1e30;
+		double total = 0.0;
+
+		void add(double ms)
+		{
+			best = std::min(best, ms);
+			total += ms;
+		}
+	};
+}
+
+//stream (std::ifstream) against memory-mapped .gem loading, warm page cache, each load also touches every array it returned
+//usage: sim_bench gem-load [repetitions] [gem files...]
+int benchGemLoad(const std::vector<std::string>& args)
+{
+	int repetitions = std::max(benchArg(args, 0, 20), 1);
+	std::vector<std::string> files(args.size() > 1 ? args.begin() + 1 : args.end(), args.end());
+	if (files.empty()) files = { "Res/TRex.gem", "Res/teraccgda.gem", "Res/acacia_003.gem" };
+
+	printf("%-22s %10s %12s %12s %12s %12s %8s\n", "file", "MB", "stream best", "stream avg", "mapped best", "mapped avg", "speedup");
+	for (const std::string& file : files)
+	{
+		bool animated = false;
+		size_t bytes = 0;
+		{
+			FILE* f = fopen(file.c_str(), "rb");
+			if (f == nullptr)
+			{
+				printf("%s could not be opened\n", file.c_str());
+				return 1;
+			}
+			fseek(f, 0, SEEK_END);
+			bytes = static_cast<size_t>(ftell(f));
+			fclose(f);
+			GEMLoader::GEMMappedModel model;
+			model.open(file);
+			animated = model.animated;
+		}
+
+		LoadTiming stream, mapped;
+		uint32_t streamSum = 0, mappedSum = 0;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			{
+				GEMLoader::GEMModelLoader loader;
+				std::vector<GEMLoader::GEMMesh> meshes;
+				GEMLoader::GEMAnimation animation;
+				if (animated) loader.load(file, meshes, animation);
+				else loader.load(file, meshes);
+				streamSum = 0;
+				for (auto& mesh : meshes)
+				{
+					streamSum += mesh.isAnimated() ? touch(mesh.verticesAnimated.data(), mesh.verticesAnimated.size(), mesh.indices.data(), mesh.indices.size())
+						: touch(mesh.verticesStatic.data(), mesh.verticesStatic.size(), mesh.indices.data(), mesh.indices.size());
+				}
+			}
+			stream.add(benchElapsedMs(start));
+
+			start = std::chrono::steady_clock::now();
+			{
+				GEMLoader::GEMMappedModel model;
+				model.open(file);
+				mappedSum = 0;
+				for (auto& mesh : model.meshes)
+				{
+					mappedSum += mesh.isAnimated() ? touch(mesh.verticesAnimated.data, mesh.verticesAnimated.size, mesh.indices.data, mesh.indices.size)
+						: touch(mesh.verticesStatic.data, mesh.verticesStatic.size, mesh.indices.data, mesh.indices.size);
+				}
+			}
+			mapped.add(benchElapsedMs(start));
+		}
+		if (streamSum != mappedSum)
+		{
+			printf("%s: the loaders returned different data\n", file.c_str());
+			return 1;
+		}
+		size_t slash = file.find_last_of("/\\");
+		printf("%-22s %10.2f %12.3f %12.3f %12.3f %12.3f %7.2fx\n", file.substr(slash == std::string::npos ? 0 : slash + 1).c_str(), bytes / 1048576.0,
+			stream.best, stream.total / repetitions, mapped.best, mapped.total / repetitions, stream.best / mapped.best);
+	}
+	printf("times in ms per load over %d repetitions\n", repetitions);
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+//sim_bench modes, each one measures a single subsystem in isolation and prints its own table
+//a mode gets the command line that follows its name and returns the process exit code
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+typedef int (*BenchMode)(const std::vector<std::string>& args);
+
+struct BenchModeEntry
+{
+	const char* name;
+	const char* usage;
+	BenchMode run;
+};
+
+int benchGemLoad(const std::vector<std::string>& args);
+int benchAnimUpdate(const std::vector<std::string>& args);
+int benchPose(const std::vector<std::string>& args);
+int benchAnimJobs(const std::vector<std::string>& args);
+int benchAnimLOD(const std::vector<std::string>& args);
+int benchAnimClips(const std::vector<std::string>& args);
+int benchCrowd(const std::vector<std::string>& args);
+int benchTerrainMax(const std::vector<std::string>& args);
+int benchTerrainBuild(const std::vector<std::string>& args);
+int benchTerrainStorage(const std::vector<std::string>& args);
+int benchSpatialHash(const std::vector<std::string>& args);
+int benchSweepAndPrune(const std::vector<std::string>& args);
+int benchProfiler(const std::vector<std::string>& args);
+
+//the sim_bench scene loop, defined in sim_bench.cpp so modes can run it on a level of their own
+int runScene(const std::string& filename, int ticks, int threads, const std::string& traceFile);
+
+inline int benchArg(const std::vector<std::string>& args, size_t index, int fallback)
+{
+	return index < args.size() ? std::atoi(args[index].c_str()) : fallback;
+}
+
+inline double benchElapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
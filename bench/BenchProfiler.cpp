@@ -0,0 +1,78 @@
+//profiler overhead: an empty PROFILE_ZONE against the same loop without it, and the cost of exporting a full ring
+//a release build without GAME_PROFILER compiles the zones out, so both loops should then time the same
+#include "BenchModes.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+namespace
+{
+	//the loops store to it so neither one can be dropped
+	volatile int sink = 0;
+
+	double bareLoop(int count)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			sink = i;
+		}
+		return benchElapsedMs(start);
+	}
+
+	double zoneLoop(int count)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			PROFILE_ZONE("bench zone");
+			sink = i;
+		}
+		return benchElapsedMs(start);
+	}
+}
+
+int benchProfiler(const std::vector<std::string>& args)
+{
+	int count = benchArg(args, 0, 1000000);
+	int repetitions = benchArg(args, 1, 5);
+	std::string traceFile = args.size() > 2 ? args[2] : "profiler_bench.json";
+
+	//best of the repetitions, after a pass that gives the thread its ring buffer
+	zoneLoop(count);
+	double bareMs = 1e30;
+	double zoneMs = 1e30;
+	for (int r = 0; r < repetitions; r++)
+	{
+		bareMs = std::min(bareMs, bareLoop(count));
+		zoneMs = std::min(zoneMs, zoneLoop(count));
+	}
+
+	printf("%d zones, best of %d, profiler %s\n", count, repetitions, PROFILER_ENABLED ? "on" : "compiled out");
+	printf("bare loop             %10.3f ns per iteration\n", bareMs * 1e6 / count);
+	printf("empty zone            %10.3f ns per iteration\n", zoneMs * 1e6 / count);
+	printf("zone overhead         %10.3f ns\n", (zoneMs - bareMs) * 1e6 / count);
+#if PROFILER_ENABLED
+	//the ring is full after the loops, so this is the largest export a thread's zones can give
+	uint64_t clockStart = Profiler::now();
+	for (int i = 0; i < count; i++) sink = static_cast<int>(Profiler::now());
+	double clockNs = static_cast<double>(Profiler::now() - clockStart) / count;
+	auto start = std::chrono::steady_clock::now();
+	bool exported = Profiler::exportChromeTrace(traceFile);
+	double exportMs = benchElapsedMs(start);
+	if (!exported)
+	{
+		printf("could not write %s\n", traceFile.c_str());
+		return 1;
+	}
+	uintmax_t bytes = std::filesystem::file_size(traceFile);
+	printf("clock read            %10.3f ns\n", clockNs);
+	printf("export %d zones    %10.3f ms, %.1f MB to %s\n", std::min(count, Profiler::ringSize), exportMs, bytes / 1048576.0, traceFile.c_str());
+	Profiler::clear();
+#else
+	printf("export                  skipped, build with -DGAME_PROFILER=ON or a debug build to time it\n");
+#endif
+	return 0;
+}
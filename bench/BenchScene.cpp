@@ -0,0 +1,147 @@
+//crowd scene, the sim_bench scene loop on a generated level with a large NPC count
+//the generated level keeps the terrain and statics of the base level and lays the NPCs out on a grid,
+//cycling through the clips of the base level's NPC line, so the per-subsystem table and the profiler trace
+//show how the per-NPC lookups and updates scale with the crowd; after the scene the per-tick clip lookup is timed
+//with the string-keyed map the animation code used before clip handles, with findSequence and with the handle
+#include "BenchModes.h"
+#include "Object.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+	std::vector<std::string> splitLine(const std::string& line)
+	{
+		std::vector<std::string> tokens;
+		std::stringstream stream(line);
+		std::string token;
+		while (std::getline(stream, token, ',')) tokens.push_back(token);
+		return tokens;
+	}
+
+	//the clip lookups one NPC update did with string names: the name compare against the current clip, the copy on a
+	//change, the death compare and the two map lookups for frame and pose
+	struct LegacyLookup
+	{
+		std::map<std::string, int> sequences;
+		std::string current;
+
+		int lookup(const std::string& name)
+		{
+			if (name != current) current = name;
+			bool death = current == "death";
+			return sequences.at(current) + sequences.at(current) + (death ? 1 : 0);
+		}
+	};
+
+	void timeLookups(int npcs, int ticks, const std::vector<std::string>& clips)
+	{
+		std::vector<std::string> names(npcs);
+		std::vector<int> handles(npcs);
+		std::vector<LegacyLookup> legacy(npcs);
+		for (int i = 0; i < npcs; i++)
+		{
+			names[i] = clips[i % clips.size()];
+			handles[i] = NPC::animation.findSequence(names[i]);
+			for (size_t s = 0; s < NPC::animation.sequenceNames.size(); s++) legacy[i].sequences[NPC::animation.sequenceNames[s]] = static_cast<int>(s);
+		}
+
+		//the sum keeps the lookups from being optimised away
+		long long sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			for (int i = 0; i < npcs; i++) sum += legacy[i].lookup(names[i]);
+		}
+		double legacyMs = benchElapsedMs(start);
+		start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			for (int i = 0; i < npcs; i++) sum += NPC::animation.findSequence(names[i]);
+		}
+		double nameMs = benchElapsedMs(start);
+		start = std::chrono::steady_clock::now();
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			for (int i = 0; i < npcs; i++) sum += handles[i] + (handles[i] == NPC::animation.deathSequence ? 1 : 0);
+		}
+		double handleMs = benchElapsedMs(start);
+
+		double n = static_cast<double>(npcs) * ticks;
+		printf("clip lookup over %d npcs x %d ticks (checksum %lld)\n", npcs, ticks, sum);
+		printf("%-22s %12s %14s\n", "lookup", "total ms", "ns/npc/tick");
+		printf("%-22s %12.3f %14.1f\n", "string map (before)", legacyMs, legacyMs * 1e6 / n);
+		printf("%-22s %12.3f %14.1f\n", "findSequence", nameMs, nameMs * 1e6 / n);
+		printf("%-22s %12.3f %14.1f\n", "handle (after)", handleMs, handleMs * 1e6 / n);
+	}
+}
+
+int benchCrowd(const std::vector<std::string>& args)
+{
+	int npcs = benchArg(args, 0, 1000);
+	int ticks = benchArg(args, 1, 600);
+	int threads = benchArg(args, 2, 0);
+	std::string traceFile = args.size() > 3 ? args[3] : "";
+	std::string baseLevel = args.size() > 4 ? args[4] : "Input.txt";
+
+	std::ifstream base(baseLevel);
+	if (!base)
+	{
+		printf("could not open %s\n", baseLevel.c_str());
+		return 1;
+	}
+
+	//every NPC entry is position, rotation, scale and a clip name, after the model file
+	std::string npcModel;
+	std::vector<std::string> clips;
+	std::vector<std::string> keptLines;
+	std::string line;
+	while (std::getline(base, line))
+	{
+		std::vector<std::string> tokens = splitLine(line);
+		if (tokens.empty()) continue;
+		if (tokens[0] != "NPC")
+		{
+			keptLines.push_back(line);
+			continue;
+		}
+		if (npcModel.empty() && tokens.size() > 1) npcModel = tokens[1];
+		for (size_t i = 11; i < tokens.size(); i += 10) clips.push_back(tokens[i]);
+	}
+	if (npcModel.empty() || clips.empty())
+	{
+		printf("%s has no NPC line to take the model and clips from\n", baseLevel.c_str());
+		return 1;
+	}
+
+	std::filesystem::path level = std::filesystem::temp_directory_path() / ("sim_bench_crowd_" + std::to_string(npcs) + ".txt");
+	{
+		std::ofstream out(level);
+		for (const std::string& kept : keptLines) out << kept << "\n";
+		out << "NPC," << npcModel;
+		int columns = std::max(1, (int)std::ceil(std::sqrt((float)npcs)));
+		for (int i = 0; i < npcs; i++)
+		{
+			float x = 60.0f + 20.0f * (i % columns);
+			float z = 60.0f + 20.0f * (i / columns);
+			out << "," << x << ",0," << z << ",0," << (0.7f * i) << ",0,1,1,1," << clips[i % clips.size()];
+		}
+		out << "\n";
+		if (!out)
+		{
+			printf("could not write %s\n", level.string().c_str());
+			return 1;
+		}
+	}
+
+	printf("crowd of %d npcs from %s, %zu clips\n", npcs, baseLevel.c_str(), clips.size());
+	int result = runScene(level.string(), ticks, threads, traceFile);
+	if (result != 0) return result;
+	timeLookups(npcs, ticks, clips);
+	return 0;
+}
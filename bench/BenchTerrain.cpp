@@ -0,0 +1,283 @@
+//terrain benchmarks, all of them run on a height map loaded the way a level loads its terrain
+#include "BenchModes.h"
+#include "Object.h"
+#include "JobSystem.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace
+{
+	bool loadTerrain(const std::string& heightMap, Map& map)
+	{
+		std::vector<Vertex_Static> vertices;
+		std::vector<unsigned int> indices;
+		map.LoadHeightMap(heightMap, vertices, indices);
+		if (map.heightMap.empty())
+		{
+			printf("could not load %s\n", heightMap.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	//the scan GetMaxHeight replaced, every texel under the footprint
+	float scanMaxHeight(const Map& map, float minX, float minZ, float maxX, float maxZ)
+	{
+		int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+		int z0 = std::max(static_cast<int>(std::floor(minZ)), 0);
+		int x1 = std::min(static_cast<int>(std::ceil(maxX)), map.width - 1);
+		int z1 = std::min(static_cast<int>(std::ceil(maxZ)), map.height - 1);
+		uint16_t highest = 0;
+		for (int z = z0; z <= z1; z++)
+		{
+			for (int x = x0; x <= x1; x++) highest = std::max(highest, map.heightMap[z * map.width + x]);
+		}
+		return map.DecodeHeight(highest);
+	}
+}
+
+//GetMaxHeight by footprint size against the texel scan, on footprints placed at random inside the map
+int benchTerrainMax(const std::vector<std::string>& args)
+{
+	std::string heightMap = args.size() > 0 ? args[0] : "Res/HeightMap2.png";
+	int queries = benchArg(args, 1, 20000);
+	Map map;
+	if (!loadTerrain(heightMap, map)) return 1;
+
+	printf("%s: %dx%d, %d footprints per size\n", heightMap.c_str(), map.width, map.height, queries);
+	printf("%10s %16s %16s %10s\n", "footprint", "pyramid ns", "scan ns", "speedup");
+	for (int size = 1; size < std::min(map.width, map.height); size *= 2)
+	{
+		std::mt19937 random(size);
+		std::uniform_real_distribution<float> x(0.0f, static_cast<float>(map.width - 1 - size));
+		std::uniform_real_distribution<float> z(0.0f, static_cast<float>(map.height - 1 - size));
+		std::vector<float> corners(static_cast<size_t>(queries) * 2);
+		for (int i = 0; i < queries; i++)
+		{
+			corners[i * 2] = x(random);
+			corners[i * 2 + 1] = z(random);
+		}
+
+		//the sums keep the queries from being optimised away, and both paths have to agree
+		//one untimed pass of the scan first, so neither path is timed on a cold cache the other one warmed
+		double scanSum = 0.0;
+		for (int i = 0; i < queries; i++)
+		{
+			float minX = corners[i * 2];
+			float minZ = corners[i * 2 + 1];
+			scanSum += scanMaxHeight(map, minX, minZ, minX + size, minZ + size);
+		}
+		double pyramidSum = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < queries; i++)
+		{
+			float minX = corners[i * 2];
+			float minZ = corners[i * 2 + 1];
+			pyramidSum += map.GetMaxHeight(minX, minZ, minX + size, minZ + size);
+		}
+		double pyramidMs = benchElapsedMs(start);
+		double checkSum = scanSum;
+		scanSum = 0.0;
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < queries; i++)
+		{
+			float minX = corners[i * 2];
+			float minZ = corners[i * 2 + 1];
+			scanSum += scanMaxHeight(map, minX, minZ, minX + size, minZ + size);
+		}
+		double scanMs = benchElapsedMs(start);
+		if (pyramidSum != scanSum || scanSum != checkSum)
+		{
+			printf("footprint %d: pyramid and scan disagree (%f, %f)\n", size, pyramidSum, scanSum);
+			return 1;
+		}
+		printf("%10d %16.1f %16.1f %9.1fx\n", size, pyramidMs * 1e6 / queries, scanMs * 1e6 / queries, scanMs / pyramidMs);
+	}
+	return 0;
+}
+
+//LoadHeightMap by map size on a 1 thread job system and on one with every hardware thread,
+//the maps are rolling .r16 terrain written to the temp directory so any size can be built
+int benchTerrainBuild(const std::vector<std::string>& args)
+{
+	int repetitions = std::max(benchArg(args, 0, 3), 1);
+	std::vector<int> sides;
+	for (size_t i = 1; i < args.size(); i++) sides.push_back(std::max(std::atoi(args[i].c_str()), 2));
+	if (sides.empty()) sides = { 257, 513, 1025, 2049 };
+
+	JobSystem serial(1);
+	JobSystem parallel(0);
+	printf("best of %d builds, %d hardware threads\n", repetitions, parallel.threadCount());
+	printf("%8s %12s %12s %14s %14s %12s %10s\n", "side", "vertices", "indices", "1 thread ms", "N threads ms", "ns/vertex", "speedup");
+	for (int side : sides)
+	{
+		std::filesystem::path file = std::filesystem::temp_directory_path() / ("sim_bench_terrain_" + std::to_string(side) + ".r16");
+		{
+			std::ofstream out(file, std::ios::binary | std::ios::trunc);
+			for (int z = 0; z < side; z++)
+			{
+				for (int x = 0; x < side; x++)
+				{
+					float h = 0.5f + 0.25f * std::sin(x * 0.05f) * std::cos(z * 0.03f) + 0.2f * std::sin((x + z) * 0.011f);
+					uint16_t sample = static_cast<uint16_t>(std::clamp(h, 0.0f, 1.0f) * 65535.0f);
+					out.put(static_cast<char>(sample & 0xFF));
+					out.put(static_cast<char>(sample >> 8));
+				}
+			}
+		}
+
+		double best[2] = { 1e30, 1e30 };
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		for (int r = 0; r < repetitions; r++)
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				Map map;
+				std::vector<Vertex_Static> vertices;
+				std::vector<unsigned int> indices;
+				auto start = std::chrono::steady_clock::now();
+				map.LoadHeightMap(file.string(), vertices, indices, k == 0 ? &serial : &parallel);
+				best[k] = std::min(best[k], benchElapsedMs(start));
+				vertexCount = vertices.size();
+				indexCount = indices.size();
+			}
+		}
+		std::filesystem::remove(file);
+		printf("%8d %12zu %12zu %14.1f %14.1f %12.1f %9.2fx\n", side, vertexCount, indexCount, best[0], best[1], best[0] * 1e6 / vertexCount, best[0] / best[1]);
+	}
+	return 0;
+}
+
+namespace
+{
+	//the file's samples as world heights, read without Map so the stored samples can be checked against them
+	bool readSourceHeights(const std::string& file, int& width, int& height, std::vector<float>& heights, float& sourceStep)
+	{
+		sourceStep = 1.0f / 256.0f;
+		std::string extension = file.substr(std::min(file.find_last_of('.'), file.size()));
+		if (extension == ".r16" || extension == ".raw")
+		{
+			std::ifstream in(file, std::ios::binary | std::ios::ate);
+			size_t samples = in ? static_cast<size_t>(in.tellg()) / 2 : 0;
+			width = height = static_cast<int>(std::lround(std::sqrt(static_cast<double>(samples))));
+			std::vector<unsigned char> bytes(samples * 2);
+			in.seekg(0);
+			in.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+			heights.resize(samples);
+			for (size_t i = 0; i < samples; i++) heights[i] = static_cast<float>(bytes[i * 2] | (bytes[i * 2 + 1] << 8)) / 256.0f;
+			return static_cast<bool>(in) && samples > 0;
+		}
+		int channels = 0;
+		if (stbi_is_16_bit(file.c_str()))
+		{
+			stbi_us* data = stbi_load_16(file.c_str(), &width, &height, &channels, 1);
+			if (!data) return false;
+			heights.resize(static_cast<size_t>(width) * height);
+			for (size_t i = 0; i < heights.size(); i++) heights[i] = static_cast<float>(data[i]) / 256.0f;
+			stbi_image_free(data);
+			return true;
+		}
+		unsigned char* data = stbi_load(file.c_str(), &width, &height, &channels, 1);
+		if (!data) return false;
+		sourceStep = 1.0f;
+		heights.resize(static_cast<size_t>(width) * height);
+		for (size_t i = 0; i < heights.size(); i++) heights[i] = static_cast<float>(data[i]);
+		stbi_image_free(data);
+		return true;
+	}
+}
+
+//memory per texel of the stored terrain against the float layout it replaced, and how far the stored heights and
+//normals are from the file's heights and float normals built from them
+//the default second map is a low relief .r16 written to the temp directory, where the fitted range matters most
+int benchTerrainStorage(const std::vector<std::string>& args)
+{
+	std::vector<std::string> files(args.begin(), args.end());
+	if (files.empty())
+	{
+		std::filesystem::path lowRelief = std::filesystem::temp_directory_path() / "sim_bench_low_relief.r16";
+		std::ofstream out(lowRelief, std::ios::binary | std::ios::trunc);
+		for (int z = 0; z < 513; z++)
+		{
+			for (int x = 0; x < 513; x++)
+			{
+				uint16_t sample = static_cast<uint16_t>(30000 + 200.0f * std::sin(x * 0.02f) * std::cos(z * 0.017f));
+				out.put(static_cast<char>(sample & 0xFF));
+				out.put(static_cast<char>(sample >> 8));
+			}
+		}
+		files = { "Res/HeightMap2.png", lowRelief.string() };
+	}
+
+	for (const std::string& file : files)
+	{
+		Map map;
+		if (!loadTerrain(file, map)) return 1;
+		int width = 0, height = 0;
+		std::vector<float> source;
+		float sourceStep = 0.0f;
+		if (!readSourceHeights(file, width, height, source, sourceStep) || width != map.width || height != map.height)
+		{
+			printf("could not read the samples of %s\n", file.c_str());
+			return 1;
+		}
+		size_t texels = source.size();
+
+		//the pyramid levels BuildHeightPyramid makes
+		size_t pyramidTexels = 0;
+		for (int w = width, h = height; w > 1 || h > 1;)
+		{
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			pyramidTexels += static_cast<size_t>(w) * h;
+		}
+		double packed = (map.heightMap.size() * sizeof(uint16_t) + map.normals.size() * sizeof(uint16_t) + pyramidTexels * sizeof(uint16_t)) / static_cast<double>(texels);
+		double floats = (texels * (sizeof(float) + sizeof(DirectX::XMFLOAT3)) + pyramidTexels * sizeof(float)) / static_cast<double>(texels);
+
+		float low = *std::min_element(source.begin(), source.end());
+		float high = *std::max_element(source.begin(), source.end());
+		double heightError = 0.0;
+		double maxHeightError = 0.0;
+		double normalError = 0.0;
+		double maxNormalError = 0.0;
+		for (int z = 0; z < height; z++)
+		{
+			int z0 = std::max(z - 1, 0);
+			int z1 = std::min(z + 1, height - 1);
+			for (int x = 0; x < width; x++)
+			{
+				size_t i = static_cast<size_t>(z) * width + x;
+				double e = std::fabs(map.DecodeHeight(map.heightMap[i]) - source[i]);
+				heightError += e;
+				maxHeightError = std::max(maxHeightError, e);
+
+				//the float normal LoadHeightMap would store without packing
+				int x0 = std::max(x - 1, 0);
+				int x1 = std::min(x + 1, width - 1);
+				float dx = (source[z * width + x1] - source[z * width + x0]) / static_cast<float>(std::max(x1 - x0, 1));
+				float dz = (source[z1 * width + x] - source[z0 * width + x]) / static_cast<float>(std::max(z1 - z0, 1));
+				DirectX::XMFLOAT3 exact;
+				DirectX::XMStoreFloat3(&exact, DirectX::XMVector3Normalize(DirectX::XMVectorSet(-dx, 1.0f, -dz, 0.0f)));
+				DirectX::XMFLOAT3 stored = unpackOctahedral(map.normals[i]);
+				float cosine = std::min(1.0f, exact.x * stored.x + exact.y * stored.y + exact.z * stored.z);
+				double degrees = std::acos(cosine) * 180.0 / 3.14159265358979;
+				normalError += degrees;
+				maxNormalError = std::max(maxNormalError, degrees);
+			}
+		}
+
+		printf("%s: %dx%d, heights %.4f to %.4f\n", file.c_str(), width, height, low, high);
+		printf("  fitted offset %.6f, step %.8f (%.1f steps per source step), %u of 65535 stored steps used\n", map.heightOffset, map.heightScale,
+			sourceStep / map.heightScale, static_cast<unsigned int>(*std::max_element(map.heightMap.begin(), map.heightMap.end())));
+		printf("  memory %.2f bytes per texel, %.2f with float heights, normals and pyramid (%.1fx)\n", packed, floats, floats / packed);
+		printf("  height error %.3g mean, %.3g max world units\n", heightError / texels, maxHeightError);
+		printf("  normal error %.3f mean, %.3f max degrees\n", normalError / texels, maxNormalError);
+	}
+	return 0;
+}
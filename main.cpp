@@ -3,11 +3,12 @@
 #include "Window.h"
 #include "Timer.h"
 #include "Object.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <cmath>
 #include <sstream>
 #include <string>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 extern "C" {
 	_declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;
 }
@@ -24,10 +25,12 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 	Map map;
 	Player player;
 	window.player = &player;
+	JobSystem jobSystem;
+	PROFILE_THREAD_NAME("main");
 
 	//load from file
 	std::string filename = "Input.txt";
-	meshManager.loadlevel(filename,objectManager,map);
+	meshManager.loadlevel(filename,objectManager,map,&jobSystem);
 	
 	//set player initial position
 	map.CheckVerticalCollision_Player(player);
@@ -35,6 +38,17 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 	//initialize renderer
 	renderer.Initialize(window, meshManager);
 
+	//a BakedAnimation,1 line in the level file skins NPCs from poses baked at load instead of evaluating them every frame
+	const bool bakedAnimation = meshManager.options.bakedAnimation;
+	float animationClock = 0.0f;
+	if (bakedAnimation) {
+		NPC::bakedAnimation.bake(NPC::animation, 60.0f);
+		renderer.setBakedAnimation(NPC::bakedAnimation);
+		for (auto& npc : objectManager.npcs) {
+			npc.bakedState = { npc.animationInstance.sequence, 0.0f };
+		}
+	}
+
 	//initialize texture
 	for (auto& pair : meshManager.objects)
 	{
@@ -66,32 +80,41 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 	renderer.updataLightingConstantBuffer(lighting);
 
 	float dt;
+	std::vector<TerrainDraw> terrainDraws;
     while (true)
     {
 		//return true if the message is WM_QUIT
 		if (window.processMessages()) break;
+		PROFILE_ZONE("frame");
 		//update dt
 		dt = timer.dt();
 
 		//update player
-		player.move(window, dt,map,objectManager);
+		map.UpdateTerrainStreaming(player.position.x, player.position.z);
+		player.move(window.keys, dt,map,objectManager);
 		map.CheckVerticalCollision_Player(player);
 
-		int i = 0;
-		//update bones and check collision with player
-		for (auto& npc : objectManager.npcs)
-		{
-			if (npc.isAlive && npc.checkCollisionWithPlayer(player)) {
-				npc.isAlive = false;
-				npc.animationInstance.update("death", 0.0f);
-			}
-			else {
-				npc.animationInstance.update(npc.animationInstance.sequenceName, dt);
+		if (bakedAnimation) {
+			//an NPC only moves its BoneOffset to the baked frame it is on
+			animationClock += dt;
+			int deathSequence = NPC::animation.deathSequence;
+			objectManager.findNPCsNearPlayer(player);
+			int npcInstances = meshManager.objects["NPC"].instanceOffset;
+			for (int i = 0; i < static_cast<int>(objectManager.npcs.size()); i++)
+			{
+				NPC& npc = objectManager.npcs[i];
+				if (npc.isAlive && objectManager.nearPlayer[i] && npc.checkCollisionWithPlayer(player)) {
+					npc.isAlive = false;
+					if (deathSequence >= 0) npc.bakedState = { deathSequence, animationClock };
+				}
+				meshManager.instances[npcInstances + i].BoneOffset = NPC::bakedAnimation.boneOffset(npc.bakedState, animationClock);
 			}
-			meshManager.updateBonesVector(npc.animationInstance.BonesTransforms,i);
-			i++;
 		}
-		renderer.updataBonesBuffer(meshManager.bonesVector);
+		else {
+			//update bones and check collision with player
+			objectManager.updateNPCs(player, dt, meshManager, jobSystem);
+			renderer.updataBonesBuffer(meshManager.bonePalette.data);
+		}
 
 		//update V
 		DirectX::XMVECTOR eye = DirectX::XMLoadFloat3(&player.position);
@@ -100,6 +123,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 		//DirectX::XMVECTOR up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 		DirectX::XMMATRIX viewMatrix = DirectX::XMMatrixLookToLH (eye, player.forward, player.up);
 		DirectX::XMMATRIX skyboxViewMatrix = viewMatrix;
+		DirectX::XMMATRIX cullViewMatrix = viewMatrix;
 		viewMatrix = DirectX::XMMatrixTranspose(viewMatrix);
 
 		//update P
@@ -107,7 +131,14 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 		float aspectRatio = static_cast<float>(window.width) / static_cast<float>(window.height);
 		float nearZ = 0.1f;
 		float farZ = 2000.0f;
-		DirectX::XMMATRIX projectionMatrix = DirectX::XMMatrixTranspose(DirectX::XMMatrixPerspectiveFovLH(fov, aspectRatio, nearZ, farZ));
+		DirectX::XMMATRIX cullProjectionMatrix = DirectX::XMMatrixPerspectiveFovLH(fov, aspectRatio, nearZ, farZ);
+		DirectX::XMMATRIX projectionMatrix = DirectX::XMMatrixTranspose(cullProjectionMatrix);
+
+		//pick terrain chunks and LODs, the stored instance W is transposed
+		DirectX::XMMATRIX terrainWorld = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&meshManager.instances[meshManager.objects["Terrain"].instanceOffset].W));
+		DirectX::XMFLOAT3 terrainEye;
+		DirectX::XMStoreFloat3(&terrainEye, DirectX::XMVector3TransformCoord(eye, DirectX::XMMatrixInverse(nullptr, terrainWorld)));
+		map.terrainChunks.Select(terrainWorld * cullViewMatrix * cullProjectionMatrix, terrainEye, terrainDraws);
 		DirectX::XMMATRIX VP = projectionMatrix * viewMatrix;
 
 		DirectX::XMFLOAT4X4 VPF;
@@ -124,10 +155,12 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 		renderer.updateSkyboxConstantBuffer(skyboxVPF);
 
 
-		renderer.Render(meshManager);
+		renderer.Render(meshManager, terrainDraws);
 
 		renderer.present();
 
     }
+	//the last frames of a profiling build, open in chrome://tracing or ui.perfetto.dev
+	PROFILE_EXPORT("trace.json");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,208 @@
+//headless simulation benchmark
+//loads a level, drives the player with a scripted input stream for a fixed number of ticks and runs the same
+//per-frame gameplay work as main.cpp without a window or a GPU, then prints per-subsystem timings
+//usage: sim_bench [level file] [ticks] [threads] [trace file]
+//       sim_bench <mode> [mode arguments], runs one of the subsystem benchmarks in bench/ instead of the scene
+//       sim_bench modes, lists them
+#include "Object.h"
+#include "bench/BenchModes.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Timer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+	//one step of the scripted input, held for a number of ticks
+	struct InputStep
+	{
+		const char* keys;
+		float mouseDx;
+		float mouseDy;
+		int ticks;
+	};
+
+	const InputStep script[] = {
+		{ "W", 0.0f, 0.0f, 240 },
+		{ "WD", 0.004f, 0.0f, 120 },
+		{ "A", 0.0f, 0.001f, 60 },
+		{ "S", -0.006f, -0.001f, 120 },
+		{ "", 0.02f, 0.0f, 60 },
+		{ "WA", 0.0f, 0.0f, 200 },
+	};
+
+	struct Subsystem
+	{
+		const char* name;
+		double total = 0.0;
+		double worst = 0.0;
+
+		void add(double ms)
+		{
+			total += ms;
+			if (ms > worst) worst = ms;
+		}
+	};
+
+	const BenchModeEntry benchModes[] = {
+		{ "gem-load", "[repetitions] [gem files...]", benchGemLoad },
+		{ "anim-update", "[level file] [updates per count] [instance counts...]", benchAnimUpdate },
+		{ "pose", "[level file] [repetitions]", benchPose },
+		{ "anim-jobs", "[level file] [instances] [ticks] [max threads]", benchAnimJobs },
+		{ "anim-lod", "[level file] [ticks] [instance counts...]", benchAnimLOD },
+		{ "anim-clips", "[level file] [samples per clip]", benchAnimClips },
+		{ "crowd", "[npcs] [ticks] [threads] [trace file] [base level]", benchCrowd },
+		{ "terrain-max", "[height map] [footprints per size]", benchTerrainMax },
+		{ "terrain-build", "[repetitions] [map sides...]", benchTerrainBuild },
+		{ "terrain-storage", "[height maps...]", benchTerrainStorage },
+		{ "spatial-hash", "[queries] [item counts...]", benchSpatialHash },
+		{ "sweep-and-prune", "[agents] [ticks]", benchSweepAndPrune },
+		{ "profiler", "[zones] [repetitions] [trace file]", benchProfiler },
+	};
+}
+
+int runScene(const std::string& filename, int ticks, int threads, const std::string& traceFile)
+{
+	const float dt = 1.0f / 60.0f;
+
+	MeshManager meshManager;
+	ObjectManager objectManager;
+	Map map;
+	Player player;
+	JobSystem jobSystem(threads);
+	PROFILE_THREAD_NAME("main");
+
+	Timer timer;
+	std::string level = filename;
+	meshManager.loadlevel(level, objectManager, map, &jobSystem);
+	float loadTime = timer.time();
+	map.CheckVerticalCollision_Player(player);
+
+	Subsystem player_ = { "player" };
+	Subsystem npcs = { "npc animation" };
+	Subsystem broadPhase = { "broad phase" };
+	Subsystem terrain = { "terrain select" };
+	Subsystem visibility = { "npc visibility" };
+
+	bool keys[256] = {};
+	int step = 0;
+	int stepTick = 0;
+	int stepCount = static_cast<int>(sizeof(script) / sizeof(script[0]));
+	std::vector<TerrainDraw> terrainDraws;
+	size_t pairCount = 0;
+	size_t drawnIndices = 0;
+	//line of sight from every living NPC's eyes to the player
+	const float eyeHeight = 5.0f;
+	std::vector<TerrainRay> sightRays;
+	std::vector<TerrainHit> sightHits;
+	size_t raysCast = 0;
+	size_t raysClear = 0;
+
+	for (int tick = 0; tick < ticks; tick++)
+	{
+		//advance the script, it loops once it runs out
+		const InputStep& input = script[step];
+		for (bool& key : keys) key = false;
+		for (const char* c = input.keys; *c; c++) keys[static_cast<unsigned char>(*c)] = true;
+		player.updateCamera(input.mouseDx, input.mouseDy);
+		if (++stepTick >= input.ticks)
+		{
+			stepTick = 0;
+			step = (step + 1) % stepCount;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		map.UpdateTerrainStreaming(player.position.x, player.position.z);
+		player.move(keys, dt, map, objectManager);
+		map.CheckVerticalCollision_Player(player);
+		player_.add(benchElapsedMs(start));
+
+		//same work as the frame loop in main.cpp
+		start = std::chrono::steady_clock::now();
+		objectManager.updateNPCs(player, dt, meshManager, jobSystem);
+		npcs.add(benchElapsedMs(start));
+
+		start = std::chrono::steady_clock::now();
+		pairCount += objectManager.updateBroadPhase().size();
+		broadPhase.add(benchElapsedMs(start));
+
+		start = std::chrono::steady_clock::now();
+		DirectX::XMVECTOR eye = DirectX::XMLoadFloat3(&player.position);
+		DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH(eye, player.forward, player.up);
+		DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(DirectX::XMConvertToRadians(45.0f), 1920.0f / 1080.0f, 0.1f, 2000.0f);
+		DirectX::XMMATRIX terrainWorld = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&meshManager.instances[meshManager.objects["Terrain"].instanceOffset].W));
+		DirectX::XMFLOAT3 terrainEye;
+		DirectX::XMStoreFloat3(&terrainEye, DirectX::XMVector3TransformCoord(eye, DirectX::XMMatrixInverse(nullptr, terrainWorld)));
+		map.terrainChunks.Select(terrainWorld * view * projection, terrainEye, terrainDraws);
+		for (auto& draw : terrainDraws) drawnIndices += draw.indexCount;
+		terrain.add(benchElapsedMs(start));
+
+		start = std::chrono::steady_clock::now();
+		sightRays.clear();
+		for (const NPC& npc : objectManager.npcs)
+		{
+			if (!npc.isAlive) continue;
+			TerrainRay ray;
+			ray.origin = { npc.position.x, npc.position.y + eyeHeight, npc.position.z };
+			ray.direction = { player.position.x - ray.origin.x, player.position.y - ray.origin.y, player.position.z - ray.origin.z };
+			ray.maxDistance = std::sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z);
+			sightRays.push_back(ray);
+		}
+		map.RaycastBatch(sightRays, sightHits, jobSystem);
+		raysCast += sightHits.size();
+		for (const TerrainHit& hit : sightHits) raysClear += hit.hit ? 0 : 1;
+		visibility.add(benchElapsedMs(start));
+	}
+
+	int alive = 0;
+	for (auto& npc : objectManager.npcs) alive += npc.isAlive ? 1 : 0;
+
+	printf("level %s: %zu npcs, %zu objects, loaded in %.1f ms\n", filename.c_str(), objectManager.npcs.size(), objectManager.objects.size(), loadTime * 1000.0f);
+	printf("%d ticks on %d threads\n", ticks, jobSystem.threadCount());
+	printf("%-16s %12s %12s %12s\n", "subsystem", "total ms", "avg us/tick", "worst us");
+	double total = 0.0;
+	for (Subsystem* s : { &player_, &npcs, &broadPhase, &terrain, &visibility })
+	{
+		printf("%-16s %12.3f %12.3f %12.3f\n", s->name, s->total, ticks > 0 ? s->total * 1000.0 / ticks : 0.0, s->worst * 1000.0);
+		total += s->total;
+	}
+	printf("%-16s %12.3f %12.3f\n", "all", total, ticks > 0 ? total * 1000.0 / ticks : 0.0);
+	uint64_t hits = NPC::poseCache.hits;
+	uint64_t misses = NPC::poseCache.misses;
+	printf("pose cache: %llu hits, %llu misses\n", static_cast<unsigned long long>(hits), static_cast<unsigned long long>(misses));
+	printf("npc visibility: %zu of %zu rays clear, %.0f rays/s\n", raysClear, raysCast, visibility.total > 0.0 ? raysCast * 1000.0 / visibility.total : 0.0);
+	//lets two runs be compared for identical behaviour
+	printf("final player (%.3f, %.3f, %.3f), npcs alive %d, overlap pairs %zu, terrain triangles %zu\n",
+		player.position.x, player.position.y, player.position.z, alive, pairCount, drawnIndices / 3);
+	if (!traceFile.empty()) {
+#if PROFILER_ENABLED
+		printf(Profiler::exportChromeTrace(traceFile) ? "trace written to %s\n" : "could not write %s\n", traceFile.c_str());
+#else
+		printf("built without the profiler, define GAME_PROFILER to record %s\n", traceFile.c_str());
+#endif
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+	{
+		std::string mode = argv[1];
+		if (mode == "modes")
+		{
+			for (const BenchModeEntry& entry : benchModes) printf("sim_bench %s %s\n", entry.name, entry.usage);
+			return 0;
+		}
+		for (const BenchModeEntry& entry : benchModes)
+		{
+			if (mode == entry.name) return entry.run(std::vector<std::string>(argv + 2, argv + argc));
+		}
+	}
+	return runScene(argc > 1 ? argv[1] : "Input.txt", argc > 2 ? std::atoi(argv[2]) : 1000, argc > 3 ? std::atoi(argv[3]) : 0, argc > 4 ? argv[4] : "");
+}
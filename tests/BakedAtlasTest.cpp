@@ -0,0 +1,114 @@
+//the baked half atlas against live AnimationInstance::update on every TRex clip: ticking an instance at the bake
+//rate, the atlas frame for the instance's clip time must hold the instance's pose to half precision,
+//and the clock mapping must wrap loops and hold the death clip's last frame
+//a level's BakedAnimation line turns the mode on for main.cpp whether the level is parsed or read from its cache
+#include "LevelCache.h"
+#include "Object.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+namespace
+{
+	const char* levelFile = "BakedAtlasTest.txt";
+
+	//halfs keep 11 significant bits, the sampling itself is the same code on both sides
+	bool closeEnough(float live, float baked)
+	{
+		return std::fabs(live - baked) <= 1.0f / 1024.0f * std::max(1.0f, std::fabs(live));
+	}
+}
+
+int main()
+{
+	{
+		std::ofstream level(levelFile, std::ios::trunc);
+		level << "NPC," << GAME_SOURCE_DIR << "/Res/TRex.gem,100,0,50,0,0,0,1,1,1,Idle\n";
+		level << "BakedAnimation,1\n";
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	//the mode is read on the parsed load, on the cached one, and again once the line turns it off
+	for (int pass = 0; pass < 3; pass++)
+	{
+		if (pass == 2)
+		{
+			std::ofstream level(levelFile, std::ios::trunc);
+			level << "NPC," << GAME_SOURCE_DIR << "/Res/TRex.gem,100,0,50,0,0,0,1,1,1,Idle\n";
+			level << "BakedAnimation,0\n";
+		}
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		std::string filename = levelFile;
+		meshManager.loadlevel(filename, objectManager, map);
+		CHECK(meshManager.options.bakedAnimation == (pass < 2));
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::filesystem::remove(levelFile);
+	Animation& animation = NPC::animation;
+	CHECK(!animation.sequences.empty());
+	if (animation.sequences.empty()) return testResult();
+	int bones = static_cast<int>(animation.skeleton.bones.size());
+
+	const float rate = 60.0f;
+	const float dt = 1.0f / rate;
+	BakedAnimation baked;
+	baked.bake(animation, rate);
+	CHECK(baked.boneCount == bones);
+	CHECK(baked.clips.size() == animation.sequences.size());
+	CHECK(baked.sizeInBytes() == static_cast<size_t>(baked.frameCount()) * bones * 12 * 2);
+
+	std::vector<DirectX::XMFLOAT4X4> decoded(bones);
+	int compared = 0;
+	int mismatches = 0;
+	float worst = 0.0f;
+	for (int clip = 0; clip < static_cast<int>(animation.sequences.size()); clip++)
+	{
+		const BakedAnimation::Clip& bakedClip = baked.clips[clip];
+		bool death = clip == animation.deathSequence;
+		CHECK(bakedClip.loop == !death);
+
+		//full rate and every bone, like the bake
+		AnimationInstance instance;
+		instance.animation = &animation;
+		instance.setLOD(static_cast<int>(animation.lodLevels.size()), 0);
+		instance.update(clip, 0.0f);
+		int ticks = static_cast<int>(std::ceil(bakedClip.duration * rate * 2.5f)) + 2;
+		for (int tick = 0; tick < ticks; tick++)
+		{
+			if (tick > 0) instance.update(clip, dt);
+			//a finished death clip keeps its last pose, which the atlas holds from the clip's end on
+			if (!instance.poseChanged) continue;
+			//a loop's instant at its duration is shown as its first frame again, the live clip has not wrapped yet
+			if (bakedClip.loop && instance.time * rate + 0.5f >= static_cast<float>(bakedClip.frameCount)) continue;
+
+			baked.decode(baked.frameIndex({ clip, 0.0f }, instance.time), decoded);
+			compared++;
+			bool same = true;
+			for (int b = 0; b < bones; b++)
+			{
+				for (int k = 0; k < 12; k++)
+				{
+					float live = (&instance.BonesTransforms[b]._11)[k];
+					float atlas = (&decoded[b]._11)[k];
+					worst = std::max(worst, std::fabs(live - atlas) / std::max(1.0f, std::fabs(live)));
+					same = same && closeEnough(live, atlas);
+				}
+			}
+			if (!same) mismatches++;
+		}
+
+		//clock mapping: loops wrap with their duration, the death clip stops on its last frame
+		int first = baked.frameIndex({ clip, 10.0f }, 10.0f);
+		CHECK(first == bakedClip.firstFrame);
+		int late = baked.frameIndex({ clip, 0.0f }, bakedClip.duration * 3.0f + 0.25f * dt);
+		CHECK(late == (death ? bakedClip.firstFrame + bakedClip.frameCount - 1 : bakedClip.firstFrame));
+		CHECK(baked.boneOffset({ clip, 0.0f }, 0.0f) == bakedClip.firstFrame * bones);
+	}
+	CHECK(compared > 100);
+	CHECK(mismatches == 0);
+	printf("%d poses compared, %d outside tolerance, worst relative difference %g\n", compared, mismatches, worst);
+	CHECK(baked.frameIndex({ -1, 0.0f }, 1.0f) == 0);
+	return testResult();
+}
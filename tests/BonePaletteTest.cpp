@@ -0,0 +1,122 @@
+//the palette must hold each bone as the first three rows of its matrix at float4 (offset + id) * 3, which is what
+//the dynamic vertex shader loads, and one instance's range must never reach into its neighbours
+#include "BonePalette.h"
+#include "TestCheck.h"
+#include <cmath>
+
+namespace
+{
+	//a pose matrix the way the animation code stores it, transposed so the translation sits in the fourth column
+	DirectX::XMFLOAT4X4 boneMatrix(int instance, int bone)
+	{
+		float a = 0.1f * bone + 0.7f * instance;
+		DirectX::XMMATRIX m = DirectX::XMMatrixScaling(1.0f + 0.01f * bone, 0.9f, 1.1f) *
+			DirectX::XMMatrixRotationRollPitchYaw(a, 0.5f * a, -a) *
+			DirectX::XMMatrixTranslation(10.0f * instance, static_cast<float>(bone), -3.0f);
+		DirectX::XMFLOAT4X4 out;
+		DirectX::XMStoreFloat4x4(&out, DirectX::XMMatrixTranspose(m));
+		return out;
+	}
+
+	std::vector<DirectX::XMFLOAT4X4> pose(int instance, int bones)
+	{
+		std::vector<DirectX::XMFLOAT4X4> out;
+		for (int b = 0; b < bones; b++) out.push_back(boneMatrix(instance, b));
+		return out;
+	}
+
+	//getBoneTransform in VertexShader_Dynamic.hlsl: three float4 loads, a (0,0,0,1) last row, then transpose
+	DirectX::XMFLOAT4X4 shaderBone(const BonePalette& palette, int boneID, int boneOffset)
+	{
+		const float* base = palette.data.data() + static_cast<size_t>(boneOffset + boneID) * 3 * 4;
+		DirectX::XMFLOAT4X4 rows;
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 4; c++) rows.m[r][c] = base[r * 4 + c];
+		}
+		rows.m[3][0] = 0.0f;
+		rows.m[3][1] = 0.0f;
+		rows.m[3][2] = 0.0f;
+		rows.m[3][3] = 1.0f;
+		DirectX::XMFLOAT4X4 out;
+		DirectX::XMStoreFloat4x4(&out, DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&rows)));
+		return out;
+	}
+
+	bool sameRows(const BonePalette& palette, int instance, int bone, const DirectX::XMFLOAT4X4& expected)
+	{
+		const float* stored = palette.data.data() + static_cast<size_t>(palette.offsets[instance] + bone) * BonePalette::floatsPerBone;
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				if (stored[r * 4 + c] != expected.m[r][c]) return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	const int counts[] = { 44, 3, 0, 17, 1 };
+	BonePalette palette;
+	int expectedOffset = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		CHECK(palette.allocate(counts[i]) == i);
+		CHECK(palette.offsets[i] == expectedOffset);
+		CHECK(palette.boneCounts[i] == counts[i]);
+		expectedOffset += counts[i];
+	}
+	CHECK(palette.allocate(-4) == 5);
+	CHECK(palette.boneCounts[5] == 0);
+	CHECK(palette.instanceCount() == 6);
+	CHECK(palette.totalBones() == expectedOffset);
+	CHECK(palette.sizeInBytes() == static_cast<size_t>(expectedOffset) * 12 * sizeof(float));
+
+	//every instance gets two extra bones, which must be dropped instead of spilling into the next range
+	for (int i = 0; i < 5; i++) palette.write(i, pose(i, counts[i] + 2));
+	for (int i = 0; i < 5; i++)
+	{
+		for (int b = 0; b < counts[i]; b++) CHECK(sameRows(palette, i, b, boneMatrix(i, b)));
+	}
+
+	//the shader's rebuilt matrix places a vertex where the full 4x4 pose matrix does
+	const DirectX::XMFLOAT4 vertex(0.3f, -1.2f, 2.5f, 1.0f);
+	for (int i = 0; i < 5; i++)
+	{
+		for (int b = 0; b < counts[i]; b++)
+		{
+			DirectX::XMFLOAT4X4 full = boneMatrix(i, b);
+			DirectX::XMFLOAT4X4 rebuilt = shaderBone(palette, b, palette.offsets[i]);
+			DirectX::XMFLOAT4 expected, skinned;
+			DirectX::XMStoreFloat4(&expected, DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&vertex), DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&full))));
+			DirectX::XMStoreFloat4(&skinned, DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&vertex), DirectX::XMLoadFloat4x4(&rebuilt)));
+			CHECK(std::fabs(expected.x - skinned.x) < 1e-4f);
+			CHECK(std::fabs(expected.y - skinned.y) < 1e-4f);
+			CHECK(std::fabs(expected.z - skinned.z) < 1e-4f);
+			CHECK(skinned.w == 1.0f);
+		}
+	}
+
+	//a short pose only overwrites the front of its range
+	palette.write(0, pose(9, 2));
+	CHECK(sameRows(palette, 0, 0, boneMatrix(9, 0)));
+	CHECK(sameRows(palette, 0, 1, boneMatrix(9, 1)));
+	CHECK(sameRows(palette, 0, 2, boneMatrix(0, 2)));
+	CHECK(sameRows(palette, 1, 0, boneMatrix(1, 0)));
+
+	//growing the palette keeps the ranges already written
+	palette.allocate(100);
+	CHECK(palette.offsets[6] == expectedOffset);
+	CHECK(sameRows(palette, 3, 16, boneMatrix(3, 16)));
+	CHECK(sameRows(palette, 4, 0, boneMatrix(4, 0)));
+
+	palette.clear();
+	CHECK(palette.instanceCount() == 0);
+	CHECK(palette.totalBones() == 0);
+	CHECK(palette.allocate(5) == 0);
+	CHECK(palette.offsets[0] == 0);
+	return testResult();
+}
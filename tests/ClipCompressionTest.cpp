@@ -0,0 +1,116 @@
+//CompressedClip against the raw frames it was built from: every frame, kept keys included, and the points halfway
+//between frames must stay within the settings' error, also on channels whose range is too wide for 16 bit keys
+#include "ClipCompression.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+namespace
+{
+	const int frames = 150;
+	const int bones = 7;
+	const int boneStride = 8;
+
+	struct Clip
+	{
+		std::vector<DirectX::XMFLOAT4A> positions;
+		std::vector<DirectX::XMFLOAT4A> quaternions;
+		std::vector<DirectX::XMFLOAT4A> scales;
+	};
+
+	//bone 0 walks 1000 units and bone 3 scales 1 to 400, far wider than 16 bits can hold within the error,
+	//bone 1 moves over a few units, bone 2 holds still, bones 4 to 6 turn and jitter
+	Clip makeClip()
+	{
+		Clip clip;
+		size_t size = static_cast<size_t>(frames) * boneStride;
+		clip.positions.assign(size, DirectX::XMFLOAT4A(0.0f, 0.0f, 0.0f, 0.0f));
+		clip.quaternions.assign(size, DirectX::XMFLOAT4A(0.0f, 0.0f, 0.0f, 1.0f));
+		clip.scales.assign(size, DirectX::XMFLOAT4A(1.0f, 1.0f, 1.0f, 0.0f));
+		std::mt19937 rng(19);
+		std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+		for (int f = 0; f < frames; f++)
+		{
+			float t = static_cast<float>(f) / (frames - 1);
+			auto at = [f](int bone) { return static_cast<size_t>(f) * boneStride + bone; };
+			clip.positions[at(0)] = DirectX::XMFLOAT4A(1000.0f * t, 20.0f * std::sin(t * 9.0f), -300.0f * t * t, 0.0f);
+			clip.positions[at(1)] = DirectX::XMFLOAT4A(3.0f * std::sin(t * 7.0f), 1.0f + t, 2.0f * std::cos(t * 5.0f), 0.0f);
+			clip.positions[at(2)] = DirectX::XMFLOAT4A(0.5f, 12.0f, -4.0f, 0.0f);
+			clip.scales[at(3)] = DirectX::XMFLOAT4A(1.0f + 399.0f * t, 1.0f + 50.0f * t * t, 2.0f, 0.0f);
+			for (int bone = 4; bone < bones; bone++)
+			{
+				DirectX::XMVECTOR axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(1.0f, static_cast<float>(bone - 3), 0.5f, 0.0f));
+				float angle = t * 6.0f * bone + jitter(rng);
+				DirectX::XMVECTOR q = DirectX::XMVectorSetW(DirectX::XMVectorScale(axis, std::sin(angle * 0.5f)), std::cos(angle * 0.5f));
+				DirectX::XMStoreFloat4A(&clip.quaternions[at(bone)], q);
+				clip.positions[at(bone)] = DirectX::XMFLOAT4A(jitter(rng), 5.0f + jitter(rng), jitter(rng), 0.0f);
+			}
+		}
+		return clip;
+	}
+
+	//the decode is float math on values up to the clip's range, a few ulps of them come on top of the error
+	bool within(DirectX::FXMVECTOR sampled, DirectX::FXMVECTOR expected, float error, bool quaternion)
+	{
+		DirectX::XMFLOAT4 s, e;
+		DirectX::XMStoreFloat4(&s, sampled);
+		DirectX::XMStoreFloat4(&e, expected);
+		const float* a = &s.x;
+		const float* b = &e.x;
+		float sign = quaternion && s.x * e.x + s.y * e.y + s.z * e.z + s.w * e.w < 0.0f ? -1.0f : 1.0f;
+		for (int k = 0; k < (quaternion ? 4 : 3); k++)
+		{
+			if (std::fabs(a[k] * sign - b[k]) > error + 4.0f * FLT_EPSILON * std::max(1.0f, std::fabs(b[k]))) return false;
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	Clip clip = makeClip();
+	ClipCompressionSettings settings;
+	CompressedClip compressed;
+	compressed.build(frames, bones, boneStride, clip.positions, clip.quaternions, clip.scales, settings);
+	CHECK(!compressed.empty());
+	//the wide channels cost more, the rest must still shrink
+	size_t rawBytes = (clip.positions.size() + clip.quaternions.size() + clip.scales.size()) * sizeof(DirectX::XMFLOAT4A);
+	CHECK(compressed.sizeInBytes() < rawBytes / 4);
+
+	int wrongPositions = 0;
+	int wrongRotations = 0;
+	int wrongScales = 0;
+	for (int f = 0; f < frames; f++)
+	{
+		int next = std::min(f + 1, frames - 1);
+		for (float u : { 0.0f, 0.5f })
+		{
+			for (int block = 0; block < bones; block += 4)
+			{
+				DirectX::XMVECTOR p[4], q[4], s[4];
+				compressed.sampleBlock(f, next, u, block, p, q, s);
+				for (int k = 0; k < 4 && block + k < bones; k++)
+				{
+					size_t a = static_cast<size_t>(f) * boneStride + block + k;
+					size_t b = static_cast<size_t>(next) * boneStride + block + k;
+					DirectX::XMVECTOR position = DirectX::XMVectorLerp(DirectX::XMLoadFloat4A(&clip.positions[a]), DirectX::XMLoadFloat4A(&clip.positions[b]), u);
+					DirectX::XMVECTOR scale = DirectX::XMVectorLerp(DirectX::XMLoadFloat4A(&clip.scales[a]), DirectX::XMLoadFloat4A(&clip.scales[b]), u);
+					if (!within(p[k], position, settings.positionError, false)) wrongPositions++;
+					if (!within(s[k], scale, settings.scaleError, false)) wrongScales++;
+					//rotations are only compared on frames, nlerp between frames is not linear in the components
+					if (u == 0.0f && !within(q[k], DirectX::XMLoadFloat4A(&clip.quaternions[a]), settings.rotationError, true)) wrongRotations++;
+				}
+			}
+		}
+	}
+	CHECK(wrongPositions == 0);
+	CHECK(wrongRotations == 0);
+	CHECK(wrongScales == 0);
+	if (wrongPositions || wrongRotations || wrongScales)
+	{
+		printf("%d positions, %d rotations and %d scales outside the error\n", wrongPositions, wrongRotations, wrongScales);
+	}
+	return testResult();
+}
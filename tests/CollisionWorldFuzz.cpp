@@ -0,0 +1,131 @@
+//CollisionWorld's scalar and AVX2 paths against Object::preCheckCollisionWithPlayer on random worlds
+//world sizes cover every tail length of the eight-box groups, index lists cover every length of a last partial
+//group, and the boxes and queries include exact contacts, empty and inverted sizes and values near FLT_MAX
+#include "Object.h"
+#include "TestCheck.h"
+#include <cfloat>
+#include <random>
+
+namespace
+{
+	std::mt19937 rng(13);
+
+	//mostly whole and half units so edges coincide exactly, now and then an extreme value
+	float coordinate()
+	{
+		switch (rng() % 16)
+		{
+		case 0: return FLT_MAX;
+		case 1: return -FLT_MAX;
+		case 2: return FLT_MIN;
+		case 3: return std::uniform_real_distribution<float>(-1e30f, 1e30f)(rng);
+		case 4: return std::uniform_real_distribution<float>(-20.0f, 20.0f)(rng);
+		default: return 0.5f * static_cast<float>(static_cast<int>(rng() % 41) - 20);
+		}
+	}
+
+	float halfSize()
+	{
+		switch (rng() % 12)
+		{
+		case 0: return 0.0f;
+		case 1: return -0.5f * static_cast<float>(rng() % 4);
+		case 2: return FLT_MAX;
+		case 3: return std::uniform_real_distribution<float>(0.0f, 8.0f)(rng);
+		default: return 0.5f * static_cast<float>(rng() % 9);
+		}
+	}
+
+	Object randomObject()
+	{
+		Object object;
+		object.position = { coordinate(), coordinate(), coordinate() };
+		object.collisionHalfX = halfSize();
+		object.collisionHalfZ = halfSize();
+		return object;
+	}
+
+	bool reference(std::vector<Object>& objects, const std::vector<int>& indices, Object& query)
+	{
+		for (int i : indices)
+		{
+			if (objects[i].preCheckCollisionWithPlayer(query.position.x, query.position.z, query)) return true;
+		}
+		return false;
+	}
+}
+
+int main()
+{
+	CollisionWorld probe;
+	bool avx2 = probe.hasAVX2();
+	if (!avx2) printf("no AVX2 on this CPU, only the scalar paths are checked\n");
+
+	int mismatches[4] = {};
+	long long hits = 0;
+	long long queries = 0;
+	for (int round = 0; round < 3000; round++)
+	{
+		//0 to 40 boxes, every tail length of a group of eight comes up
+		int count = round % 41;
+		std::vector<Object> objects;
+		for (int i = 0; i < count; i++) objects.push_back(randomObject());
+		CollisionWorld world;
+		world.build(objects);
+		CHECK(world.size() == count);
+
+		//move a few boxes after the build, the world must see the update
+		for (int i = 0; i < count; i += 7)
+		{
+			objects[i] = randomObject();
+			world.update(i, objects[i]);
+		}
+
+		std::vector<int> all(count);
+		for (int i = 0; i < count; i++) all[i] = i;
+		for (int q = 0; q < 20; q++)
+		{
+			Object query = randomObject();
+			//a query that shares an edge with a box, touching must not count
+			if (count > 0 && q % 4 == 0)
+			{
+				const Object& box = objects[rng() % count];
+				query.position.x = box.position.x + box.collisionHalfX + query.collisionHalfX;
+				query.position.z = box.position.z;
+			}
+
+			//a truncated batch, a random subset with repeats whose length runs through every partial last group
+			std::vector<int> subset;
+			int length = count > 0 ? static_cast<int>(rng() % 20) : 0;
+			for (int i = 0; i < length; i++) subset.push_back(static_cast<int>(rng() % count));
+
+			bool expectedAll = reference(objects, all, query);
+			bool expectedSubset = reference(objects, subset, query);
+			hits += expectedAll ? 1 : 0;
+			queries++;
+			float x = query.position.x;
+			float z = query.position.z;
+			float hx = query.collisionHalfX;
+			float hz = query.collisionHalfZ;
+
+			world.setAVX2(false);
+			if (world.overlapsAnyScalar(x, z, hx, hz) != expectedAll) mismatches[0]++;
+			if (world.overlapsAny(subset, x, z, hx, hz) != expectedSubset) mismatches[1]++;
+			if (avx2)
+			{
+				world.setAVX2(true);
+				if (world.overlapsAny(x, z, hx, hz) != expectedAll) mismatches[2]++;
+				if (world.overlapsAny(subset, x, z, hx, hz) != expectedSubset) mismatches[3]++;
+			}
+		}
+	}
+	const char* paths[4] = { "scalar", "scalar indexed", "AVX2", "AVX2 indexed" };
+	for (int i = 0; i < 4; i++)
+	{
+		CHECK(mismatches[i] == 0);
+		if (mismatches[i]) printf("%s: %d of %lld queries differ from preCheckCollisionWithPlayer\n", paths[i], mismatches[i], queries);
+	}
+	//both answers have to come up often enough to mean something
+	CHECK(hits > queries / 10 && hits < queries * 9 / 10);
+	return testResult();
+}
@@ -0,0 +1,194 @@
+//feeds truncated and corrupted .gem files to the memory-mapped loader
+//a bad file must end in the loader's own error exit, never in a crash, a hang or a huge allocation,
+//so every case is opened in a forked child and only its exit status is looked at
+#include "GEMMappedLoader.h"
+#include "TestCheck.h"
+#include <cstdint>
+#include <fstream>
+#include <random>
+
+#ifdef _WIN32
+int main()
+{
+	printf("needs fork, skipped\n");
+	return 77;
+}
+#else
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	const char* scratchFile = "GEMLoaderFuzz.gem";
+
+	struct Writer
+	{
+		std::vector<unsigned char> bytes;
+
+		template<typename T>
+		void put(T v)
+		{
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+			bytes.insert(bytes.end(), p, p + sizeof(T));
+		}
+		void putString(const std::string& s)
+		{
+			put(static_cast<int>(s.size()));
+			bytes.insert(bytes.end(), s.begin(), s.end());
+		}
+	};
+
+	//a small animated file where every count field is a handful of bytes away from the next one
+	std::vector<unsigned char> syntheticFile()
+	{
+		const int bones = 3;
+		Writer w;
+		w.put(4058972161u);
+		w.put(1u);
+		w.put(1u);
+		w.put(1u);
+		w.putString("diffuse");
+		w.putString("Textures/T.png");
+		w.put(4u);
+		for (int v = 0; v < 4; v++)
+		{
+			GEMLoader::GEMAnimatedVertex vertex = {};
+			vertex.position = { static_cast<float>(v), 0.0f, 1.0f };
+			vertex.bonesIDs[0] = v % bones;
+			vertex.boneWeights[0] = 1.0f;
+			w.put(vertex);
+		}
+		w.put(6u);
+		for (unsigned int i : { 0u, 1u, 2u, 2u, 1u, 3u }) w.put(i);
+		w.put(static_cast<unsigned int>(bones));
+		for (int b = 0; b < bones; b++)
+		{
+			w.putString("bone" + std::to_string(b));
+			for (int m = 0; m < 16; m++) w.put(m % 5 == 0 ? 1.0f : 0.0f);
+			w.put(b - 1);
+		}
+		for (int m = 0; m < 16; m++) w.put(m % 5 == 0 ? 1.0f : 0.0f);
+		w.put(2u);
+		for (int a = 0; a < 2; a++)
+		{
+			w.putString(a == 0 ? "idle" : "walk");
+			w.put(2);
+			w.put(30.0f);
+			for (int f = 0; f < 2; f++)
+			{
+				for (int b = 0; b < bones; b++) w.put(GEMLoader::GEMVec3{ 0.0f, static_cast<float>(f), 0.0f });
+				for (int b = 0; b < bones; b++) w.put(GEMLoader::GEMQuaternion{ { 0.0f, 0.0f, 0.0f, 1.0f } });
+				for (int b = 0; b < bones; b++) w.put(GEMLoader::GEMVec3{ 1.0f, 1.0f, 1.0f });
+			}
+		}
+		return w.bytes;
+	}
+
+	std::vector<unsigned char> readFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	}
+
+	void writeFile(const std::vector<unsigned char>& bytes, size_t size)
+	{
+		std::ofstream file(scratchFile, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(size));
+	}
+
+	//opens the scratch file in a child, true if the child exited normally
+	bool opensCleanly()
+	{
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			//the loader reports bad files on stdout, thousands of cases would drown the test log
+			int null = open("/dev/null", O_WRONLY);
+			dup2(null, 1);
+			alarm(10);
+			GEMLoader::GEMMappedModel model;
+			model.open(scratchFile);
+			_exit(0);
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	int runCase(const std::vector<unsigned char>& bytes, size_t size, const char* what, size_t where)
+	{
+		writeFile(bytes, size);
+		if (opensCleanly()) return 0;
+		printf("%s at %zu of a %zu byte file crashed the loader\n", what, where, bytes.size());
+		return 1;
+	}
+}
+
+int main()
+{
+	int crashes = 0;
+	int cases = 0;
+	std::mt19937 rng(1234);
+
+	//the synthetic file parses as written
+	std::vector<unsigned char> synthetic = syntheticFile();
+	writeFile(synthetic, synthetic.size());
+	{
+		GEMLoader::GEMMappedModel model;
+		model.open(scratchFile);
+		CHECK(model.animated);
+		CHECK(model.meshes.size() == 1);
+		CHECK(model.meshes[0].verticesAnimated.size == 4);
+		CHECK(model.meshes[0].indices.size == 6);
+		CHECK(model.meshes[0].material.find("diffuse").value == "Textures/T.png");
+		CHECK(model.animation.bones.size() == 3);
+		CHECK(model.animation.animations.size() == 2);
+		CHECK(model.animation.animations[1].frames.size() == 2);
+		CHECK(model.animation.animations[1].frames[1].positions[2].y == 1.0f);
+	}
+
+	//every truncation of it, and every word of it replaced by negative, oversized and random values
+	for (size_t size = 0; size < synthetic.size(); size++, cases++)
+	{
+		crashes += runCase(synthetic, size, "truncation", size);
+	}
+	for (size_t at = 0; at + 4 <= synthetic.size(); at += 4)
+	{
+		for (uint32_t value : { 0xFFFFFFFFu, 0x80000000u, 0x7FFFFFFFu, 0x00FFFFFFu, static_cast<uint32_t>(rng()) })
+		{
+			std::vector<unsigned char> corrupt = synthetic;
+			memcpy(corrupt.data() + at, &value, sizeof(value));
+			crashes += runCase(corrupt, corrupt.size(), "corrupt word", at);
+			cases++;
+		}
+	}
+
+	//random truncations and corruptions of the shipped models
+	for (const char* asset : { "/Res/acacia_003.gem", "/Res/teraccgda.gem", "/Res/TRex.gem" })
+	{
+		std::vector<unsigned char> bytes = readFile(std::string(GAME_SOURCE_DIR) + asset);
+		CHECK(!bytes.empty());
+		if (bytes.empty()) continue;
+		std::uniform_int_distribution<size_t> anywhere(0, bytes.size() - 1);
+		for (int i = 0; i < 40; i++, cases++)
+		{
+			size_t size = anywhere(rng);
+			crashes += runCase(bytes, size, "truncation", size);
+		}
+		for (int i = 0; i < 40; i++, cases++)
+		{
+			std::vector<unsigned char> corrupt = bytes;
+			size_t at = anywhere(rng) & ~static_cast<size_t>(3);
+			for (int b = 0; b < 4 && at + b < corrupt.size(); b++) corrupt[at + b] = static_cast<unsigned char>(rng());
+			crashes += runCase(corrupt, corrupt.size(), "corrupt word", at);
+		}
+	}
+	unlink(scratchFile);
+
+	printf("%d cases, %d crashes\n", cases, crashes);
+	CHECK(crashes == 0);
+	return testResult();
+}
+#endif
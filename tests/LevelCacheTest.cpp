@@ -0,0 +1,72 @@
+//the baked level must be rebuilt when a source changes even if its size and modification time do not,
+//and a blob that could not be written must not be left behind
+#include "LevelCache.h"
+#include "TestCheck.h"
+#include <filesystem>
+
+namespace
+{
+	const char* levelFile = "LevelCacheTest.txt";
+	const char* modelFile = "LevelCacheTest.gem";
+
+	bool cacheLoads()
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		return LevelCache().load(levelFile, meshManager, objectManager, map);
+	}
+}
+
+int main()
+{
+	std::filesystem::copy_file(std::string(GAME_SOURCE_DIR) + "/Res/teraccgda.gem", modelFile, std::filesystem::copy_options::overwrite_existing);
+	{
+		std::ofstream level(levelFile, std::ios::trunc);
+		level << "Static," << modelFile << ",100,0,300,0,0,0,0.2,0.2,0.2,200,0,300,0,0,0,0.4,0.4,0.4\n";
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+
+	//the first load bakes, the next one reads the blob
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		std::string filename = levelFile;
+		meshManager.loadlevel(filename, objectManager, map);
+		CHECK(objectManager.objects.size() == 2);
+	}
+	CHECK(std::filesystem::exists(LevelCache::cacheFileName(levelFile)));
+	CHECK(cacheLoads());
+
+	//flip one byte of the model, keep its size and its modification time
+	auto time = std::filesystem::last_write_time(modelFile);
+	uintmax_t size = std::filesystem::file_size(modelFile);
+	{
+		std::fstream model(modelFile, std::ios::binary | std::ios::in | std::ios::out);
+		model.seekg(static_cast<std::streamoff>(size / 2));
+		char c = 0;
+		model.get(c);
+		model.seekp(static_cast<std::streamoff>(size / 2));
+		model.put(static_cast<char>(c ^ 0x40));
+	}
+	std::filesystem::last_write_time(modelFile, time);
+	CHECK(std::filesystem::file_size(modelFile) == size);
+	CHECK(std::filesystem::last_write_time(modelFile) == time);
+	CHECK(!cacheLoads());
+
+	//a blob that cannot be written reports it and leaves nothing behind
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		std::string unwritable = "LevelCacheTest_missing/level.txt";
+		CHECK(!LevelCache().save(unwritable, meshManager, objectManager, map));
+		CHECK(!std::filesystem::exists(LevelCache::cacheFileName(unwritable)));
+	}
+
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::filesystem::remove(levelFile);
+	std::filesystem::remove(modelFile);
+	return testResult();
+}
@@ -0,0 +1,222 @@
+//the 16 or 32 bit pool choice at the 0xFFFE/0xFFFF boundary, rebased indices against their 32 bit originals,
+//and the pools loadlevel fills for the shipped level and for a terrain small enough to move to 16 bits
+#include "LevelCache.h"
+#include "MeshIndices.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <filesystem>
+#include <random>
+
+namespace
+{
+	const char* levelFile = "MeshIndicesTest.txt";
+
+	struct Appended
+	{
+		std::vector<unsigned int> original;
+		unsigned int baseVertex = 0;
+		size_t offset = 0;
+		bool shortIndices = false;
+	};
+
+	bool isShort(std::vector<unsigned int> indices, unsigned int baseVertex)
+	{
+		std::vector<unsigned int> indices32;
+		std::vector<uint16_t> indices16;
+		bool shortIndices = false;
+		appendIndices(indices.data(), indices.size(), baseVertex, indices32, indices16, shortIndices);
+		CHECK(shortIndices == fitsShortIndices(indices.data(), indices.size(), baseVertex));
+		CHECK((shortIndices ? indices16.size() : indices32.size()) == indices.size());
+		CHECK((shortIndices ? indices32.size() : indices16.size()) == 0);
+		return shortIndices;
+	}
+
+	void checkBoundary()
+	{
+		CHECK(isShort({ 0, 1, 2 }, 0));
+		CHECK(isShort({ 0, 0xFFFD, 0xFFFE }, 0));
+		//0xFFFF is the strip cut value
+		CHECK(!isShort({ 0, 0xFFFF, 1 }, 0));
+		CHECK(!isShort({ 0x10000 }, 0));
+		//the limit applies after rebasing, wherever the mesh starts
+		const unsigned int base = 70000;
+		CHECK(isShort({ base, base + 0xFFFE }, base));
+		CHECK(!isShort({ base, base + 0xFFFF }, base));
+		CHECK(!isShort({ base + 5, base - 1 }, base));
+		CHECK(isShort({ 0xFFFFFFFFu - 0xFFFE, 0xFFFFFFFFu }, 0xFFFFFFFFu - 0xFFFE));
+		//an empty mesh takes no room and goes to the 16 bit pool
+		CHECK(isShort({}, base));
+	}
+
+	//meshes of every kind appended one after another, each one read back from its pool plus its base must give the
+	//indices it was appended with, untouched by the meshes appended after it
+	void checkRebasing()
+	{
+		std::mt19937 rng(25);
+		std::vector<unsigned int> indices32;
+		std::vector<uint16_t> indices16;
+		std::vector<Appended> meshes(400);
+		size_t expected16 = 0;
+		size_t expected32 = 0;
+		int offsetErrors = 0;
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			Appended& mesh = meshes[m];
+			//spans on both sides of the limit, bases below and above 65535
+			unsigned int spans[] = { 3u, 1000u, maxShortIndex - 1, maxShortIndex, maxShortIndex + 1, maxShortIndex + 2, 200000u };
+			unsigned int span = spans[rng() % 7];
+			mesh.baseVertex = m % 3 == 0 ? 0 : static_cast<unsigned int>(rng() % 3000000);
+			size_t count = rng() % 64;
+			for (size_t i = 0; i < count; i++) mesh.original.push_back(mesh.baseVertex + static_cast<unsigned int>(rng() % span));
+			//the mesh's extremes decide its pool, put one of them in
+			if (count > 0 && rng() % 2) mesh.original[rng() % count] = mesh.baseVertex + span - 1;
+			mesh.offset = appendIndices(mesh.original.data(), count, mesh.baseVertex, indices32, indices16, mesh.shortIndices);
+
+			unsigned int highest = 0;
+			for (unsigned int index : mesh.original) highest = std::max(highest, index - mesh.baseVertex);
+			CHECK(mesh.shortIndices == (highest <= maxShortIndex));
+			size_t& expected = mesh.shortIndices ? expected16 : expected32;
+			if (mesh.offset != expected) offsetErrors++;
+			expected += count;
+		}
+		CHECK(offsetErrors == 0);
+		CHECK(indices16.size() == expected16);
+		CHECK(indices32.size() == expected32);
+		CHECK(expected16 > 0 && expected32 > 0);
+
+		int wrong = 0;
+		for (const Appended& mesh : meshes)
+		{
+			for (size_t i = 0; i < mesh.original.size(); i++)
+			{
+				unsigned int rebased = mesh.shortIndices ? indices16[mesh.offset + i] : indices32[mesh.offset + i];
+				if (rebased + mesh.baseVertex != mesh.original[i]) wrong++;
+			}
+		}
+		CHECK(wrong == 0);
+	}
+
+	unsigned int indexAt(const MeshManager& meshManager, const MeshDescriptor& md, int i)
+	{
+		if (md.isDynamic) return md.shortIndices ? meshManager.indices16_Dynamic[md.indexOffset + i] : meshManager.indices_Dynamic[md.indexOffset + i];
+		return md.shortIndices ? meshManager.indices16_Static[md.indexOffset + i] : meshManager.indices_Static[md.indexOffset + i];
+	}
+
+	//every index stays inside its mesh's vertices, and the mesh sits in the pool its vertex count allows
+	void checkLevel(const MeshManager& meshManager)
+	{
+		int outside = 0;
+		for (const auto& pair : meshManager.objects)
+		{
+			const MeshDescriptor& md = pair.second;
+			unsigned int highest = 0;
+			for (int i = 0; i < md.indexCount; i++)
+			{
+				unsigned int index = indexAt(meshManager, md, i);
+				highest = std::max(highest, index);
+				if (index >= static_cast<unsigned int>(md.vertexCount)) outside++;
+			}
+			CHECK(md.shortIndices == (highest <= maxShortIndex));
+		}
+		CHECK(outside == 0);
+	}
+}
+
+int main()
+{
+	checkBoundary();
+	checkRebasing();
+
+	//the shipped level: the models fit in 16 bits, the terrain does not
+	{
+		std::ifstream in(GAME_SOURCE_DIR "/Input.txt");
+		std::ofstream level(levelFile, std::ios::trunc);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			//the level's paths are relative to the source tree
+			size_t res = 0;
+			while ((res = line.find("Res/", res)) != std::string::npos)
+			{
+				line.insert(res, GAME_SOURCE_DIR "/");
+				res += sizeof(GAME_SOURCE_DIR "/Res/") - 1;
+			}
+			level << line << "\n";
+		}
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::string filename = levelFile;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		//baked on the first pass, read from the cache on the second
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		meshManager.loadlevel(filename, objectManager, map);
+		CHECK(meshManager.objects.count("NPC") && meshManager.objects["NPC"].shortIndices);
+		CHECK(meshManager.objects.count("Static") && meshManager.objects["Static"].shortIndices);
+		CHECK(meshManager.objects.count("Terrain") && !meshManager.objects["Terrain"].shortIndices);
+		checkLevel(meshManager);
+	}
+
+	//a 193x193 terrain moves to the 16 bit pool, its indices and chunk sets must match the 32 bit build
+	const char* terrainFile = "MeshIndicesTest.r16";
+	{
+		const int side = 193;
+		std::mt19937 rng(9);
+		std::ofstream file(terrainFile, std::ios::binary | std::ios::trunc);
+		for (int i = 0; i < side * side; i++)
+		{
+			uint16_t sample = static_cast<uint16_t>(rng());
+			file.put(static_cast<char>(sample & 0xFF));
+			file.put(static_cast<char>(sample >> 8));
+		}
+	}
+	{
+		std::ofstream level(levelFile, std::ios::trunc);
+		level << "Terrain," << terrainFile << "," << GAME_SOURCE_DIR << "/Res/HeightMap2_Diffuse.png,0,0,0,0,0,0,1,1,1\n";
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	Map original;
+	std::vector<Vertex_Static> originalVertices;
+	std::vector<unsigned int> originalIndices;
+	original.LoadHeightMap(terrainFile, originalVertices, originalIndices);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		meshManager.loadlevel(filename, objectManager, map);
+		const MeshDescriptor& md = meshManager.objects["Terrain"];
+		CHECK(md.shortIndices);
+		CHECK(md.vertexCount == static_cast<int>(originalVertices.size()));
+		CHECK(md.indexCount == static_cast<int>(originalIndices.size()));
+		checkLevel(meshManager);
+		if (!md.shortIndices || md.indexCount != static_cast<int>(originalIndices.size())) continue;
+
+		int wrong = 0;
+		for (int i = 0; i < md.indexCount; i++)
+		{
+			if (meshManager.indices16_Static[md.indexOffset + i] != originalIndices[i]) wrong++;
+		}
+		CHECK(wrong == 0);
+		//the chunk sets point at the same indices in the 16 bit pool as in the 32 bit build
+		CHECK(map.terrainChunks.chunks.size() == original.terrainChunks.chunks.size());
+		int wrongSets = 0;
+		for (size_t c = 0; c < std::min(map.terrainChunks.chunks.size(), original.terrainChunks.chunks.size()); c++)
+		{
+			const TerrainChunk& moved = map.terrainChunks.chunks[c];
+			const TerrainChunk& built = original.terrainChunks.chunks[c];
+			for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+			{
+				if (moved.indexCount[lod] != built.indexCount[lod] || moved.indexOffset[lod] - md.indexOffset != built.indexOffset[lod]) wrongSets++;
+			}
+		}
+		CHECK(wrongSets == 0);
+	}
+
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::filesystem::remove(levelFile);
+	std::filesystem::remove(terrainFile);
+	return testResult();
+}
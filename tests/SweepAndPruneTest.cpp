@@ -0,0 +1,127 @@
+//SweepAndPrune::update against a brute force test of every pair, tick after tick while the boxes move, items are
+//added and removed, the sweep axis switches and boxes only touch, which is not an overlap
+#include "SweepAndPrune.h"
+#include "TestCheck.h"
+#include <random>
+
+namespace
+{
+	struct Item
+	{
+		DirectX::XMFLOAT3 minBound;
+		DirectX::XMFLOAT3 maxBound;
+		bool isStatic;
+	};
+
+	//positive depth on all three axes and not two static items, as documented in SweepAndPrune.h
+	std::vector<SweepAndPrune::Pair> brutePairs(const std::vector<Item>& items)
+	{
+		std::vector<SweepAndPrune::Pair> pairs;
+		for (int a = 0; a < static_cast<int>(items.size()); a++)
+		{
+			for (int b = a + 1; b < static_cast<int>(items.size()); b++)
+			{
+				const Item& p = items[a];
+				const Item& q = items[b];
+				if (p.isStatic && q.isStatic) continue;
+				if (p.minBound.x < q.maxBound.x && q.minBound.x < p.maxBound.x &&
+					p.minBound.y < q.maxBound.y && q.minBound.y < p.maxBound.y &&
+					p.minBound.z < q.maxBound.z && q.minBound.z < p.maxBound.z)
+				{
+					pairs.push_back({ a, b });
+				}
+			}
+		}
+		return pairs;
+	}
+
+	bool samePairs(const std::vector<SweepAndPrune::Pair>& a, const std::vector<SweepAndPrune::Pair>& b)
+	{
+		if (a.size() != b.size()) return false;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].a != b[i].a || a[i].b != b[i].b) return false;
+		}
+		return true;
+	}
+
+	//boxes on a coarse grid of whole units, so many of them share a face or an edge exactly
+	Item randomItem(std::mt19937& random, float spreadX, float spreadZ)
+	{
+		std::uniform_int_distribution<int> size(1, 4);
+		Item item;
+		item.minBound = { static_cast<float>(random() % static_cast<unsigned int>(spreadX)), static_cast<float>(random() % 4), static_cast<float>(random() % static_cast<unsigned int>(spreadZ)) };
+		item.maxBound = { item.minBound.x + size(random), item.minBound.y + size(random), item.minBound.z + size(random) };
+		item.isStatic = random() % 5 == 0;
+		return item;
+	}
+
+	void setAll(SweepAndPrune& sap, const std::vector<Item>& items)
+	{
+		sap.resize(static_cast<int>(items.size()));
+		for (int i = 0; i < static_cast<int>(items.size()); i++) sap.setBox(i, items[i].minBound, items[i].maxBound, items[i].isStatic);
+	}
+}
+
+int main()
+{
+	std::mt19937 random(12);
+	std::uniform_real_distribution<float> step(-0.75f, 0.75f);
+	std::vector<Item> items;
+	for (int i = 0; i < 600; i++) items.push_back(randomItem(random, 120.0f, 120.0f));
+
+	SweepAndPrune sap;
+	int mismatches = 0;
+	long long checkedPairs = 0;
+	for (int tick = 0; tick < 120; tick++)
+	{
+		//moving items step by fractions or by whole units, which keeps exact contacts coming back
+		for (Item& item : items)
+		{
+			if (item.isStatic) continue;
+			float dx = tick % 3 == 0 ? static_cast<float>(static_cast<int>(random() % 3) - 1) : step(random);
+			float dz = tick % 3 == 0 ? static_cast<float>(static_cast<int>(random() % 3) - 1) : step(random);
+			item.minBound.x += dx;
+			item.maxBound.x += dx;
+			item.minBound.z += dz;
+			item.maxBound.z += dz;
+		}
+		//grow and shrink the item list
+		if (tick % 17 == 5)
+		{
+			for (int i = 0; i < 50; i++) items.push_back(randomItem(random, 120.0f, 120.0f));
+		}
+		if (tick % 23 == 11) items.resize(items.size() - 80);
+		//stretch the world along z and back, so the sweep axis switches
+		if (tick == 40 || tick == 80)
+		{
+			float factor = tick == 40 ? 6.0f : 1.0f / 6.0f;
+			for (Item& item : items)
+			{
+				float width = item.maxBound.z - item.minBound.z;
+				item.minBound.z *= factor;
+				item.maxBound.z = item.minBound.z + width;
+			}
+		}
+
+		setAll(sap, items);
+		std::vector<SweepAndPrune::Pair> expected = brutePairs(items);
+		checkedPairs += static_cast<long long>(expected.size());
+		if (!samePairs(sap.update(), expected)) mismatches++;
+		if (!samePairs(sap.overlaps(), expected)) mismatches++;
+	}
+	CHECK(mismatches == 0);
+	//the test is only worth something if the world actually produced overlaps
+	CHECK(checkedPairs > 1000);
+	if (mismatches) printf("%d of 120 ticks differ from the brute force pairs\n", mismatches);
+
+	//degenerate sizes
+	SweepAndPrune empty;
+	CHECK(empty.update().empty());
+	empty.resize(1);
+	empty.setBox(0, { 0,0,0 }, { 1,1,1 });
+	CHECK(empty.update().empty());
+	empty.resize(0);
+	CHECK(empty.update().empty());
+	return testResult();
+}
@@ -0,0 +1,76 @@
+//LoadHeightMap must build the same terrain for any thread count: vertices, normals, index sets and chunk bounds
+//are compared byte for byte between a one thread job system and larger ones, on the shipped height map and on a
+//synthetic .r16 map whose rows do not divide into the job grain
+#include "Map.h"
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace
+{
+	struct TerrainBuild
+	{
+		std::vector<Vertex_Static> vertices;
+		std::vector<unsigned int> indices;
+		std::vector<uint16_t> normals;
+		std::vector<TerrainChunk> chunks;
+	};
+
+	//vertices and indices already in the pools are kept, the terrain lands after them like in a level load
+	TerrainBuild build(const std::string& file, int threads)
+	{
+		JobSystem jobSystem(threads);
+		Map map;
+		TerrainBuild out;
+		out.vertices.resize(3);
+		out.indices.assign({ 0, 1, 2 });
+		map.LoadHeightMap(file, out.vertices, out.indices, &jobSystem);
+		out.normals = map.normals;
+		out.chunks = map.terrainChunks.chunks;
+		return out;
+	}
+
+	template <typename T>
+	bool sameBytes(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	void checkThreadCounts(const std::string& file)
+	{
+		TerrainBuild reference = build(file, 1);
+		CHECK(reference.vertices.size() > 3);
+		CHECK(reference.indices.size() > 3);
+		CHECK(!reference.chunks.empty());
+		for (int threads : { 2, 3, 8, 0 })
+		{
+			TerrainBuild other = build(file, threads);
+			bool same = sameBytes(reference.vertices, other.vertices) && sameBytes(reference.indices, other.indices) &&
+				sameBytes(reference.normals, other.normals) && sameBytes(reference.chunks, other.chunks);
+			CHECK(same);
+			if (!same) printf("%s differs between 1 and %d threads\n", file.c_str(), threads);
+		}
+	}
+}
+
+int main()
+{
+	checkThreadCounts(GAME_SOURCE_DIR "/Res/HeightMap2.png");
+
+	const char* synthetic = "TerrainBuildTest.r16";
+	{
+		const int side = 333;
+		std::mt19937 random(3);
+		std::ofstream file(synthetic, std::ios::binary | std::ios::trunc);
+		for (int i = 0; i < side * side; i++)
+		{
+			uint16_t sample = static_cast<uint16_t>(random());
+			file.put(static_cast<char>(sample & 0xFF));
+			file.put(static_cast<char>(sample >> 8));
+		}
+	}
+	checkThreadCounts(synthetic);
+	return testResult();
+}
@@ -0,0 +1,284 @@
+//TerrainChunks headless: LOD 0 must cover the grid's triangles exactly once, no chunk with a vertex in view may be
+//culled, the LOD must step up at lodDistance and every doubling of it, chunks next to each other in the index pool
+//must merge into one draw, and the skirts must hang the chunk's full height range below its edges
+#include "TerrainChunks.h"
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <set>
+
+namespace
+{
+	const int width = 197;
+	const int height = 141;
+
+	struct Terrain
+	{
+		TerrainChunks chunks;
+		std::vector<Vertex_Static> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	//ragged last chunks on both axes, hills and noise so every chunk gets its own height range
+	void build(Terrain& terrain, JobSystem& jobSystem)
+	{
+		std::mt19937 rng(10);
+		std::uniform_real_distribution<float> noise(0.0f, 3.0f);
+		for (int z = 0; z < height; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				Vertex_Static vertex = {};
+				vertex.position = { static_cast<float>(x), 40.0f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + noise(rng), static_cast<float>(z) };
+				terrain.vertices.push_back(vertex);
+			}
+		}
+		terrain.chunks.chunkSize = 32;
+		terrain.chunks.Build(width, height, terrain.vertices, 0, terrain.indices, jobSystem);
+	}
+
+	bool isGrid(unsigned int index)
+	{
+		return index < static_cast<unsigned int>(width * height);
+	}
+
+	//a triangle's indices sorted, so windings and rotations compare equal
+	std::array<unsigned int, 3> key(unsigned int a, unsigned int b, unsigned int c)
+	{
+		std::array<unsigned int, 3> k = { a, b, c };
+		std::sort(k.begin(), k.end());
+		return k;
+	}
+
+	void checkCoverage(const Terrain& terrain)
+	{
+		std::set<std::array<unsigned int, 3>> grid;
+		for (int z = 0; z + 1 < height; z++)
+		{
+			for (int x = 0; x + 1 < width; x++)
+			{
+				grid.insert(key(z * width + x, (z + 1) * width + x, z * width + x + 1));
+				grid.insert(key(z * width + x + 1, (z + 1) * width + x, (z + 1) * width + x + 1));
+			}
+		}
+		std::set<std::array<unsigned int, 3>> lod0;
+		int duplicates = 0;
+		int stray = 0;
+		for (const TerrainChunk& chunk : terrain.chunks.chunks)
+		{
+			for (int i = chunk.indexOffset[0]; i < chunk.indexOffset[0] + chunk.indexCount[0]; i += 3)
+			{
+				unsigned int a = terrain.indices[i];
+				unsigned int b = terrain.indices[i + 1];
+				unsigned int c = terrain.indices[i + 2];
+				if (!isGrid(a) || !isGrid(b) || !isGrid(c)) continue;
+				if (!grid.count(key(a, b, c))) stray++;
+				if (!lod0.insert(key(a, b, c)).second) duplicates++;
+			}
+		}
+		CHECK(lod0.size() == grid.size());
+		CHECK(duplicates == 0);
+		CHECK(stray == 0);
+
+		//coarser LODs still cover the whole grid, their triangles' XZ areas add up to it
+		for (int lod = 1; lod < TerrainChunk::lodCount; lod++)
+		{
+			double area = 0.0;
+			for (const TerrainChunk& chunk : terrain.chunks.chunks)
+			{
+				for (int i = chunk.indexOffset[lod]; i < chunk.indexOffset[lod] + chunk.indexCount[lod]; i += 3)
+				{
+					const DirectX::XMFLOAT3& a = terrain.vertices[terrain.indices[i]].position;
+					const DirectX::XMFLOAT3& b = terrain.vertices[terrain.indices[i + 1]].position;
+					const DirectX::XMFLOAT3& c = terrain.vertices[terrain.indices[i + 2]].position;
+					if (!isGrid(terrain.indices[i]) || !isGrid(terrain.indices[i + 1]) || !isGrid(terrain.indices[i + 2])) continue;
+					area += std::fabs((b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z)) * 0.5;
+				}
+			}
+			CHECK(area == static_cast<double>(width - 1) * (height - 1));
+		}
+	}
+
+	//every skirt vertex sits under a vertex of its chunk's edge by the chunk's height range plus one
+	void checkSkirts(const Terrain& terrain)
+	{
+		int wrongDepth = 0;
+		int offEdge = 0;
+		int belowBound = 0;
+		int skirts = 0;
+		for (const TerrainChunk& chunk : terrain.chunks.chunks)
+		{
+			int x0 = static_cast<int>(chunk.minBound.x);
+			int z0 = static_cast<int>(chunk.minBound.z);
+			int x1 = static_cast<int>(chunk.maxBound.x);
+			int z1 = static_cast<int>(chunk.maxBound.z);
+			float minY = 1e30f;
+			float maxY = -1e30f;
+			for (int z = z0; z <= z1; z++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					minY = std::min(minY, terrain.vertices[z * width + x].position.y);
+					maxY = std::max(maxY, terrain.vertices[z * width + x].position.y);
+				}
+			}
+			float depth = maxY - minY + 1.0f;
+			CHECK(chunk.maxBound.y == maxY);
+			CHECK(chunk.minBound.y == minY - depth);
+			for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+			{
+				for (int i = chunk.indexOffset[lod]; i < chunk.indexOffset[lod] + chunk.indexCount[lod]; i++)
+				{
+					unsigned int index = terrain.indices[i];
+					if (isGrid(index)) continue;
+					skirts++;
+					const DirectX::XMFLOAT3& p = terrain.vertices[index].position;
+					int x = static_cast<int>(p.x);
+					int z = static_cast<int>(p.z);
+					if (static_cast<float>(x) != p.x || static_cast<float>(z) != p.z || x < x0 || x > x1 || z < z0 || z > z1 || (x != x0 && x != x1 && z != z0 && z != z1))
+					{
+						offEdge++;
+						continue;
+					}
+					if (p.y != terrain.vertices[z * width + x].position.y - depth) wrongDepth++;
+					if (p.y < chunk.minBound.y) belowBound++;
+				}
+			}
+		}
+		CHECK(skirts > 0);
+		CHECK(offEdge == 0);
+		CHECK(wrongDepth == 0);
+		CHECK(belowBound == 0);
+	}
+
+	//the lod whose range of the index pool a draw covers, -1 if the chunk is not drawn
+	int drawnLOD(const TerrainChunk& chunk, const std::vector<TerrainDraw>& draws)
+	{
+		int found = -1;
+		for (int lod = 0; lod < TerrainChunk::lodCount; lod++)
+		{
+			for (const TerrainDraw& draw : draws)
+			{
+				if (chunk.indexOffset[lod] >= draw.indexOffset && chunk.indexOffset[lod] + chunk.indexCount[lod] <= draw.indexOffset + draw.indexCount)
+				{
+					//a chunk is drawn at one LOD only
+					CHECK(found == -1);
+					found = lod;
+				}
+			}
+		}
+		return found;
+	}
+
+	//0 inside lodDistance, one more for every doubling of it, capped at the coarsest set
+	int expectedLOD(float distance, float lodDistance)
+	{
+		int lod = 0;
+		for (float limit = lodDistance; distance >= limit && lod < TerrainChunk::lodCount - 1; limit *= 2.0f) lod++;
+		return lod;
+	}
+
+	bool inFrustum(const DirectX::XMMATRIX& terrainToClip, const DirectX::XMFLOAT3& p)
+	{
+		DirectX::XMFLOAT4 clip;
+		DirectX::XMStoreFloat4(&clip, DirectX::XMVector4Transform(DirectX::XMVectorSet(p.x, p.y, p.z, 1.0f), terrainToClip));
+		return clip.w > 0.0f && std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && clip.z >= 0.0f && clip.z <= clip.w;
+	}
+
+	//random cameras over and around the terrain: a chunk with any vertex in view is drawn, at the LOD its distance asks for
+	void checkSelection(Terrain& terrain)
+	{
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		int culledVisible = 0;
+		int wrongLOD = 0;
+		int unmerged = 0;
+		int drawnChunks = 0;
+		int culledChunks = 0;
+		int perLOD[TerrainChunk::lodCount] = {};
+		std::vector<TerrainDraw> draws;
+		for (int camera = 0; camera < 300; camera++)
+		{
+			terrain.chunks.lodDistance = 8.0f + unit(rng) * 120.0f;
+			DirectX::XMFLOAT3 eye = { unit(rng) * (width + 200.0f) - 100.0f, 10.0f + unit(rng) * 150.0f, unit(rng) * (height + 200.0f) - 100.0f };
+			DirectX::XMFLOAT3 target = { unit(rng) * width, 0.0f, unit(rng) * height };
+			DirectX::XMVECTOR eyeV = DirectX::XMLoadFloat3(&eye);
+			DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH(eyeV, DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&target), eyeV), DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(0.3f + unit(rng) * 1.2f, 16.0f / 9.0f, 0.1f, 100.0f + unit(rng) * 400.0f);
+			DirectX::XMMATRIX terrainToClip = view * projection;
+			terrain.chunks.Select(terrainToClip, eye, draws);
+
+			for (size_t i = 0; i + 1 < draws.size(); i++)
+			{
+				if (draws[i].indexOffset + draws[i].indexCount == draws[i + 1].indexOffset) unmerged++;
+			}
+			for (const TerrainChunk& chunk : terrain.chunks.chunks)
+			{
+				int lod = drawnLOD(chunk, draws);
+				if (lod < 0)
+				{
+					culledChunks++;
+					//the LOD 0 set references every grid and skirt vertex of the chunk
+					for (int i = chunk.indexOffset[0]; i < chunk.indexOffset[0] + chunk.indexCount[0]; i++)
+					{
+						if (inFrustum(terrainToClip, terrain.vertices[terrain.indices[i]].position))
+						{
+							culledVisible++;
+							break;
+						}
+					}
+					continue;
+				}
+				drawnChunks++;
+				perLOD[lod]++;
+				DirectX::XMFLOAT3 closest = {
+					std::clamp(eye.x, chunk.minBound.x, chunk.maxBound.x),
+					std::clamp(eye.y, chunk.minBound.y, chunk.maxBound.y),
+					std::clamp(eye.z, chunk.minBound.z, chunk.maxBound.z) };
+				float distance = std::sqrt((eye.x - closest.x) * (eye.x - closest.x) + (eye.y - closest.y) * (eye.y - closest.y) + (eye.z - closest.z) * (eye.z - closest.z));
+				//a distance on a threshold may round either way
+				float ratio = distance / terrain.chunks.lodDistance;
+				bool onThreshold = std::fabs(ratio - std::round(ratio)) < 1e-4f;
+				if (lod != expectedLOD(distance, terrain.chunks.lodDistance) && !onThreshold) wrongLOD++;
+			}
+		}
+		CHECK(drawnChunks > 0 && culledChunks > 0);
+		for (int lod = 0; lod < TerrainChunk::lodCount; lod++) CHECK(perLOD[lod] > 0);
+		CHECK(culledVisible == 0);
+		CHECK(wrongLOD == 0);
+		CHECK(unmerged == 0);
+		if (culledVisible || wrongLOD || unmerged) printf("%d visible chunks culled, %d at the wrong LOD, %d draws left unmerged\n", culledVisible, wrongLOD, unmerged);
+	}
+
+	//seen from far above with everything in view, every chunk is at the coarsest LOD and the whole set is one draw
+	void checkMerge(Terrain& terrain)
+	{
+		terrain.chunks.lodDistance = 1.0f;
+		DirectX::XMFLOAT3 eye = { width * 0.5f, 2000.0f, height * 0.5f };
+		DirectX::XMMATRIX view = DirectX::XMMatrixLookToLH(DirectX::XMLoadFloat3(&eye), DirectX::XMVectorSet(0.0f, -1.0f, 0.0f, 0.0f), DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+		DirectX::XMMATRIX projection = DirectX::XMMatrixPerspectiveFovLH(1.0f, 1.0f, 1.0f, 5000.0f);
+		std::vector<TerrainDraw> draws;
+		terrain.chunks.Select(view * projection, eye, draws);
+		const int coarsest = TerrainChunk::lodCount - 1;
+		int total = 0;
+		for (const TerrainChunk& chunk : terrain.chunks.chunks) total += chunk.indexCount[coarsest];
+		CHECK(draws.size() == 1);
+		CHECK(!draws.empty() && draws[0].indexOffset == terrain.chunks.chunks.front().indexOffset[coarsest] && draws[0].indexCount == total);
+	}
+}
+
+int main()
+{
+	JobSystem jobSystem;
+	Terrain terrain;
+	build(terrain, jobSystem);
+	CHECK(terrain.chunks.chunks.size() == static_cast<size_t>(((width - 2) / terrain.chunks.chunkSize + 1) * ((height - 2) / terrain.chunks.chunkSize + 1)));
+	checkCoverage(terrain);
+	checkSkirts(terrain);
+	checkSelection(terrain);
+	checkMerge(terrain);
+	return testResult();
+}
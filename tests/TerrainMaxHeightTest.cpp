@@ -0,0 +1,88 @@
+//GetMaxHeight against a brute force scan of every texel a random rectangle covers, on a synthetic map with odd
+//dimensions and on the shipped height map, and every bilinear sample inside a rectangle must stay under the answer
+#include "Map.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+namespace
+{
+	//the texels [floor(minX), ceil(maxX)] x [floor(minZ), ceil(maxZ)] clipped to the map, at least 0 when a sample
+	//inside the rectangle falls off the map, since GetHeight returns 0 there
+	float bruteMaxHeight(const Map& map, float minX, float minZ, float maxX, float maxZ)
+	{
+		int x0 = static_cast<int>(std::floor(minX));
+		int z0 = static_cast<int>(std::floor(minZ));
+		int x1 = static_cast<int>(std::ceil(maxX));
+		int z1 = static_cast<int>(std::ceil(maxZ));
+		bool outside = x0 < 0 || z0 < 0 || static_cast<int>(std::floor(maxX)) + 1 >= map.width || static_cast<int>(std::floor(maxZ)) + 1 >= map.height;
+		float best = outside ? 0.0f : -FLT_MAX;
+		for (int z = std::max(z0, 0); z <= std::min(z1, map.height - 1); z++)
+		{
+			for (int x = std::max(x0, 0); x <= std::min(x1, map.width - 1); x++)
+			{
+				best = std::max(best, map.DecodeHeight(map.heightMap[z * map.width + x]));
+			}
+		}
+		return best;
+	}
+
+	//rectangles from a fraction of a texel up to the whole map, some of them hanging over the border
+	void checkRandomRectangles(Map& map, int count, unsigned int seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		int mismatches = 0;
+		int escapes = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float maxSize = i % 4 == 0 ? static_cast<float>(std::max(map.width, map.height)) : std::pow(2.0f, unit(random) * 7.0f);
+			float sizeX = unit(random) * maxSize;
+			float sizeZ = unit(random) * maxSize;
+			float minX = unit(random) * (map.width + 8.0f) - 4.0f - sizeX * 0.5f;
+			float minZ = unit(random) * (map.height + 8.0f) - 4.0f - sizeZ * 0.5f;
+			float maxX = minX + sizeX;
+			float maxZ = minZ + sizeZ;
+
+			float answer = map.GetMaxHeight(minX, minZ, maxX, maxZ);
+			if (answer != bruteMaxHeight(map, minX, minZ, maxX, maxZ)) mismatches++;
+			for (int s = 0; s < 8; s++)
+			{
+				float h = map.GetHeight(minX + unit(random) * sizeX, minZ + unit(random) * sizeZ);
+				if (h > answer + 1e-4f) escapes++;
+			}
+		}
+		CHECK(mismatches == 0);
+		CHECK(escapes == 0);
+		if (mismatches || escapes) printf("%d of %d rectangles differ from the scan, %d samples above the answer\n", mismatches, count, escapes);
+	}
+}
+
+int main()
+{
+	//odd sizes give pyramid levels with a ragged last row and column
+	{
+		Map map;
+		map.width = 301;
+		map.height = 187;
+		std::mt19937 random(7);
+		map.heightMap.resize(static_cast<size_t>(map.width) * map.height);
+		for (uint16_t& sample : map.heightMap) sample = static_cast<uint16_t>(random() % 20000);
+		//a few isolated spikes, the descent has to find them from the nodes above
+		for (int i = 0; i < 40; i++) map.heightMap[random() % map.heightMap.size()] = static_cast<uint16_t>(30000 + random() % 35000);
+		map.BuildHeightPyramid();
+		checkRandomRectangles(map, 20000, 1);
+	}
+
+	{
+		Map map;
+		std::vector<Vertex_Static> vertices;
+		std::vector<unsigned int> indices;
+		map.LoadHeightMap(GAME_SOURCE_DIR "/Res/HeightMap2.png", vertices, indices);
+		CHECK(map.width > 0 && map.height > 0);
+		checkRandomRectangles(map, 5000, 2);
+	}
+	return testResult();
+}
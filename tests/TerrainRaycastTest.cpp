@@ -0,0 +1,216 @@
+//Map::Raycast against dense sampling of the bilinear height map along each ray, and the same rays again once a
+//bigger streamed world is open: Raycast, the max pyramid and SaveTerrainTiles keep reading the resident height map
+#include "Map.h"
+#include "TerrainTiles.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+namespace
+{
+	//the bilinear height of the resident map decoded from heightMap, false off the texels Raycast covers
+	//GetHeight reads the tiles once they are open, so it cannot stand in for it
+	bool residentHeight(const Map& map, float x, float z, float& h)
+	{
+		if (x < 0.0f || z < 0.0f || x > static_cast<float>(map.width - 1) || z > static_cast<float>(map.height - 1)) return false;
+		int x0 = std::min(static_cast<int>(std::floor(x)), map.width - 2);
+		int z0 = std::min(static_cast<int>(std::floor(z)), map.height - 2);
+		auto texel = [&](int tx, int tz) { return map.DecodeHeight(map.heightMap[tz * map.width + tx]); };
+		float dx = x - static_cast<float>(x0);
+		float dz = z - static_cast<float>(z0);
+		float h0 = texel(x0, z0) + (texel(x0 + 1, z0) - texel(x0, z0)) * dx;
+		float h1 = texel(x0, z0 + 1) + (texel(x0 + 1, z0 + 1) - texel(x0, z0 + 1)) * dx;
+		h = h0 + (h1 - h0) * dz;
+		return true;
+	}
+
+	//rays from above the terrain, most of them pointing down, some starting off the map or running along it
+	std::vector<TerrainRay> makeRays(const Map& map, int count, unsigned int seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<TerrainRay> rays(count);
+		for (TerrainRay& ray : rays)
+		{
+			ray.origin.x = unit(rng) * (map.width + 40.0f) - 20.0f;
+			ray.origin.z = unit(rng) * (map.height + 40.0f) - 20.0f;
+			float ground = 0.0f;
+			residentHeight(map, ray.origin.x, ray.origin.z, ground);
+			ray.origin.y = ground + 0.5f + unit(rng) * 40.0f;
+			float angle = unit(rng) * 6.2831853f;
+			ray.direction = { std::cos(angle), -unit(rng) * unit(rng) * 1.5f, std::sin(angle) };
+			ray.maxDistance = 20.0f + unit(rng) * 300.0f;
+		}
+		return rays;
+	}
+
+	//the first sample at or under the ground every step along the ray, false when none is
+	bool denseHit(const Map& map, const TerrainRay& ray, float step, float& distance)
+	{
+		float length = std::sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z);
+		for (float s = 0.0f; s <= ray.maxDistance; s += step)
+		{
+			float h;
+			float t = s / length;
+			if (residentHeight(map, ray.origin.x + ray.direction.x * t, ray.origin.z + ray.direction.z * t, h) && ray.origin.y + ray.direction.y * t <= h)
+			{
+				distance = s;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//how far above the ground the ray is at a distance, FLT_MAX off the map
+	float clearance(const Map& map, const TerrainRay& ray, float distance)
+	{
+		float length = std::sqrt(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y + ray.direction.z * ray.direction.z);
+		float t = distance / length;
+		float h;
+		if (!residentHeight(map, ray.origin.x + ray.direction.x * t, ray.origin.z + ray.direction.z * t, h)) return FLT_MAX;
+		return ray.origin.y + ray.direction.y * t - h;
+	}
+
+	//every hit must fall within a step of the first sample under the ground, a ray the sampling crosses must hit
+	//and a hit the sampling steps over may only graze the surface
+	void checkAgainstSampling(Map& map, const std::vector<TerrainRay>& rays, std::vector<TerrainHit>& hits)
+	{
+		const float step = 0.01f;
+		int wrongDistance = 0;
+		int missed = 0;
+		int extra = 0;
+		int offSurface = 0;
+		int hitCount = 0;
+		hits.resize(rays.size());
+		for (size_t i = 0; i < rays.size(); i++)
+		{
+			bool hit = map.Raycast(rays[i], hits[i]);
+			float expected = 0.0f;
+			bool sampled = denseHit(map, rays[i], step, expected);
+			if (hit)
+			{
+				hitCount++;
+				//a ray entering the map under the ground stops at the border
+				const DirectX::XMFLOAT3& p = hits[i].position;
+				bool border = p.x < 1e-3f || p.z < 1e-3f || p.x > map.width - 1 - 1e-3f || p.z > map.height - 1 - 1e-3f;
+				float h;
+				residentHeight(map, std::clamp(p.x, 0.0f, map.width - 1.0f), std::clamp(p.z, 0.0f, map.height - 1.0f), h);
+				if ( (border ? p.y > h + 1e-2f : std::fabs(p.y - h) > 1e-2f)) offSurface++;
+			}
+			if (hit && sampled)
+			{
+				if (hits[i].distance < expected - step - 1e-2f || hits[i].distance > expected + 1e-2f) wrongDistance++;
+			}
+			else if (sampled)
+			{
+				if (clearance(map, rays[i], expected) < -1e-3f) missed++;
+			}
+			else if (hit)
+			{
+				if (clearance(map, rays[i], hits[i].distance) > 1e-2f) extra++;
+			}
+		}
+		CHECK(hitCount > static_cast<int>(rays.size()) / 4);
+		CHECK(wrongDistance == 0);
+		CHECK(missed == 0);
+		CHECK(extra == 0);
+		CHECK(offSurface == 0);
+		if (wrongDistance || missed || extra || offSurface)
+		{
+			printf("%d hits at the wrong distance, %d missed, %d not in the sampling, %d off the surface of %zu rays\n", wrongDistance, missed, extra, offSurface, rays.size());
+		}
+	}
+
+	//rolling ground with per texel noise, nothing like the resident map so a mixed up read shows
+	float streamedHeight(int x, int z)
+	{
+		return 300.0f + 50.0f * std::sin(x * 0.03f) * std::cos(z * 0.02f) + static_cast<float>((x * 31 + z * 17) % 7);
+	}
+}
+
+int main()
+{
+	Map map;
+	map.width = 211;
+	map.height = 157;
+	std::mt19937 rng(23);
+	std::uniform_int_distribution<int> noise(0, 600);
+	map.heightMap.resize(static_cast<size_t>(map.width) * map.height);
+	for (int z = 0; z < map.height; z++)
+	{
+		for (int x = 0; x < map.width; x++)
+		{
+			float hills = 20000.0f + 12000.0f * std::sin(x * 0.07f) * std::cos(z * 0.05f);
+			map.heightMap[z * map.width + x] = static_cast<uint16_t>(hills + noise(rng));
+		}
+	}
+	//a few thin spikes the coarse pyramid levels have to lead the ray into
+	for (int i = 0; i < 30; i++) map.heightMap[rng() % map.heightMap.size()] = static_cast<uint16_t>(45000 + rng() % 20000);
+	map.BuildHeightPyramid();
+
+	std::vector<TerrainRay> rays = makeRays(map, 2000, 5);
+	std::vector<TerrainHit> resident;
+	checkAgainstSampling(map, rays, resident);
+
+	//a streamed world several times the resident map's size
+	const int side = 640;
+	const char* file = "TerrainRaycastTest.tiles";
+	CHECK(TerrainTiles::write(file, side, side, 64, 16, streamedHeight));
+	CHECK(map.OpenTerrainTiles(file));
+	CHECK(map.width == 211 && map.height == 157);
+	CHECK(map.WorldWidth() == side && map.WorldHeight() == side);
+	//an overview texel, so it holds whether or not its tile is resident yet
+	CHECK(std::fabs(map.GetHeight(96.0f, 96.0f) - streamedHeight(96, 96)) < 1e-2f);
+
+	//the same rays give the same hits, and rays beyond the resident map find nothing rather than reading past it
+	std::vector<TerrainHit> streamed;
+	checkAgainstSampling(map, rays, streamed);
+	int changed = 0;
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		if (streamed[i].hit != resident[i].hit || streamed[i].distance != resident[i].distance) changed++;
+	}
+	CHECK(changed == 0);
+	int beyond = 0;
+	for (int i = 0; i < 200; i++)
+	{
+		TerrainRay ray;
+		ray.origin = { 300.0f + i, 200.0f, 300.0f + (i * 7) % 300 };
+		ray.direction = { -0.1f, -1.0f, 0.05f };
+		ray.maxDistance = 400.0f;
+		TerrainHit hit;
+		if (map.Raycast(ray, hit)) beyond++;
+	}
+	CHECK(beyond == 0);
+
+	//saving writes the resident map, not the streamed world's size over the resident samples
+	const char* saved = "TerrainRaycastTestSaved.tiles";
+	CHECK(map.SaveTerrainTiles(saved, 64, 16));
+	TerrainTiles tiles;
+	CHECK(tiles.open(saved));
+	CHECK(tiles.width() == map.width && tiles.height() == map.height);
+	tiles.update(static_cast<float>(map.width / 2), static_cast<float>(map.height / 2));
+	tiles.flush();
+	int wrongTexels = 0;
+	//GetHeight is 0 on the last row and column, like Map's
+	for (int z = 0; z + 1 < map.height; z += 13)
+	{
+		for (int x = 0; x + 1 < map.width; x += 11)
+		{
+			float h;
+			residentHeight(map, static_cast<float>(x), static_cast<float>(z), h);
+			if (std::fabs(tiles.GetHeight(static_cast<float>(x), static_cast<float>(z)) - h) > 1e-2f) wrongTexels++;
+		}
+	}
+	CHECK(wrongTexels == 0);
+
+	tiles.close();
+	map.terrainTiles.reset();
+	std::filesystem::remove(file);
+	std::filesystem::remove(saved);
+	return testResult();
+}
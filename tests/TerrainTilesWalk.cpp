@@ -0,0 +1,177 @@
+//scripted walk across a streamed world: every tick the resident tiles must stay inside the memory budget, and after
+//each flush every height and max height query around the walker must match the generator's texels exactly
+//and a level file's TerrainTiles line must open the file whether the level is parsed or read from its cache
+//usage: TerrainTilesWalk [world side], ctest runs a 4096 world, GAME_LARGE_TESTS adds the 32768 one (a 4.4 GB file)
+#include "LevelCache.h"
+#include "TerrainTiles.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+
+namespace
+{
+	//rolling hills plus per texel noise, so a wrong tile or a wrong texel inside one never goes unnoticed
+	float heightAt(int x, int z)
+	{
+		uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(z) * 19349663u;
+		hash = (hash ^ (hash >> 13)) * 1274126177u;
+		float noise = static_cast<float>(hash >> 8) / 16777216.0f;
+		return 100.0f + 40.0f * std::sin(x * 0.01f) * std::cos(z * 0.013f) + 10.0f * std::sin((x * 7 + z * 13) * 0.002f) + noise;
+	}
+
+	//Map::GetHeight on the generator's texels
+	float referenceHeight(int side, float x, float z)
+	{
+		int x0 = static_cast<int>(std::floor(x));
+		int z0 = static_cast<int>(std::floor(z));
+		if (x0 < 0 || x0 + 1 >= side || z0 < 0 || z0 + 1 >= side) return 0.0f;
+		float h00 = heightAt(x0, z0);
+		float h01 = heightAt(x0 + 1, z0);
+		float h10 = heightAt(x0, z0 + 1);
+		float h11 = heightAt(x0 + 1, z0 + 1);
+		float dx = x - static_cast<float>(x0);
+		float dz = z - static_cast<float>(z0);
+		float h0 = h00 + (h01 - h00) * dx;
+		float h1 = h10 + (h11 - h10) * dx;
+		return h0 + (h1 - h0) * dz;
+	}
+
+	//Map::GetMaxHeight on the generator's texels
+	float referenceMaxHeight(int side, float minX, float minZ, float maxX, float maxZ)
+	{
+		int x0 = static_cast<int>(std::floor(minX));
+		int z0 = static_cast<int>(std::floor(minZ));
+		int x1 = static_cast<int>(std::ceil(maxX));
+		int z1 = static_cast<int>(std::ceil(maxZ));
+		bool outside = x0 < 0 || z0 < 0 || static_cast<int>(std::floor(maxX)) + 1 >= side || static_cast<int>(std::floor(maxZ)) + 1 >= side;
+		float best = outside ? 0.0f : -FLT_MAX;
+		for (int z = std::max(z0, 0); z <= std::min(z1, side - 1); z++)
+		{
+			for (int x = std::max(x0, 0); x <= std::min(x1, side - 1); x++) best = std::max(best, heightAt(x, z));
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int side = argc > 1 ? std::atoi(argv[1]) : 4096;
+	bool large = side > 8192;
+	const char* file = "TerrainTilesWalk.tiles";
+	int tileSize = large ? 256 : 128;
+	if (!TerrainTiles::write(file, side, side, tileSize, 32, heightAt))
+	{
+		printf("could not write %s\n", file);
+		return 1;
+	}
+
+	TerrainTiles tiles;
+	tiles.memoryBudget = large ? 48 << 20 : 8 << 20;
+	tiles.loadRadius = large ? 1024.0f : 384.0f;
+	CHECK(tiles.open(file));
+	CHECK(tiles.width() == side && tiles.height() == side);
+
+	//corner to corner legs at 8, 64 and 256 texels per tick, the world scaled to its side
+	const float waypoints[][2] = { { 0.02f, 0.02f }, { 0.95f, 0.07f }, { 0.95f, 0.95f }, { 0.05f, 0.93f }, { 0.5f, 0.5f }, { 0.98f, 0.3f } };
+	const float speeds[] = { 8.0f, 64.0f, 256.0f };
+	std::mt19937 random(21);
+	std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+	std::uniform_real_distribution<float> size(0.0f, 40.0f);
+
+	int ticks = 0;
+	int flushes = 0;
+	int fallbackTicks = 0;
+	int overBudget = 0;
+	int notResident = 0;
+	int heightMismatches = 0;
+	int maxMismatches = 0;
+	double updateMs = 0.0;
+	double worstUpdateMs = 0.0;
+	size_t largestResident = 0;
+	for (size_t leg = 0; leg + 1 < sizeof(waypoints) / sizeof(waypoints[0]); leg++)
+	{
+		float x0 = waypoints[leg][0] * side;
+		float z0 = waypoints[leg][1] * side;
+		float x1 = waypoints[leg + 1][0] * side;
+		float z1 = waypoints[leg + 1][1] * side;
+		float speed = speeds[leg % 3];
+		int steps = std::max(1, static_cast<int>(std::hypot(x1 - x0, z1 - z0) / speed));
+		for (int step = 0; step <= steps; step++)
+		{
+			float x = x0 + (x1 - x0) * step / steps;
+			float z = z0 + (z1 - z0) * step / steps;
+			auto start = std::chrono::steady_clock::now();
+			tiles.update(x, z);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			updateMs += ms;
+			worstUpdateMs = std::max(worstUpdateMs, ms);
+			ticks++;
+			largestResident = std::max(largestResident, tiles.residentBytes());
+			if (tiles.residentBytes() > tiles.memoryBudget) overBudget++;
+			if (!tiles.isResident(x, z)) fallbackTicks++;
+
+			if (step % 32 != 0 && step != steps) continue;
+			//everything the walker wants is resident now, queries must read it and nothing else
+			tiles.flush();
+			flushes++;
+			if (tiles.residentBytes() > tiles.memoryBudget) overBudget++;
+			float reach = tiles.loadRadius * 0.5f;
+			for (int i = 0; i < 64; i++)
+			{
+				float px = x + offset(random) * reach;
+				float pz = z + offset(random) * reach;
+				if (!tiles.isResident(std::clamp(px, 0.0f, side - 1.0f), std::clamp(pz, 0.0f, side - 1.0f))) notResident++;
+				if (tiles.GetHeight(px, pz) != referenceHeight(side, px, pz)) heightMismatches++;
+				float w = size(random);
+				float d = size(random);
+				if (tiles.GetMaxHeight(px, pz, px + w, pz + d) != referenceMaxHeight(side, px, pz, px + w, pz + d)) maxMismatches++;
+			}
+		}
+	}
+
+	CHECK(overBudget == 0);
+	CHECK(notResident == 0);
+	CHECK(heightMismatches == 0);
+	CHECK(maxMismatches == 0);
+	//the walk has to cycle the cache to test the budget at all
+	CHECK(tiles.tilesEvicted > 0);
+	printf("%dx%d world, %d texel tiles, %zu MB budget, %.0f texel radius\n", side, side, tileSize, tiles.memoryBudget >> 20, tiles.loadRadius);
+	printf("%d ticks, %d flushes, %llu tiles loaded, %llu evicted, largest resident %.1f MB\n", ticks, flushes,
+		static_cast<unsigned long long>(tiles.tilesLoaded), static_cast<unsigned long long>(tiles.tilesEvicted), largestResident / 1048576.0);
+	printf("walker on the overview in %d ticks, update %.3f ms mean, %.3f ms worst\n", fallbackTicks, updateMs / ticks, worstUpdateMs);
+	printf("after flush: %d samples not resident, %d heights and %d max heights differ from the texels\n", notResident, heightMismatches, maxMismatches);
+
+	tiles.close();
+
+	//a level's TerrainTiles line opens the file on the parsed and on the cached load
+	const char* levelFile = "TerrainTilesWalk.txt";
+	{
+		std::ofstream level(levelFile, std::ios::trunc);
+		level << "Terrain," << GAME_SOURCE_DIR << "/Res/HeightMap2.png," << GAME_SOURCE_DIR << "/Res/HeightMap2_Diffuse.png,0,0,0,0,0,0,1,1,1\n";
+		level << "TerrainTiles," << file << "\n";
+	}
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	for (int pass = 0; pass < 2; pass++)
+	{
+		MeshManager meshManager;
+		ObjectManager objectManager;
+		Map map;
+		std::string filename = levelFile;
+		meshManager.loadlevel(filename, objectManager, map);
+		CHECK(meshManager.options.terrainTiles == file);
+		CHECK(map.WorldWidth() == side && map.WorldHeight() == side);
+		CHECK(map.width < side && !map.heightMap.empty());
+	}
+	CHECK(std::filesystem::exists(LevelCache::cacheFileName(levelFile)));
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::filesystem::remove(levelFile);
+
+	std::filesystem::remove(file);
+	return testResult();
+}
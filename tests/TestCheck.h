@@ -0,0 +1,34 @@
+#pragma once
+//minimal checks for the headless tests, a failed check is reported and the test carries on,
+//main returns testResult() so ctest sees every failure of a run at once
+#include <cstdio>
+
+inline int& testFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			testFailures()++; \
+		} \
+	} while (0)
+
+inline int testResult()
+{
+	if (testFailures() > 0)
+	{
+		printf("%d checks failed\n", testFailures());
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
+
+//assets are read from the source tree, scratch files are written to the working directory (the build tree)
+#ifndef GAME_SOURCE_DIR
+#define GAME_SOURCE_DIR "."
+#endif
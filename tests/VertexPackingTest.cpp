@@ -0,0 +1,217 @@
+//packVertices then unpackVertex on every mesh of the shipped assets must stay within the packing's error bounds,
+//and a level read from the cache must come out packed exactly like the one it was baked from
+#include "LevelCache.h"
+#include "TestCheck.h"
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+	const char* levelFile = "VertexPackingTest.txt";
+
+	struct Errors
+	{
+		int vertices = 0;
+		int position = 0;
+		int normal = 0;
+		int tangent = 0;
+		int uv = 0;
+		int bones = 0;
+		int weights = 0;
+		float worstNormal = 0.0f;
+		float worstTangent = 0.0f;
+	};
+
+	//unorm16 rounding moves a position by at most half a step of its axis, plus the float error of the decode
+	bool positionClose(float original, float decoded, float offset, float scale)
+	{
+		float tolerance = scale / 131070.0f + 4.0f * FLT_EPSILON * (std::fabs(offset) + std::fabs(scale));
+		return std::fabs(original - decoded) <= tolerance;
+	}
+
+	//degrees between a vector and its decoded direction, 0 for a degenerate vector, which decodes to +y
+	float angleDegrees(const DirectX::XMFLOAT3& original, const DirectX::XMFLOAT3& decoded)
+	{
+		float length = std::sqrt(original.x * original.x + original.y * original.y + original.z * original.z);
+		if (!(length > 1e-6f)) return 0.0f;
+		float cosine = (original.x * decoded.x + original.y * decoded.y + original.z * decoded.z) / length;
+		return std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * 180.0f / static_cast<float>(M_PI);
+	}
+
+	//halfs round to 11 significant bits
+	bool uvClose(float original, float decoded)
+	{
+		return std::fabs(original - decoded) <= std::fabs(original) / 2048.0f + 6e-8f;
+	}
+
+	template <typename Vertex>
+	void checkCommon(const Vertex& original, const Vertex& decoded, const PositionQuantization& q, Errors& errors)
+	{
+		errors.vertices++;
+		if (!positionClose(original.position.x, decoded.position.x, q.offset.x, q.scale.x) ||
+			!positionClose(original.position.y, decoded.position.y, q.offset.y, q.scale.y) ||
+			!positionClose(original.position.z, decoded.position.z, q.offset.z, q.scale.z)) errors.position++;
+		float normal = angleDegrees(original.normal, decoded.normal);
+		float tangent = angleDegrees(original.tangent, decoded.tangent);
+		errors.worstNormal = std::max(errors.worstNormal, normal);
+		errors.worstTangent = std::max(errors.worstTangent, tangent);
+		//packOctahedral's worst case is just under a degree
+		if (normal > 1.0f) errors.normal++;
+		if (tangent > 1.0f) errors.tangent++;
+		if (!uvClose(original.uvCoords.x, decoded.uvCoords.x) || !uvClose(original.uvCoords.y, decoded.uvCoords.y)) errors.uv++;
+	}
+
+	void report(const char* kind, const Errors& errors)
+	{
+		CHECK(errors.vertices > 0);
+		CHECK(errors.position == 0);
+		CHECK(errors.normal == 0);
+		CHECK(errors.tangent == 0);
+		CHECK(errors.uv == 0);
+		CHECK(errors.bones == 0);
+		CHECK(errors.weights == 0);
+		printf("%s: %d vertices, worst normal %.2f deg, worst tangent %.2f deg, out of bounds: %d positions, %d normals, %d tangents, %d uvs, %d bone ids, %d weights\n",
+			kind, errors.vertices, errors.worstNormal, errors.worstTangent, errors.position, errors.normal, errors.tangent, errors.uv, errors.bones, errors.weights);
+	}
+
+	//every mesh of a float level through its own quantization
+	void checkRoundTrip(const MeshManager& meshManager)
+	{
+		Errors staticErrors;
+		Errors dynamicErrors;
+		for (const auto& pair : meshManager.objects)
+		{
+			const MeshDescriptor& md = pair.second;
+			if (md.isDynamic)
+			{
+				const Vertex_Dynamic* vertices = meshManager.vertices_Dynamic.data() + md.vertexOffset;
+				PositionQuantization q = computePositionQuantization(vertices, md.vertexCount);
+				std::vector<Vertex_DynamicPacked> packed(md.vertexCount);
+				CHECK(packVertices(vertices, md.vertexCount, q, packed.data()));
+				for (int i = 0; i < md.vertexCount; i++)
+				{
+					Vertex_Dynamic decoded = unpackVertex(packed[i], q);
+					checkCommon(vertices[i], decoded, q, dynamicErrors);
+					float sum = 0.0f;
+					int packedSum = 0;
+					for (int k = 0; k < 4; k++)
+					{
+						sum += std::max(vertices[i].boneWeights[k], 0.0f);
+						packedSum += packed[i].boneWeights[k];
+					}
+					bool wrongWeight = packedSum != (sum > 0.0f ? 255 : 0);
+					for (int k = 0; k < 4; k++)
+					{
+						if (vertices[i].boneWeights[k] > 0.0f && decoded.bonesIDs[k] != vertices[i].bonesIDs[k]) dynamicErrors.bones++;
+						float expected = sum > 0.0f ? std::max(vertices[i].boneWeights[k], 0.0f) / sum : 0.0f;
+						if (std::fabs(decoded.boneWeights[k] - expected) > 1.0f / 255.0f + 1e-6f) wrongWeight = true;
+					}
+					if (wrongWeight) dynamicErrors.weights++;
+				}
+			}
+			else
+			{
+				const Vertex_Static* vertices = meshManager.vertices_Static.data() + md.vertexOffset;
+				PositionQuantization q = computePositionQuantization(vertices, md.vertexCount);
+				std::vector<Vertex_StaticPacked> packed(md.vertexCount);
+				packVertices(vertices, md.vertexCount, q, packed.data());
+				for (int i = 0; i < md.vertexCount; i++) checkCommon(vertices[i], unpackVertex(packed[i], q), q, staticErrors);
+			}
+		}
+		report("static", staticErrors);
+		report("dynamic", dynamicErrors);
+	}
+
+	void writeLevel(const std::string& staticModel)
+	{
+		std::ofstream level(levelFile, std::ios::trunc);
+		level << "Terrain," << GAME_SOURCE_DIR << "/Res/HeightMap2.png," << GAME_SOURCE_DIR << "/Res/HeightMap2_Diffuse.png,0,0,0,0,0,0,1,1,1\n";
+		level << "NPC," << GAME_SOURCE_DIR << "/Res/TRex.gem,100,0,50,0,0,0,1,1,1,Idle,200,0,50,0,0,0,2,2,2,Idle\n";
+		level << "Static," << GAME_SOURCE_DIR << "/Res/" << staticModel << ",100,0,300,0,0,0,0.2,0.2,0.2,200,0,300,0,0,0,0.4,0.4,0.4\n";
+	}
+
+	//the packed pools and the quantization every instance carries
+	void checkPacked(const MeshManager& meshManager, size_t staticCount, size_t dynamicCount)
+	{
+		CHECK(meshManager.packVertices);
+		CHECK(meshManager.vertices_Static.empty());
+		CHECK(meshManager.vertices_Dynamic.empty());
+		CHECK(meshManager.verticesPacked_Static.size() == staticCount);
+		CHECK(meshManager.verticesPacked_Dynamic.size() == dynamicCount);
+		int wrongInstances = 0;
+		for (const auto& pair : meshManager.objects)
+		{
+			const MeshDescriptor& md = pair.second;
+			for (int i = md.instanceOffset; i < md.instanceOffset + md.instanceCount; i++)
+			{
+				const InstanceData_General& instance = meshManager.instances[i];
+				if (std::memcmp(&instance.PositionScale, &md.quantization.scale, sizeof(DirectX::XMFLOAT3)) != 0 ||
+					std::memcmp(&instance.PositionOffset, &md.quantization.offset, sizeof(DirectX::XMFLOAT3)) != 0) wrongInstances++;
+			}
+		}
+		CHECK(wrongInstances == 0);
+	}
+}
+
+int main()
+{
+	const char* statics[] = { "teraccgda.gem", "acacia_003.gem" };
+	for (const char* staticModel : statics)
+	{
+		writeLevel(staticModel);
+		std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+		std::string filename = levelFile;
+		printf("%s\n", staticModel);
+
+		//float pools, the reference for the round trip and for the packed loads
+		MeshManager reference;
+		{
+			ObjectManager objectManager;
+			Map map;
+			reference.loadlevel(filename, objectManager, map);
+		}
+		CHECK(reference.verticesPacked_Static.empty());
+		checkRoundTrip(reference);
+
+		//parsed and cached loads must both pack, into the same bytes
+		std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+		MeshManager parsed;
+		parsed.packVertices = true;
+		{
+			ObjectManager objectManager;
+			Map map;
+			parsed.loadlevel(filename, objectManager, map);
+		}
+		checkPacked(parsed, reference.vertices_Static.size(), reference.vertices_Dynamic.size());
+		CHECK(std::filesystem::exists(LevelCache::cacheFileName(levelFile)));
+
+		MeshManager cached;
+		cached.packVertices = true;
+		{
+			ObjectManager objectManager;
+			Map map;
+			MeshManager probe;
+			probe.packVertices = true;
+			CHECK(LevelCache().load(filename, probe, objectManager, map));
+			CHECK(probe.packVertices);
+		}
+		{
+			ObjectManager objectManager;
+			Map map;
+			cached.loadlevel(filename, objectManager, map);
+		}
+		checkPacked(cached, reference.vertices_Static.size(), reference.vertices_Dynamic.size());
+		CHECK(cached.verticesPacked_Static.size() == parsed.verticesPacked_Static.size() &&
+			std::memcmp(cached.verticesPacked_Static.data(), parsed.verticesPacked_Static.data(), parsed.verticesPacked_Static.size() * sizeof(Vertex_StaticPacked)) == 0);
+		CHECK(cached.verticesPacked_Dynamic.size() == parsed.verticesPacked_Dynamic.size() &&
+			std::memcmp(cached.verticesPacked_Dynamic.data(), parsed.verticesPacked_Dynamic.data(), parsed.verticesPacked_Dynamic.size() * sizeof(Vertex_DynamicPacked)) == 0);
+	}
+
+	std::filesystem::remove(LevelCache::cacheFileName(levelFile));
+	std::filesystem::remove(levelFile);
+	return testResult();
+}